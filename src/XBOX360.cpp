@@ -18,366 +18,1387 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <stdexcept>
-#include <vector>
-#include <future>
 
 #include "XBOX360.hpp"
+#include "XBOX360Decode.hpp"
+#include "XBOX360Report.hpp"
 
-#define CONTROLLER_BOUNDS(C) std::max(std::min(C, MAX_CONTROLLERS), 0)
-#define APPLY_MASK(VALUE, MASK) ((VALUE & MASK) > 0)
+#define CONTROLLER_BOUNDS(C) std::max(std::min(C, MAX_CONTROLLERS - 1), 0)
 
 XKCTRL::XBOX360::XBOX360()
-  : USBDeviceThreadRunning_(false)
+  : XBOX360(std::unique_ptr<Transport>(new LibUSBTransport()))
 {
+}
+
+XKCTRL::XBOX360::XBOX360(const REALTIME_CONFIG& RealtimeConfig)
+  : XBOX360(std::unique_ptr<Transport>(new LibUSBTransport()), RealtimeConfig)
+{
+}
+
+XKCTRL::XBOX360::XBOX360(std::unique_ptr<Transport> ControllerTransport, const REALTIME_CONFIG& RealtimeConfig)
+  : Transport_(std::move(ControllerTransport)),
+    USBDeviceThreadRunning_(false),
+    RealtimeConfig_(RealtimeConfig),
+    EventTapOpen_(false)
+{
+  // eventfds for epoll/poll integration, all non blocking
+  ReceiverEventFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ReceiverEventFD_ < 0)
+    throw std::runtime_error("Error creating receiver eventfd");
+  for (int32_t i = 0; i < MAX_CONTROLLERS; i++)
+  {
+    ControllerEventFD_[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ControllerEventFD_[i] < 0)
+    {
+      // the destructor does not run for a constructor that throws
+      while (i-- > 0)
+        close(ControllerEventFD_[i]);
+      close(ReceiverEventFD_);
+      throw std::runtime_error("Error creating controller eventfd");
+    }
+  }
+
+  for (auto& enabled : AnalogEnabled_)
+    enabled = false;
+  for (auto& active : SubscriptionsActive_)
+    active = 0;
+  for (auto& generation : ControllerGeneration_)
+    generation = 0;
+  SnapshotSequence_ = 0;
+
   // start with cleared controller states
   ControllerDisconnectAll();
 
+  // diagnostics from the device thread are printed from here on
+  if (XBOX360_LOG_PRINTER)
+    LogPrinterStart();
+
   //start Wireless Device polling thread.
   USBDeviceThreadRunning_ = true;
   USBDeviceThread_ = std::thread(&XBOX360::USBDeviceThread, this);
+
+  //memory is locked and prefaulted before the first call into the API
+  RealtimeApplied_.get_future().wait();
 }
 
 XKCTRL::XBOX360::~XBOX360()
 {
-  //kill async polling
+  //complete pending asynchronous waits while their timers can still be
+  //cancelled, then drop pending timed rumbles before anything else is torn down
+  WaitersCancelAll();
+  RumbleScheduler_.Stop();
+
+  //kill async polling, the transport releases all devices on exit
   USBDeviceThreadRunning_ = false;
+  Transport_->Stop();
   USBDeviceThread_.join();
 
-  if (USBDeviceHandle_)
+  if (XBOX360_LOG_PRINTER)
+    LogPrinterStop();
+
+  for (auto fd : ControllerEventFD_)
+    close(fd);
+  close(ReceiverEventFD_);
+  if (EventTapFD_ >= 0)
+    close(EventTapFD_);
+}
+
+void XKCTRL::XBOX360::USBDeviceThread()
+{
+  // whatever is not permitted is skipped, the thread then runs as before
+  if (!RealtimeApply(RealtimeConfig_, RealtimeStatus_))
+  {
+    LogWrite(LOG_WARNING, "WARNING: real-time mode only partly applied (scheduling: %s, affinity: %s, memory lock: %s)",
+             strerror(RealtimeStatus_.SCHEDULING_ERROR), strerror(RealtimeStatus_.AFFINITY_ERROR),
+             strerror(RealtimeStatus_.MEMORY_ERROR));
+  }
+  if (RealtimeConfig_.PREFAULT_STACK_KB)
+    RealtimePrefault(this, sizeof(*this));
+  RealtimeApplied_.set_value();
+
+  // the transport delivers every report on this thread until it is stopped
+  try
+  {
+    Transport_->Run(this);
+  }
+  catch(const std::exception& e)
+  {
+    LogWrite(LOG_ERROR, "ERROR Running Transport: %s", e.what());
+  }
+}
+
+void XKCTRL::XBOX360::TransportReport(const int32_t ControllerIndex, const uint8_t* Report,
+                                      const size_t Length, const uint64_t TimestampNS)
+{
+  if (ControllerIndex < 0 || ControllerIndex >= MAX_CONTROLLERS)
+    return;
+
+  // time since the previous report of this controller
+  if (XBOX360_STATS && USBTimestampIn_[ControllerIndex] != 0)
+    ReportInterval_[ControllerIndex].Record(TimestampNS - USBTimestampIn_[ControllerIndex]);
+  Reports_.Add();
+
+  // the parser never reads past the length, so nothing needs clearing
+  USBTimestampIn_[ControllerIndex] = TimestampNS;
+  USBLengthIn_[ControllerIndex] = std::min(Length, static_cast<size_t>(MAX_USB_INBUFF));
+  memcpy(USBDataIn_[ControllerIndex], Report, USBLengthIn_[ControllerIndex]);
+
+  //Process USB Controller data.  
+  try
+  {
+    ControllerDataProcessing(ControllerIndex);
+  }
+  catch(const std::exception& e)
+  {
+    // Error Processing Data..
+    LogWrite(LOG_ERROR, "ERROR Processing USB Data: %s", e.what());
+  }
+}
+
+void XKCTRL::XBOX360::TransportSent(const int32_t ControllerIndex, const bool Success)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+
+  //syncronize access to the output queue
+  auto guard = OutputLock();
+  USBTXBusy_[controlleridx] = false;
+  OutputTime_.Record(StatsNow() - OutputSubmitTime_[controlleridx]);
+  if (!Success)
+    OutputStats_.FAILED++;
+  OutputComplete(OutputInFlight_[controlleridx], Success);
+
+  // send whatever was queued while this report was in flight
+  USBTXSubmit(controlleridx);
+}
+
+void XKCTRL::XBOX360::TransportDetached(const int32_t FirstController, const int32_t ControllerCount)
+{
+  int32_t first = CONTROLLER_BOUNDS(FirstController);
+  int32_t last = std::min(first + ControllerCount, MAX_CONTROLLERS);
+
+  { // fail anything still waiting in the output queue
+    auto guard = OutputLock();
+    for (int32_t i = first; i < last; i++)
+    {
+      for (int32_t cmd = 0; cmd < OUTPUT_COMMANDS; cmd++)
+      {
+        if (OutputQueued_[i][cmd])
+          OutputStats_.FAILED++;
+        OutputQueued_[i][cmd] = false;
+        OutputComplete(OutputWaiters_[i][cmd], false);
+      }
+      OutputComplete(OutputInFlight_[i], false);
+      USBTXBusy_[i] = false;
+    }
+  }
+
+  //clear all controller states behind the device
+  ControllerDisconnect(first, last - first);
+}
+
+void XKCTRL::XBOX360::ControllerDataProcessing(const int32_t ControllerIndex)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+
+  // one table driven parse, dispatched on the report type
+  RECEIVER_REPORT report;
+  uint64_t decodestart = StatsNow();
+  switch (ParseReport(USBDataIn_[controlleridx], USBLengthIn_[controlleridx], report))
+  {
+    case REPORT_LINK:
+      ControllerInfoUpdate(controlleridx, report);
+      if (report.LINK.CONTROLLER()) 
+      {
+        // Connected, Initialize, Set LED's and small Rumble
+        ControllerInit(controlleridx);
+        ControllerConnect(controlleridx, true);
+      }
+      else
+      {    
+        // only a headset or nothing is left
+        ControllerConnect(controlleridx, false);
+      }
+      return;
+
+    case REPORT_ANNOUNCE:
+    case REPORT_BATTERY:
+    case REPORT_CHATPAD:
+      ControllerInfoUpdate(controlleridx, report);
+      return;
+
+    case REPORT_INPUT:
+      break;
+
+    default:
+      // keep alives and reports nobody decodes yet
+      return;
+  }
+
+  // If controller status is not connected and we are receiving
+  // data from controller, it's alive, set as connected
+  ControllerConnect(controlleridx, true);
+  
+  CONTROLLER_PACKED_STATE& state = ControllerShadow_[controlleridx];
+  CONTROLLER_PACKED_STATE previous = state;
+  state = report.INPUT;
+
+  // queue an event with button edges and changed axes
+  CONTROLLER_EVENT event;
+  event.TIMESTAMP_NS = USBTimestampIn_[controlleridx];
+  event.PRESSED = state.BUTTONS & ~previous.BUTTONS & MASK_ALL_BUTTONS;
+  event.RELEASED = previous.BUTTONS & ~state.BUTTONS & MASK_ALL_BUTTONS;
+  event.BUTTONS = state.BUTTONS & MASK_ALL_BUTTONS;
+  event.CHANGED_AXES = ((state.LTRIG != previous.LTRIG) ? MASK_AXIS_LTRIG : 0x00) |
+                       ((state.RTRIG != previous.RTRIG) ? MASK_AXIS_RTRIG : 0x00) |
+                       ((state.LSTICK_X != previous.LSTICK_X) ? MASK_AXIS_LSTICK_X : 0x00) |
+                       ((state.LSTICK_Y != previous.LSTICK_Y) ? MASK_AXIS_LSTICK_Y : 0x00) |
+                       ((state.RSTICK_X != previous.RSTICK_X) ? MASK_AXIS_RSTICK_X : 0x00) |
+                       ((state.RSTICK_Y != previous.RSTICK_Y) ? MASK_AXIS_RSTICK_Y : 0x00);
+  event.LTRIG = state.LTRIG;
+  event.RTRIG = state.RTRIG;
+  event.LSTICK_X = state.LSTICK_X;
+  event.LSTICK_Y = state.LSTICK_Y;
+  event.RSTICK_X = state.RSTICK_X;
+  event.RSTICK_Y = state.RSTICK_Y;
+  if (event.PRESSED || event.RELEASED || event.CHANGED_AXES)
+    ControllerEventPush(controlleridx, event);
+
+  // advance the combo recognizer on new presses
+  ControllerCombos(controlleridx, event);
+
+  // optional deadzones, curves and smoothing
+  ControllerAnalog(controlleridx, state);
+
+  // publish new state, readers pick it up without locking
+  ControllerPublish(controlleridx, USBTimestampIn_[controlleridx]);
+  DecodeTime_.Record(StatsNow() - decodestart);
+
+  // wake only the subscribers whose filter matches
+  ControllerSubscriptions(controlleridx, previous, false);
+
+  // complete asynchronous waits, state waits on every report
+  ControllerWaiters(controlleridx, &event);
+
+  // valid data received, notify any waiting requests..
+  ControllerNotify(controlleridx);
+}
+
+void XKCTRL::XBOX360::ControllerInfoUpdate(const int32_t ControllerIndex, const XKCTRL::RECEIVER_REPORT& Report)
+{
+  // only the device thread writes, readers take a snapshot without locking
+  CONTROLLER_INFO& info = ControllerInfoShadow_[ControllerIndex];
+  switch (Report.TYPE)
   {
-    // attempt to release all interfaces
-    for (auto iface : USBInterfaces_)
-      libusb_release_interface(USBDeviceHandle_, iface);
+    case REPORT_LINK:
+      // a new controller in the slot announces itself again
+      if (!Report.LINK.CONTROLLER())
+        memset(&info, 0x00, sizeof(CONTROLLER_INFO));
+      info.LINK = Report.LINK;
+      break;
+    case REPORT_ANNOUNCE:
+      memcpy(info.SERIAL, Report.ANNOUNCE.SERIAL, sizeof(info.SERIAL));
+      info.SERIAL_VALID = true;
+      info.BATTERY = Report.ANNOUNCE.BATTERY;
+      info.BATTERY_VALID = true;
+      break;
+    case REPORT_BATTERY:
+      info.BATTERY = Report.BATTERY.LEVEL;
+      info.BATTERY_VALID = true;
+      break;
+    case REPORT_CHATPAD:
+      info.CHATPAD = Report.CHATPAD;
+      info.CHATPAD_VALID = true;
+      break;
+    default:
+      return;
+  }
+  info.TIMESTAMP_NS = USBTimestampIn_[ControllerIndex];
+  ControllerInfo_[ControllerIndex].Store(info);
+}
+
+void XKCTRL::XBOX360::ControllerAnalog(const int32_t ControllerIndex, const XKCTRL::CONTROLLER_PACKED_STATE& State)
+{
+  // pick up a new configuration between two reports, without locking
+  if (AnalogPipelines_[ControllerIndex].Acquire())
+    AnalogEnabled_[ControllerIndex].store(AnalogPipelines_[ControllerIndex].Active()->Enabled(), std::memory_order_release);
 
-    libusb_close(USBDeviceHandle_);
+  AnalogPipeline* pipeline = AnalogPipelines_[ControllerIndex].Active();
+  if (pipeline && pipeline->Enabled())
+  {
+    ANALOG_STATE analog;
+    pipeline->Process(State, USBTimestampIn_[ControllerIndex], analog);
+    AnalogStates_[ControllerIndex].Store(analog);
   }
+}
+
+void XKCTRL::XBOX360::ControllerEventPush(const int32_t ControllerIndex, const XKCTRL::CONTROLLER_EVENT& Event)
+{
+  // the tap keeps its own ring, so its reader never takes events from ReadControllerEvents
+  ControllerEvents_[ControllerIndex].Push(Event);
+  if (EventTapOpen_.load(std::memory_order_acquire))
+    EventTap_[ControllerIndex].Push(Event);
+}
+
+void XKCTRL::XBOX360::ControllerCombos(const int32_t ControllerIndex, const XKCTRL::CONTROLLER_EVENT& Event)
+{
+  // a new recognizer starts from scratch, also swapped in without locking
+  Combos_[ControllerIndex].Acquire();
 
-  //close out context
-  if (USBContext_)
-    libusb_exit(USBContext_);
+  ComboRecognizer* combos = Combos_[ControllerIndex].Active();
+  if (!combos || !combos->MACHINE)
+    return;
+
+  combos->MACHINE->Advance(combos->CURSOR, Event.PRESSED, Event.BUTTONS, Event.TIMESTAMP_NS, [&](const int32_t Combo)
+  {
+    COMBO_MATCH match = {Event.TIMESTAMP_NS, ControllerIndex, Combo};
+    ComboMatches_[ControllerIndex].Push(match);
+  });
 }
 
-void XKCTRL::XBOX360::USBDeviceInit()
+void XKCTRL::XBOX360::ControllerInit(const int32_t ControllerIndex)
 {
-// Init USB
-  int ret = libusb_init(&USBContext_);
-  if (ret != LIBUSB_SUCCESS)
-    throw std::runtime_error(libusb_strerror(static_cast<libusb_error>(ret)));
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  SetLED(controlleridx, LED_SETTING::OFF_ALL);
+  ControllerReady(controlleridx);
+}
 
-  // Create XBOX360 Wireless Receiver USB Device
-  USBDeviceHandle_ = libusb_open_device_with_vid_pid(USBContext_, USBVendorID_, USBProductID_);
-  if (!USBDeviceHandle_)
-    throw std::runtime_error("Error finding XBOX360 Wireless Receiver");
+void XKCTRL::XBOX360::USBTXSubmit(const int32_t ControllerIndex)
+{
+  // caller holds mutex_
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
 
-  // Claim all interfaces for all controllers
-  for (auto iface : USBInterfaces_)
+  // send the highest priority queued command, keep trying the next
+  // one if a report can not be queued at all.
+  for (int32_t cmd = 0; cmd < OUTPUT_COMMANDS && !USBTXBusy_[controlleridx]; cmd++)
   {
-    // detach from any kernel drivers - requires sudo
-    if (libusb_kernel_driver_active(USBDeviceHandle_, iface) == 0x01)
-      libusb_detach_kernel_driver(USBDeviceHandle_, iface);
+    if (!OutputQueued_[controlleridx][cmd])
+      continue;
+
+    OutputQueued_[controlleridx][cmd] = false;
+    OutputInFlight_[controlleridx].swap(OutputWaiters_[controlleridx][cmd]);
 
-    // claim interface
-    ret = libusb_claim_interface(USBDeviceHandle_, iface);
-    if (ret != LIBUSB_SUCCESS)
-      throw std::runtime_error(libusb_strerror(static_cast<libusb_error>(ret)));
+    OutputSubmitTime_[controlleridx] = StatsNow();
+    if (Transport_->Send(controlleridx, OutputQueue_[controlleridx][cmd], MAX_USB_OUTBUFF))
+    {
+      USBTXBusy_[controlleridx] = true;
+    }
+    else
+    {
+      OutputStats_.FAILED++;
+      OutputComplete(OutputInFlight_[controlleridx], false);
+    }
   }
+}
 
-  //clear all controller states
-  ControllerDisconnectAll();
+void XKCTRL::XBOX360::OutputQueue(const int32_t ControllerIndex, const USBOutputCommand Command, 
+                                  const uint8_t* Data, std::promise<bool>* Completion)
+{
+  //syncronize access to the output queue, never held across USB I/O
+  auto guard = OutputLock();
+  OutputEnqueue(ControllerIndex, Command, Data, Completion);
 }
 
-int32_t XKCTRL::XBOX360::USBRXAsync(const int32_t ControllerIndex)
+void XKCTRL::XBOX360::OutputEnqueue(const int32_t ControllerIndex, const USBOutputCommand Command, 
+                                    const uint8_t* Data, std::promise<bool>* Completion)
 {
+  // caller holds mutex_
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  OutputStats_.SUBMITTED++;
+
+  // latest wins, an older value still waiting to be sent is replaced
+  if (OutputQueued_[controlleridx][Command])
+    OutputStats_.COALESCED++;
 
-  //Read Controller data
-  memset(USBDataIn_[controlleridx], 0x00, MAX_USB_INBUFF);
-  int32_t datasize;
-  int32_t ret = libusb_interrupt_transfer(USBDeviceHandle_, USBEndpointsIn_[controlleridx], 
-                                          USBDataIn_[controlleridx], MAX_USB_INBUFF, &datasize, 
-                                          MAX_USB_TIMEOUT);
+  memcpy(OutputQueue_[controlleridx][Command], Data, MAX_USB_OUTBUFF);
+  OutputQueued_[controlleridx][Command] = true;
+  if (Completion)
+    OutputWaiters_[controlleridx][Command].push_back(std::move(*Completion));
 
-  return (ret == LIBUSB_SUCCESS)?controlleridx:ret;
+  if (!USBTXBusy_[controlleridx])
+    USBTXSubmit(controlleridx);
 }
 
-void XKCTRL::XBOX360::USBDeviceThread()
+std::unique_lock<std::mutex> XKCTRL::XBOX360::OutputLock()
 {
-  while (USBDeviceThreadRunning_)
+  // only time the wait when the mutex is actually held by someone else
+  std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+  if (XBOX360_STATS && !lock.owns_lock())
+  {
+    uint64_t start = StatsNow();
+    lock.lock();
+    MutexWait_.Record(StatsNow() - start);
+    MutexContended_.Add();
+  }
+  else if (!lock.owns_lock())
   {
-    // If Wireles Receiver not connected, try connect
-    if (USBDeviceHandle_ == nullptr)
+    lock.lock();
+  }
+  MutexAcquired_.Add();
+  return lock;
+}
+
+void XKCTRL::XBOX360::OutputComplete(std::vector<std::promise<bool>>& Waiters, bool Result)
+{
+  for (auto& waiter : Waiters)
+    waiter.set_value(Result);
+  Waiters.clear();
+}
+
+void XKCTRL::XBOX360::ControllerReady(const int32_t ControllerIndex)
+{
+  // Transfer Controller ready command
+  uint8_t data[MAX_USB_OUTBUFF] = {0x00};
+  data[2] = 0x02;
+  data[3] = 0x80;
+  OutputQueue(ControllerIndex, USBOutputCommand::READY, data, nullptr);
+}
+
+void XKCTRL::XBOX360::ControllerConnect(const int32_t ControllerIndex, bool IsConnected) 
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  bool AlreadyConnected = false;
+  
+  // Only the device thread updates controller states
+  AlreadyConnected = ControllerShadow_[controlleridx].CONNECTED();
+  if (AlreadyConnected != IsConnected)
+  {
+    ControllerShadow_[controlleridx].BUTTONS ^= MASK_CONNECTED;
+    (IsConnected ? Connects_ : Disconnects_).Add();
+    if (IsConnected && AnalogPipelines_[controlleridx].Active())
+      AnalogPipelines_[controlleridx].Active()->Reset();
+    if (IsConnected && Combos_[controlleridx].Active())
+      ComboMachine::Reset(Combos_[controlleridx].Active()->CURSOR);
+    ControllerPublish(controlleridx, USBTimestampIn_[controlleridx]);
+    ControllerSubscriptions(controlleridx, ControllerShadow_[controlleridx], true);
+    ControllerWaiters(controlleridx, nullptr);
+    ControllerNotify(controlleridx);
+    if (!IsConnected)
+    {
+      // nothing would reach the controller, stop streaming to it
+      auto guard = OutputLock();
+      ControllerHapticsStop(controlleridx, false);
+    }
+  }
+
+  // small buzz on connect..
+  if (!AlreadyConnected && IsConnected)
+  {
+    SetLED(controlleridx, static_cast<LED_SETTING>(LED_SETTING::BLINK_1_ON + (controlleridx % RECEIVER_CONTROLLERS)));
+    SetRumbleTimed(controlleridx, 0x00, 0xFF, 250);
+  }
+}
+
+void XKCTRL::XBOX360::ControllerPublish(const int32_t ControllerIndex, const uint64_t TimestampNS)
+{
+  // latest state for GetControllerState with its generation, bracketed for
+  // snapshots of all controllers, and a timestamped copy for queries by time
+  // if it differs from the last one
+  uint64_t sequence = SnapshotSequence_.load(std::memory_order_relaxed);
+  SnapshotSequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ControllerStates_[ControllerIndex].Store(ControllerShadow_[ControllerIndex]);
+  ControllerGeneration_[ControllerIndex].fetch_add(1, std::memory_order_relaxed);
+  SnapshotSequence_.store(sequence + 2, std::memory_order_release);
+
+  ControllerHistory_[ControllerIndex].Push(TimestampNS, ControllerShadow_[ControllerIndex]);
+}
+
+void XKCTRL::XBOX360::ControllerNotify(const int32_t ControllerIndex)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+
+  { // waiters check the generation under the lock, taking it here orders
+    // the wakeup after any check that missed the new generation
+    std::lock_guard<std::mutex> guard(NotifyMutex_);
+  }
+  // wake every thread waiting on this controller or on any controller
+  ControllersNotify_[controlleridx].notify_all();
+  AnyNotify_.notify_all();
+
+  // make the controller and receiver eventfds readable
+  uint64_t signal = 1;
+  if (write(ControllerEventFD_[controlleridx], &signal, sizeof(signal)) < 0 ||
+      write(ReceiverEventFD_, &signal, sizeof(signal)) < 0 ||
+      (EventTapOpen_.load(std::memory_order_acquire) && write(EventTapFD_, &signal, sizeof(signal)) < 0))
+  {
+    // counter can only overflow if nobody ever reads it, nothing to do
+  }
+}
+
+void XKCTRL::XBOX360::ControllerSubscriptions(const int32_t ControllerIndex, const XKCTRL::CONTROLLER_PACKED_STATE& Previous, const bool WakeAll)
+{
+  // filters are checked without locking, the mutex is only taken to wake someone
+  const CONTROLLER_PACKED_STATE& state = ControllerShadow_[ControllerIndex];
+  uint32_t active = SubscriptionsActive_[ControllerIndex].load(std::memory_order_acquire);
+  uint32_t wake = 0;
+  while (active)
+  {
+    int32_t slot = __builtin_ctz(active);
+    active &= active - 1;
+    Subscription& subscription = Subscriptions_[ControllerIndex][slot];
+
+    // a new subscription in this slot starts out from the previous state
+    uint32_t version = subscription.Version.load(std::memory_order_acquire);
+    if (version != subscription.SeenVersion)
     {
-      try
+      subscription.Filter.Load(subscription.ActiveFilter);
+      subscription.Reference = Previous;
+      subscription.SeenVersion = version;
+    }
+
+    if (WakeAll || SubscriptionMatch(subscription.ActiveFilter, subscription.Reference, Previous, state))
+    {
+      subscription.Reference = state;
+      subscription.Delivered.fetch_add(1, std::memory_order_relaxed);
+      wake |= 1u << slot;
+    }
+    else
+    {
+      subscription.Suppressed.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  if (wake)
+    SubscriptionWake(ControllerIndex, wake);
+}
+
+void XKCTRL::XBOX360::SubscriptionWake(const int32_t ControllerIndex, const uint32_t Slots)
+{
+  {
+    std::lock_guard<std::mutex> guard(NotifyMutex_);
+    for (uint32_t slots = Slots; slots; slots &= slots - 1)
+      Subscriptions_[ControllerIndex][__builtin_ctz(slots)].Generation++;
+  }
+  for (uint32_t slots = Slots; slots; slots &= slots - 1)
+    Subscriptions_[ControllerIndex][__builtin_ctz(slots)].Notify.notify_all();
+}
+
+void XKCTRL::XBOX360::ControllerDisconnect(const int32_t FirstController, const int32_t ControllerCount)
+{
+  //Clear a range of controller states, only called before the 
+  //device thread starts or from the device thread itself
+  for (int32_t i = FirstController; i < FirstController + ControllerCount; i++)
+  {
+    // let event readers see buttons that were still held as released
+    uint16_t held = ControllerShadow_[i].BUTTONS & MASK_ALL_BUTTONS;
+    if (held)
+    {
+      CONTROLLER_EVENT event;
+      memset(&event, 0x00, sizeof(CONTROLLER_EVENT));
+      event.TIMESTAMP_NS = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch()).count();
+      event.RELEASED = held;
+      ControllerEventPush(i, event);
+    }
+
+    bool connected = ControllerShadow_[i].CONNECTED();
+    memset(&ControllerShadow_[i], 0x00, sizeof(CONTROLLER_PACKED_STATE));
+    if (connected)
+    {
+      Disconnects_.Add();
+      ControllerPublish(i, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    else
+    {
+      ControllerStates_[i].Store(ControllerShadow_[i]);
+    }
+
+    ANALOG_STATE analog;
+    memset(&analog, 0x00, sizeof(ANALOG_STATE));
+    AnalogStates_[i].Store(analog);
+    memset(&ControllerInfoShadow_[i], 0x00, sizeof(CONTROLLER_INFO));
+    ControllerInfo_[i].Store(ControllerInfoShadow_[i]);
+    if (connected)
+    {
+      ControllerSubscriptions(i, ControllerShadow_[i], true);
+      ControllerWaiters(i, nullptr);
+      ControllerNotify(i);
+      auto guard = OutputLock();
+      ControllerHapticsStop(i, false);
+    }
+  }
+}
+
+void XKCTRL::XBOX360::ControllerDisconnectAll()
+{
+  ControllerDisconnect(0, MAX_CONTROLLERS);
+}
+
+void XKCTRL::XBOX360::SetLED(const int32_t ControllerIndex, const XKCTRL::LED_SETTING LEDSetting)
+{
+  // Queue Controller LED Setting, returns without waiting for USB
+  uint8_t data[MAX_USB_OUTBUFF] = {0x00};
+  data[2] = 0x08;
+  data[3] = 0x40|static_cast<uint8_t>(LEDSetting);
+  OutputQueue(ControllerIndex, USBOutputCommand::LED, data, nullptr);
+}
+
+void XKCTRL::XBOX360::SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  // Queue Controller Rumble Setting, returns without waiting for USB
+  auto guard = OutputLock();
+  RumbleEnqueue(ControllerIndex, BigWeight, SmallWeight);
+}
+
+void XKCTRL::XBOX360::RumbleEnqueue(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  // caller holds mutex_, so the value is queued together with any
+  // RumbleGeneration_ change it belongs to
+  uint8_t data[MAX_USB_OUTBUFF] = {0x00};
+  data[1] = 0x01;
+  data[2] = 0x0f;
+  data[3] = 0xc0;
+  data[5] = BigWeight; 
+  data[6] = SmallWeight; 
+  OutputEnqueue(ControllerIndex, USBOutputCommand::RUMBLE, data, nullptr);
+}
+
+std::future<bool> XKCTRL::XBOX360::SetLEDAsync(const int32_t ControllerIndex, const XKCTRL::LED_SETTING LEDSetting)
+{
+  // same as SetLED, the future resolves once the USB transfer completed
+  std::promise<bool> completion;
+  std::future<bool> result = completion.get_future();
+
+  uint8_t data[MAX_USB_OUTBUFF] = {0x00};
+  data[2] = 0x08;
+  data[3] = 0x40|static_cast<uint8_t>(LEDSetting);
+  OutputQueue(ControllerIndex, USBOutputCommand::LED, data, &completion);
+  return result;
+}
+
+std::future<bool> XKCTRL::XBOX360::SetRumbleAsync(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  // same as SetRumble, the future resolves once the USB transfer completed
+  std::promise<bool> completion;
+  std::future<bool> result = completion.get_future();
+
+  uint8_t data[MAX_USB_OUTBUFF] = {0x00};
+  data[1] = 0x01;
+  data[2] = 0x0f;
+  data[3] = 0xc0;
+  data[5] = BigWeight; 
+  data[6] = SmallWeight; 
+  OutputQueue(ControllerIndex, USBOutputCommand::RUMBLE, data, &completion);
+  return result;
+}
+
+void XKCTRL::XBOX360::ControllerWaiters(const int32_t ControllerIndex, const XKCTRL::CONTROLLER_EVENT* Event)
+{
+  // connects and disconnects come without an event, a disconnect also ends event waits
+  const CONTROLLER_PACKED_STATE& state = ControllerShadow_[ControllerIndex];
+  ControllerWaiter* completed = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(NotifyMutex_);
+    ControllerWaiter* waiter = Waiters_[ControllerIndex];
+    while (waiter)
+    {
+      ControllerWaiter* next = waiter->Next;
+      int32_t result = WAIT_PENDING;
+      if (waiter->Rumble)
       {
-        // Find and initialize XBOX360 Wireless device
-        USBDeviceInit();            
+        // rumble waits only end with their timer
+        waiter = next;
+        continue;
       }
-      catch(const std::exception& e)
+      if (!waiter->Buttons && !waiter->Axes)
+        result = WAIT_READY;
+      else if (Event && (((Event->PRESSED | Event->RELEASED) & waiter->Buttons) || (Event->CHANGED_AXES & waiter->Axes)))
+        result = WAIT_READY;
+      else if (!Event && !state.CONNECTED())
+        result = WAIT_DISCONNECTED;
+
+      // a timeout or cancel may have won already, it unlinks the waiter itself
+      int32_t pending = WAIT_PENDING;
+      if (result != WAIT_PENDING && waiter->Result.compare_exchange_strong(pending, result))
       {
-        // No Wireless device found.. will try again
-        std::cerr << e.what() << '\n';
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        waiter->State = state;
+        if (Event)
+          waiter->Event = *Event;
+        WaiterUnlink(waiter);
+        waiter->Next = completed;
+        completed = waiter;
       }
+      waiter = next;
     }
-    else
-    {
-      // Wireless Device Connected, schedule parralel async data transfer for all controllers
-      std::vector<std::future<int32_t>> future_transfers;
-      for (uint32_t i = 0; i < MAX_CONTROLLERS; i++)
-        future_transfers.push_back(std::async(std::launch::async, &XBOX360::USBRXAsync, this, i));
+  }
+  WaitersComplete(completed);
+}
+
+void XKCTRL::XBOX360::WaitAsync(XKCTRL::ControllerWaiter& Waiter)
+{
+  Waiter.Controller = CONTROLLER_BOUNDS(Waiter.Controller);
+  Waiter.Rumble = false;
+  WaiterStart(Waiter);
+}
+
+void XKCTRL::XBOX360::RumbleAsync(XKCTRL::ControllerWaiter& Waiter, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  // like SetRumbleTimed, the wait completes when the rumble is stopped
+  int32_t controlleridx = CONTROLLER_BOUNDS(Waiter.Controller);
+  {
+    auto guard = OutputLock();
+    RumbleEnqueue(controlleridx, BigWeight, SmallWeight);
+    Waiter.RumbleGeneration = ++RumbleGeneration_[controlleridx];
+    RumbleScheduler_.Cancel(RumbleTimers_[controlleridx]);
+    RumbleTimers_[controlleridx] = TimerWheel::INVALID_TIMER;
+  }
+
+  Waiter.Controller = controlleridx;
+  Waiter.Rumble = true;
+  Waiter.TimeoutMS = std::max<uint32_t>(Waiter.TimeoutMS, 1);
+  WaiterStart(Waiter);
+}
+
+bool XKCTRL::XBOX360::CancelWait(XKCTRL::ControllerWaiter& Waiter)
+{
+  // false if the wait already completed, or is completing right now
+  return WaiterFinish(&Waiter, WAIT_CANCELLED);
+}
+
+void XKCTRL::XBOX360::WaiterStart(XKCTRL::ControllerWaiter& Waiter)
+{
+  // one reference for the list, one for a pending timeout
+  Waiter.Timer = TimerWheel::INVALID_TIMER;
+  Waiter.References = Waiter.TimeoutMS ? 2 : 1;
+  Waiter.Prev = nullptr;
+
+  bool stopped = false;
+  {
+    // pending only once linked, a CancelWait racing with a re-armed waiter
+    // would otherwise unlink it before it is in the list
+    std::lock_guard<std::mutex> guard(NotifyMutex_);
+    Waiter.Result = WAIT_PENDING;
+    Waiter.Next = Waiters_[Waiter.Controller];
+    if (Waiter.Next)
+      Waiter.Next->Prev = &Waiter;
+    Waiters_[Waiter.Controller] = &Waiter;
 
-      //process results from all controllers
-      for (auto& future_transfer : future_transfers)
+    // scheduled while linked, so a timeout always finds it in the list
+    if (Waiter.TimeoutMS)
+    {
+      ControllerWaiter* waiter = &Waiter;
+      Waiter.Timer = RumbleScheduler_.Schedule(Waiter.TimeoutMS, [this, waiter]()
       {
-        int32_t ret = future_transfer.get();
+        WaiterFinish(waiter, WAIT_TIMEOUT);
+        WaiterRelease(waiter);
+      });
+      stopped = (Waiter.Timer == TimerWheel::INVALID_TIMER);
+    }
+  }
+
+  // only while shutting down
+  if (stopped)
+  {
+    WaiterRelease(&Waiter);
+    WaiterFinish(&Waiter, WAIT_CANCELLED);
+  }
+}
+
+bool XKCTRL::XBOX360::WaiterFinish(XKCTRL::ControllerWaiter* Waiter, XKCTRL::WAIT_RESULT Result)
+{
+  // a rumble wait is done when its time is up
+  if (Waiter->Rumble && Result == WAIT_TIMEOUT)
+    Result = WAIT_READY;
+
+  int32_t pending = WAIT_PENDING;
+  if (!Waiter->Result.compare_exchange_strong(pending, Result))
+    return false;
+
+  ControllerStates_[Waiter->Controller].Load(Waiter->State);
+  {
+    std::lock_guard<std::mutex> guard(NotifyMutex_);
+    WaiterUnlink(Waiter);
+  }
+  Waiter->Next = nullptr;
+  WaitersComplete(Waiter);
+  return true;
+}
+
+void XKCTRL::XBOX360::WaiterUnlink(XKCTRL::ControllerWaiter* Waiter)
+{
+  if (Waiter->Prev)
+    Waiter->Prev->Next = Waiter->Next;
+  else
+    Waiters_[Waiter->Controller] = Waiter->Next;
+  if (Waiter->Next)
+    Waiter->Next->Prev = Waiter->Prev;
+}
+
+void XKCTRL::XBOX360::WaitersComplete(XKCTRL::ControllerWaiter* Waiters)
+{
+  // unlinked waiters chained through Next, each is released by its last reference
+  while (Waiters)
+  {
+    ControllerWaiter* waiter = Waiters;
+    Waiters = waiter->Next;
+    if (waiter->Rumble)
+      ControllerRumbleStop(waiter->Controller, waiter->RumbleGeneration);
+    if (waiter->Timer != TimerWheel::INVALID_TIMER && RumbleScheduler_.Cancel(waiter->Timer))
+      WaiterRelease(waiter);
+    WaiterRelease(waiter);
+  }
+}
+
+void XKCTRL::XBOX360::WaiterRelease(XKCTRL::ControllerWaiter* Waiter)
+{
+  if (Waiter->References.fetch_sub(1, std::memory_order_acq_rel) == 1 && Waiter->Complete)
+    Waiter->Complete(Waiter);
+}
 
-        // returns controller index on success or negative value on error.
-        if (ret >= 0)
+void XKCTRL::XBOX360::WaitersCancelAll()
+{
+  // waits another thread is finishing right now unlink themselves shortly
+  while (true)
+  {
+    ControllerWaiter* cancelled = nullptr;
+    bool finishing = false;
+    {
+      std::lock_guard<std::mutex> guard(NotifyMutex_);
+      for (auto& waiters : Waiters_)
+      {
+        ControllerWaiter* waiter = waiters;
+        while (waiter)
         {
-          //Process USB Controller data.  
-          try
+          ControllerWaiter* next = waiter->Next;
+          int32_t pending = WAIT_PENDING;
+          if (waiter->Result.compare_exchange_strong(pending, WAIT_CANCELLED))
           {
-            ControllerDataProcessing(ret);
+            WaiterUnlink(waiter);
+            waiter->Next = cancelled;
+            cancelled = waiter;
           }
-          catch(const std::exception& e)
+          else
           {
-            // Error Processing Data..
-            std::cerr << "ERROR Processing USB Data: " << e.what() << '\n';
+            finishing = true;
           }
+          waiter = next;
         }
-        else if (ret == LIBUSB_ERROR_NO_DEVICE)
-        {
-          try
-          {
-            //Device was disconnected..
-            std::cerr << "XBOX360 Wireless Device Disconnected!" << std::endl;
-
-            //clear all controller states
-            ControllerDisconnectAll();
-
-            //release all interfaces
-            for (auto iface : USBInterfaces_)
-              libusb_release_interface(USBDeviceHandle_, iface);
-            
-            // release device
-            libusb_close(USBDeviceHandle_);
-            USBDeviceHandle_ = nullptr;
-          }
-          catch(const std::exception& e)
-          {
-            // Error Processing Disconnect..
-            std::cerr << "ERROR Disconnecting: " << e.what() << '\n';
-          }
+      }
+    }
+    WaitersComplete(cancelled);
+    if (!finishing)
+      return;
+    std::this_thread::yield();
+  }
+}
 
-          break;
-        }
+void XKCTRL::XBOX360::ControllerRumbleStop(const int32_t ControllerIndex, const uint32_t Generation)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
 
-      } //end for controllers
-    } //end else device != nullptr
-  } //end while polling
+  //only stop if no newer timed rumble replaced this one, checked and
+  //stopped under one lock so a newer rumble can not slip in between
+  auto guard = OutputLock();
+  if (RumbleGeneration_[controlleridx] != Generation)
+    return;
+  RumbleTimers_[controlleridx] = TimerWheel::INVALID_TIMER;
+  RumbleEnqueue(controlleridx, 0x00, 0x00);
 }
 
-void XKCTRL::XBOX360::ControllerDataProcessing(const int32_t ControllerIndex)
+void XKCTRL::XBOX360::SetRumbleTimed(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight, const uint32_t RumbleTimeMS)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+
+  // replace any timed rumble still running on this controller, the value
+  // and its generation change together so a stale stop can not undo it
+  auto guard = OutputLock();
+  RumbleEnqueue(controlleridx, BigWeight, SmallWeight);
+  uint32_t generation = ++RumbleGeneration_[controlleridx];
+  RumbleScheduler_.Cancel(RumbleTimers_[controlleridx]);
+  RumbleTimers_[controlleridx] = RumbleScheduler_.Schedule(RumbleTimeMS, [this, controlleridx, generation]()
+  {
+    ControllerRumbleStop(controlleridx, generation);
+  });
+}
+
+void XKCTRL::XBOX360::PlayHaptics(const int32_t ControllerIndex, std::shared_ptr<const XKCTRL::HapticTrack> Track, const bool Loop)
+{
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  if (!Track || !Track->Frames())
+  {
+    StopHaptics(controlleridx);
+    return;
+  }
+
+  // replaces a timed rumble or track still running on this controller, the
+  // token bucket carries over so restarting tracks can not flood the endpoint
+  auto guard = OutputLock();
+  uint32_t generation = ++RumbleGeneration_[controlleridx];
+  RumbleScheduler_.Cancel(RumbleTimers_[controlleridx]);
+  RumbleTimers_[controlleridx] = TimerWheel::INVALID_TIMER;
+
+  HapticStream& stream = HapticStreams_[controlleridx];
+  stream.Track = std::move(Track);
+  stream.Loop = Loop;
+  stream.Generation = generation;
+  stream.StartNS = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now().time_since_epoch()).count();
+  stream.NextFrame = 0;
+  stream.LastValid = false;
+  ControllerHaptics(controlleridx, generation);
+}
+
+void XKCTRL::XBOX360::StopHaptics(const int32_t ControllerIndex)
+{
+  auto guard = OutputLock();
+  ControllerHapticsStop(CONTROLLER_BOUNDS(ControllerIndex), true);
+}
+
+void XKCTRL::XBOX360::GetHapticStats(const int32_t ControllerIndex, XKCTRL::HAPTIC_STATS& HapticStats)
 {
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  auto guard = OutputLock();
+  HapticStats = HapticStats_[controlleridx];
+  HapticStats.PLAYING = HapticStreams_[controlleridx].Track &&
+                        HapticStreams_[controlleridx].Generation == RumbleGeneration_[controlleridx];
+}
+
+void XKCTRL::XBOX360::ControllerHaptics(const int32_t ControllerIndex, const uint32_t Generation)
+{
+  // caller holds mutex_, sends the frame due now and schedules the next one
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  HapticStream& stream = HapticStreams_[controlleridx];
+  HAPTIC_STATS& stats = HapticStats_[controlleridx];
+  if (RumbleGeneration_[controlleridx] != Generation || !stream.Track)
+    return;
 
-  // *****  Check if report is Connection event *****
-  if (USBDataIn_[controlleridx][0] == USBReportType::CONNECTION) 
+  const uint64_t period = 1000000000ULL / HAPTIC_FRAME_HZ;
+  uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+  uint64_t frame = (now - stream.StartNS) / period;
+  uint64_t frames = stream.Track->Frames();
+  if (!stream.Loop && frame >= frames)
   {
-    // Check if connected or disconnected..
-    if (USBDataIn_[controlleridx][1] == 0x80) 
+    // whatever the timer never got to before the end is lost
+    stats.FRAMES += frames - std::min(stream.NextFrame, frames);
+    stats.DROPPED += frames - std::min(stream.NextFrame, frames);
+    ControllerHapticsStop(controlleridx, true);
+    return;
+  }
+
+  // a tick may come slightly early, the frame due then was already sent
+  if (frame >= stream.NextFrame)
+  {
+    // frames skipped because the timer ran late are never sent
+    stats.FRAMES += frame + 1 - stream.NextFrame;
+    stats.DROPPED += frame - stream.NextFrame;
+    if (now - (stream.StartNS + frame * period) > period / 2)
+      stats.LATE++;
+    stream.NextFrame = frame + 1;
+
+    // token bucket, one frame period of credit per frame sent
+    stream.CreditNS = std::min(stream.CreditNS + (now - stream.CreditTimeNS), HAPTIC_BURST * period);
+    stream.CreditTimeNS = now;
+
+    size_t index = frame % frames;
+    uint16_t value = (stream.Track->Big(index) << 8) | stream.Track->Small(index);
+    if (stream.LastValid && value == stream.LastFrame)
+    {
+      stats.UNCHANGED++;
+    }
+    else if (stream.CreditNS < period)
     {
-      // Connected, Initialize, Set LED's and small Rumble
-      ControllerConnect(controlleridx, ControllerInit(controlleridx));
+      stats.DROPPED++;
     }
     else
-    {    
-      //Seems like this was a disconnect msg.  
-      ControllerConnect(controlleridx, false);
+    {
+      // a frame still waiting for the endpoint is replaced by this one
+      if (OutputQueued_[controlleridx][RUMBLE])
+        stats.DROPPED++;
+      stream.CreditNS -= period;
+      stream.LastFrame = value;
+      stream.LastValid = true;
+      stats.QUEUED++;
+
+      RumbleEnqueue(controlleridx, stream.Track->Big(index), stream.Track->Small(index));
     }
+  }
+
+  // the wheel counts whole milliseconds from its last tick, round up
+  uint64_t due = stream.StartNS + stream.NextFrame * period;
+  uint32_t delayms = static_cast<uint32_t>((due - std::min(due, now) + 999999) / 1000000);
+  RumbleTimers_[controlleridx] = RumbleScheduler_.Schedule(std::max<uint32_t>(delayms, 1), [this, controlleridx, Generation]()
+  {
+    auto guard = OutputLock();
+    ControllerHaptics(controlleridx, Generation);
+  });
+}
+
+void XKCTRL::XBOX360::ControllerHapticsStop(const int32_t ControllerIndex, const bool Silence)
+{
+  // caller holds mutex_, only stops a track that is still the latest rumble
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  HapticStream& stream = HapticStreams_[controlleridx];
+  if (!stream.Track)
     return;
-  }// end if connection event
-
-  // ***** Generic event for further parsing..  *****
-  if (USBDataIn_[controlleridx][0] == USBReportType::DATA)
-  {
-    // Standard Controller event (i.e buttons pushed)
-    if (USBDataIn_[controlleridx][1] == 0x01 &&  
-        USBDataIn_[controlleridx][3] == 0xF0 &&  //data input
-        USBDataIn_[controlleridx][5] == 0x13)    //type controller buttons
-    { 
-
-      // If controller status is not connected and we are receiving
-      // data from controller, it's alive, set as connected
-      ControllerConnect(controlleridx, true);
-      
-      { // Protect ControllerStates shared obj  
-        std::lock_guard<std::mutex> guard(mutex_);
-          
-        // printbuff(USBDataIn_[controlleridx], MAX_USB_INBUFF);
-
-        CONTROLLER_LAYOUT* ctrl_in = reinterpret_cast<CONTROLLER_LAYOUT*>(&USBDataIn_[controlleridx][0x06]);
-        ControllerStates_[controlleridx].UP = APPLY_MASK(ctrl_in->BUTTONS, MASK_DPAD_UP);
-        ControllerStates_[controlleridx].DOWN = APPLY_MASK(ctrl_in->BUTTONS, MASK_DPAD_DOWN);
-        ControllerStates_[controlleridx].LEFT = APPLY_MASK(ctrl_in->BUTTONS, MASK_DPAD_LEFT);
-        ControllerStates_[controlleridx].RIGHT = APPLY_MASK(ctrl_in->BUTTONS, MASK_DPAD_RIGHT);
-        ControllerStates_[controlleridx].START = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_START);
-        ControllerStates_[controlleridx].BACK = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_BACK);
-        ControllerStates_[controlleridx].LH = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_LH);
-        ControllerStates_[controlleridx].RH = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_RH);
-        ControllerStates_[controlleridx].LB = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_LB);
-        ControllerStates_[controlleridx].RB = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_RB);
-        ControllerStates_[controlleridx].XBOX = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_XBOX);
-        ControllerStates_[controlleridx].A = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_A);
-        ControllerStates_[controlleridx].B = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_B);
-        ControllerStates_[controlleridx].X = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_X);
-        ControllerStates_[controlleridx].Y = APPLY_MASK(ctrl_in->BUTTONS, MASK_BTN_Y);
-        // Update controller Analog states
-        ControllerStates_[controlleridx].LTRIG = ctrl_in->LTRIG;
-        ControllerStates_[controlleridx].RTRIG = ctrl_in->RTRIG;
-        ControllerStates_[controlleridx].LSTICK_X = ctrl_in->LSTICK_X;
-        ControllerStates_[controlleridx].LSTICK_Y = ctrl_in->LSTICK_Y;
-        ControllerStates_[controlleridx].RSTICK_X = ctrl_in->RSTICK_X;
-        ControllerStates_[controlleridx].RSTICK_Y = ctrl_in->RSTICK_Y;
-
-        // valid data received, notify any waiting requests..
-        ControllersNotify_[controlleridx].notify_one();
-
-      }// end lock guard
-
-
-    } // end if buttons pushed
-  }// end if data event
-}
-
-bool XKCTRL::XBOX360::ControllerInit(const int32_t ControllerIndex)
-{
-  bool retval = false;
+
+  bool playing = (stream.Generation == RumbleGeneration_[controlleridx]);
+  stream.Track.reset();
+  if (!playing)
+    return;
+
+  ++RumbleGeneration_[controlleridx];
+  RumbleScheduler_.Cancel(RumbleTimers_[controlleridx]);
+  RumbleTimers_[controlleridx] = TimerWheel::INVALID_TIMER;
+  if (Silence)
+    RumbleEnqueue(controlleridx, 0x00, 0x00);
+}
+
+void XKCTRL::XBOX360::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState)
+{
+  // lock free snapshot, never waits on USB I/O or other readers
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  SetLED(controlleridx, LED_SETTING::OFF_ALL);
-  retval = ControllerReady(controlleridx);
-  return retval;
+  ControllerStates_[controlleridx].Load(ControllerState);
 }
 
-bool XKCTRL::XBOX360::USBTXSync(const int32_t ControllerIndex)
+void XKCTRL::XBOX360::GetControllerInfo(const int32_t ControllerIndex, XKCTRL::CONTROLLER_INFO& ControllerInfo)
 {
-  bool retval = false;
+  // link, serial, battery and chatpad as last reported, lock free like the state
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  if (USBDeviceHandle_ != nullptr)
+  ControllerInfo_[controlleridx].Load(ControllerInfo);
+}
+
+void XKCTRL::XBOX360::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState)
+{
+  CONTROLLER_PACKED_STATE state;
+  GetControllerState(ControllerIndex, state);
+  state.ToState(ControllerState);
+}
+
+bool  XKCTRL::XBOX360::GetWaitControllerState(const int32_t ControllerIndex,  XKCTRL::CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  // use unique lock so the condition_variable checking can lock/relock..
+  // this only guards the notification, not the controller state.
+  std::unique_lock<std::mutex> lock(NotifyMutex_);
+
+  // wait for controller data changes notification to get latest changed values
+  // if noting received after timout, return false and populate current stale values.
+  // every waiter on the controller is woken once its generation changes.
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  uint64_t generation = ControllerGeneration_[controlleridx];
+  bool notified = ControllersNotify_[controlleridx].wait_for(lock, std::chrono::milliseconds(TimeoutMS), [&]()
   {
-    int32_t datalen = 0x00;
-    int32_t res = libusb_interrupt_transfer(USBDeviceHandle_, USBEndpointsOut_[controlleridx], 
-                              USBDataOut_[controlleridx], MAX_USB_OUTBUFF, 
-                              &datalen, MAX_USB_TIMEOUT);
-    retval = (res == LIBUSB_SUCCESS);
-  }
-  return retval;
+    return ControllerGeneration_[controlleridx] != generation;
+  });
+  lock.unlock();
+
+  ControllerStates_[controlleridx].Load(ControllerState);
+  return notified;
 }
 
-bool XKCTRL::XBOX360::ControllerReady(const int32_t ControllerIndex)
+bool  XKCTRL::XBOX360::GetWaitControllerState(const int32_t ControllerIndex,  XKCTRL::CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS)
 {
-  //syncronize access to resources for entire function call
-  std::lock_guard<std::mutex> guard(mutex_);
+  CONTROLLER_PACKED_STATE state;
+  bool notified = GetWaitControllerState(ControllerIndex, state, TimeoutMS);
+  state.ToState(ControllerState);
+  return notified;
+}
+
+void XKCTRL::XBOX360::GetAllControllerStates(XKCTRL::CONTROLLER_SNAPSHOT& Snapshot)
+{
+  // retries while the device thread published during the copy, publishes
+  // are short and at most a few thousand per second
+  uint64_t before, after;
+  do
+  {
+    before = SnapshotSequence_.load(std::memory_order_acquire);
+    for (int32_t c = 0; c < MAX_CONTROLLERS; c++)
+    {
+      Snapshot.GENERATIONS[c] = ControllerGeneration_[c].load(std::memory_order_relaxed);
+      ControllerStates_[c].Load(Snapshot.STATES[c]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = SnapshotSequence_.load(std::memory_order_relaxed);
+  } while ((before & 0x01) || before != after);
+}
+
+uint64_t XKCTRL::XBOX360::WaitAny(const uint64_t* LastGenerations, uint32_t TimeoutMS)
+{
+  // bit n set for every controller n whose generation moved past LastGenerations[n],
+  // 0 if none did within the timeout
+  uint64_t changed = 0;
+  std::unique_lock<std::mutex> lock(NotifyMutex_);
+  AnyNotify_.wait_for(lock, std::chrono::milliseconds(TimeoutMS), [&]()
+  {
+    for (int32_t c = 0; c < MAX_CONTROLLERS; c++)
+    {
+      if (ControllerGeneration_[c].load(std::memory_order_relaxed) != LastGenerations[c])
+        changed |= 1ULL << c;
+    }
+    return changed != 0;
+  });
+  return changed;
+}
 
-  // Transfer Controller LED Setting
+bool XKCTRL::XBOX360::GetControllerStateAt(const int32_t ControllerIndex, const uint64_t TimestampNS,
+                                           XKCTRL::CONTROLLER_PACKED_STATE& ControllerState, const bool Interpolate)
+{
+  // lock free binary search of the state history, the device thread never waits on it
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  memset(USBDataOut_[controlleridx], 0x00, MAX_USB_OUTBUFF);
-  USBDataOut_[controlleridx][2] = 0x02;
-  USBDataOut_[controlleridx][3] = 0x80;
-  return USBTXSync(controlleridx);
+  return ControllerHistory_[controlleridx].StateAt(TimestampNS, Interpolate, ControllerState);
 }
 
-void XKCTRL::XBOX360::ControllerConnect(const int32_t ControllerIndex, bool IsConnected) 
+bool XKCTRL::XBOX360::GetControllerStateAt(const int32_t ControllerIndex, const uint64_t TimestampNS,
+                                           XKCTRL::CONTROLLER_STATE& ControllerState, const bool Interpolate)
+{
+  CONTROLLER_PACKED_STATE state;
+  bool found = GetControllerStateAt(ControllerIndex, TimestampNS, state, Interpolate);
+  state.ToState(ControllerState);
+  return found;
+}
+
+size_t XKCTRL::XBOX360::GetControllerChangesSince(const int32_t ControllerIndex, const uint64_t TimestampNS,
+                                                  XKCTRL::CONTROLLER_HISTORY_ENTRY* Entries, const size_t MaxEntries)
 {
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  bool AlreadyConnected = false;
-  
-  {// Protect ControllerStates shared obj  
-    std::lock_guard<std::mutex> guard(mutex_);
-    AlreadyConnected = ControllerStates_[controlleridx].CONNECTED;
-    ControllerStates_[controlleridx].CONNECTED = IsConnected;
-  }
+  return ControllerHistory_[controlleridx].Since(TimestampNS, Entries, MaxEntries);
+}
 
-  // small buzz on connect..
-  if (!AlreadyConnected && IsConnected)
-  {
-    SetLED(controlleridx, static_cast<LED_SETTING>(LED_SETTING::BLINK_1_ON + ControllerIndex));
-    SetRumbleTimed(controlleridx, 0x00, 0xFF, 250);
-  }
+int XKCTRL::XBOX360::GetControllerEventFD(const int32_t ControllerIndex)
+{
+  // readable whenever new data arrived for the controller, read 8 bytes to reset
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  return ControllerEventFD_[controlleridx];
 }
 
-void XKCTRL::XBOX360::ControllerDisconnectAll()
+int XKCTRL::XBOX360::GetReceiverEventFD()
 {
-  //syncronize access to resources for entire function call
-  std::lock_guard<std::mutex> guard(mutex_);
+  // readable whenever new data arrived for any controller, read 8 bytes to reset
+  return ReceiverEventFD_;
+}
 
-  //Clear all controllers state
-  for (uint32_t i = 0; i < MAX_CONTROLLERS; i++)
-    memset(&ControllerStates_[i], 0x00, sizeof(CONTROLLER_STATE));
+size_t XKCTRL::XBOX360::ReadControllerEvents(const int32_t ControllerIndex, XKCTRL::CONTROLLER_EVENT* Events, 
+                                             const size_t MaxEvents, uint64_t& DroppedEvents)
+{
+  // lock free batch read, only one thread may read events per controller
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  return ControllerEvents_[controlleridx].Read(Events, MaxEvents, DroppedEvents);
 }
 
-void XKCTRL::XBOX360::SetLED(const int32_t ControllerIndex, const XKCTRL::LED_SETTING LEDSetting)
+int XKCTRL::XBOX360::OpenEventTap()
 {
-  //syncronize access to resources for entire function call
+  // opened once, every later call returns the same eventfd
   std::lock_guard<std::mutex> guard(mutex_);
+  if (!EventTapOpen_.load(std::memory_order_relaxed))
+  {
+    EventTapFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (EventTapFD_ < 0)
+      throw std::runtime_error("Error creating event tap eventfd");
+    EventTap_.reset(new SPSCRing<CONTROLLER_EVENT, MAX_CONTROLLER_EVENTS>[MAX_CONTROLLERS]);
+    EventTapOpen_.store(true, std::memory_order_release);
+  }
+  return EventTapFD_;
+}
 
-  // Transfer Controller LED Setting
+size_t XKCTRL::XBOX360::ReadEventTap(const int32_t ControllerIndex, XKCTRL::CONTROLLER_EVENT* Events,
+                                     const size_t MaxEvents, uint64_t& DroppedEvents)
+{
+  // like ReadControllerEvents, only one thread may read the tap per controller
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  memset(USBDataOut_[controlleridx], 0x00, MAX_USB_OUTBUFF);
-  USBDataOut_[controlleridx][2] = 0x08;
-  USBDataOut_[controlleridx][3] = 0x40|static_cast<uint8_t>(LEDSetting);
-  USBTXSync(controlleridx);
+  DroppedEvents = 0;
+  if (!EventTapOpen_.load(std::memory_order_acquire))
+    return 0;
+  return EventTap_[controlleridx].Read(Events, MaxEvents, DroppedEvents);
 }
 
-void XKCTRL::XBOX360::SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+void XKCTRL::XBOX360::GetOutputStats(XKCTRL::OUTPUT_STATS& OutputStats)
 {
-  //syncronize access to resources for entire function call
-  std::lock_guard<std::mutex> guard(mutex_);
+  auto guard = OutputLock();
+  OutputStats = OutputStats_;
+}
+
+void XKCTRL::XBOX360::GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats)
+{
+  Transport_->GetReceiverStats(ReceiverStats);
+}
+
+void XKCTRL::XBOX360::GetPerfStats(XKCTRL::PERF_STATS& PerfStats)
+{
+  // each value is read on its own with relaxed ordering, the snapshot is
+  // not atomic as a whole but never blocks the device thread
+  for (int32_t i = 0; i < MAX_CONTROLLERS; i++)
+    ReportInterval_[i].Snapshot(PerfStats.REPORT_INTERVAL_NS[i]);
+  DecodeTime_.Snapshot(PerfStats.DECODE_NS);
+  MutexWait_.Snapshot(PerfStats.MUTEX_WAIT_NS);
+  OutputTime_.Snapshot(PerfStats.OUTPUT_NS);
+  PerfStats.REPORTS = Reports_.Get();
+  PerfStats.MUTEX_ACQUIRED = MutexAcquired_.Get();
+  PerfStats.MUTEX_CONTENDED = MutexContended_.Get();
+  PerfStats.CONNECTS = Connects_.Get();
+  PerfStats.DISCONNECTS = Disconnects_.Get();
+  PerfStats.SUBSCRIPTION_DELIVERED = 0;
+  PerfStats.SUBSCRIPTION_SUPPRESSED = 0;
+  for (auto& controller : Subscriptions_)
+  {
+    for (auto& subscription : controller)
+    {
+      PerfStats.SUBSCRIPTION_DELIVERED += subscription.Delivered.load(std::memory_order_relaxed);
+      PerfStats.SUBSCRIPTION_SUPPRESSED += subscription.Suppressed.load(std::memory_order_relaxed);
+    }
+  }
 
+  OUTPUT_STATS output;
+  GetOutputStats(output);
+  PerfStats.OUTPUT_FAILED = output.FAILED;
+
+  RECEIVER_STATS receiver;
+  Transport_->GetReceiverStats(receiver);
+  PerfStats.TIMEOUTS_IN = receiver.TIMEOUTS_IN;
+  PerfStats.TIMEOUTS_OUT = receiver.TIMEOUTS_OUT;
+}
+
+void XKCTRL::XBOX360::SetAnalogConfig(const int32_t ControllerIndex, const XKCTRL::ANALOG_CONFIG& AnalogConfig)
+{
+  // tables are built here, the device thread only swaps a pointer
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  memset(USBDataOut_[controlleridx], 0x00, MAX_USB_OUTBUFF);
-  USBDataOut_[controlleridx][1] = 0x01;
-  USBDataOut_[controlleridx][2] = 0x0f;
-  USBDataOut_[controlleridx][3] = 0xc0;
-  USBDataOut_[controlleridx][5] = BigWeight; 
-  USBDataOut_[controlleridx][6] = SmallWeight; 
-  USBTXSync(controlleridx);
+  AnalogPipeline* pipeline = new AnalogPipeline(AnalogConfig);
+
+  std::lock_guard<std::mutex> guard(ConfigMutex_);
+  AnalogPipelines_[controlleridx].Publish(pipeline);
 }
 
-void XKCTRL::XBOX360::ControllerRumbleAsync(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight, const uint32_t RumbleTimeMS)
+void XKCTRL::XBOX360::ClearAnalogConfig(const int32_t ControllerIndex)
 {
-  SetRumble(ControllerIndex, BigWeight, SmallWeight);
-  std::this_thread::sleep_for(std::chrono::milliseconds(RumbleTimeMS));
-  SetRumble(ControllerIndex, 0x00, 0x00);
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  AnalogPipeline* pipeline = new AnalogPipeline();
+
+  std::lock_guard<std::mutex> guard(ConfigMutex_);
+  AnalogPipelines_[controlleridx].Publish(pipeline);
 }
 
-void XKCTRL::XBOX360::SetRumbleTimed(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight, const uint32_t RumbleTimeMS)
+bool XKCTRL::XBOX360::GetAnalogState(const int32_t ControllerIndex, XKCTRL::ANALOG_STATE& AnalogState)
 {
-  // kick off a timed rumbler via async thread.
-  std::thread rumble_task(&XBOX360::ControllerRumbleAsync, this, ControllerIndex, BigWeight, SmallWeight, RumbleTimeMS);
-  rumble_task.detach();
+  // lock free snapshot, false while analog processing is off for the controller
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  AnalogStates_[controlleridx].Load(AnalogState);
+  return AnalogEnabled_[controlleridx].load(std::memory_order_acquire);
 }
 
-void XKCTRL::XBOX360::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState)
+void XKCTRL::XBOX360::SetCombos(const int32_t ControllerIndex, std::shared_ptr<const XKCTRL::ComboMachine> Combos)
 {
-  //syncronize access to resources for entire function call
-  std::lock_guard<std::mutex> guard(mutex_);
+  // one compiled machine can serve any number of controllers, nullptr turns recognition off
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  ControllerState = ControllerStates_[controlleridx];
+  ComboRecognizer* combos = new ComboRecognizer();
+  combos->MACHINE = std::move(Combos);
+
+  std::lock_guard<std::mutex> guard(ConfigMutex_);
+  Combos_[controlleridx].Publish(combos);
 }
 
-bool  XKCTRL::XBOX360::GetWaitControllerState(const int32_t ControllerIndex,  XKCTRL::CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS)
+size_t XKCTRL::XBOX360::ReadComboMatches(const int32_t ControllerIndex, XKCTRL::COMBO_MATCH* Matches,
+                                         const size_t MaxMatches, uint64_t& DroppedMatches)
 {
-  // syncronize access to resources for entire function call
-  // use unique lock so the condition_variable checking can lock/relock..
-  std::unique_lock<std::mutex> lock(mutex_);
+  // lock free batch read, only one thread may read matches per controller
+  int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
+  return ComboMatches_[controlleridx].Read(Matches, MaxMatches, DroppedMatches);
+}
 
-  // wait for controller data changes notification to get latest changed values
-  // if noting received after timout, return false and populate current stale values.
-  // waits for condition_variable notify OR timeout.
+int32_t XKCTRL::XBOX360::Subscribe(const int32_t ControllerIndex, const XKCTRL::SUBSCRIPTION_FILTER& Filter)
+{
+  // returns the subscription id, or -1 if the controller has no free slot left
   int32_t controlleridx = CONTROLLER_BOUNDS(ControllerIndex);
-  auto notified = ControllersNotify_[controlleridx].wait_for(lock, std::chrono::milliseconds(TimeoutMS));
-  ControllerState = ControllerStates_[controlleridx];
-  return (notified == std::cv_status::no_timeout);
+  SUBSCRIPTION_FILTER filter = Filter;
+  filter.BUTTONS &= MASK_ALL_BUTTONS;
+
+  std::lock_guard<std::mutex> guard(ConfigMutex_);
+  uint32_t active = SubscriptionsActive_[controlleridx].load(std::memory_order_relaxed);
+  uint32_t unused = ~active & ((1u << MAX_SUBSCRIPTIONS) - 1);
+  if (!unused)
+    return -1;
+
+  int32_t slot = __builtin_ctz(unused);
+  Subscription& subscription = Subscriptions_[controlleridx][slot];
+  subscription.Filter.Store(filter);
+  subscription.Version.fetch_add(1, std::memory_order_release);
+  subscription.DeliveredStart = subscription.Delivered.load(std::memory_order_relaxed);
+  subscription.SuppressedStart = subscription.Suppressed.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> notifyguard(NotifyMutex_);
+    subscription.Consumed = subscription.Generation;
+  }
+
+  SubscriptionsActive_[controlleridx].fetch_or(1u << slot, std::memory_order_release);
+  return controlleridx * MAX_SUBSCRIPTIONS + slot;
+}
+
+void XKCTRL::XBOX360::Unsubscribe(const int32_t SubscriptionID)
+{
+  if (SubscriptionID < 0 || SubscriptionID >= MAX_CONTROLLERS * MAX_SUBSCRIPTIONS)
+    return;
+
+  int32_t controlleridx = SubscriptionID / MAX_SUBSCRIPTIONS;
+  int32_t slot = SubscriptionID % MAX_SUBSCRIPTIONS;
+  {
+    std::lock_guard<std::mutex> guard(ConfigMutex_);
+    SubscriptionsActive_[controlleridx].fetch_and(~(1u << slot), std::memory_order_release);
+  }
+
+  // let a thread still waiting on it return
+  SubscriptionWake(controlleridx, 1u << slot);
+}
+
+bool XKCTRL::XBOX360::WaitSubscription(const int32_t SubscriptionID, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  // Like GetWaitControllerState, but only wakes when the filter matched. Wakeups
+  // that happened since the last call return right away, so only one thread
+  // should wait on a subscription. False on timeout or for an unknown id.
+  if (SubscriptionID < 0 || SubscriptionID >= MAX_CONTROLLERS * MAX_SUBSCRIPTIONS)
+  {
+    memset(&ControllerState, 0x00, sizeof(CONTROLLER_PACKED_STATE));
+    return false;
+  }
+
+  int32_t controlleridx = SubscriptionID / MAX_SUBSCRIPTIONS;
+  int32_t slot = SubscriptionID % MAX_SUBSCRIPTIONS;
+  Subscription& subscription = Subscriptions_[controlleridx][slot];
+
+  std::unique_lock<std::mutex> lock(NotifyMutex_);
+  bool notified = subscription.Notify.wait_for(lock, std::chrono::milliseconds(TimeoutMS), [&]()
+  {
+    return subscription.Generation != subscription.Consumed;
+  });
+  subscription.Consumed = subscription.Generation;
+  lock.unlock();
+
+  ControllerStates_[controlleridx].Load(ControllerState);
+  return notified && (SubscriptionsActive_[controlleridx].load(std::memory_order_acquire) & (1u << slot));
+}
+
+bool XKCTRL::XBOX360::WaitSubscription(const int32_t SubscriptionID, XKCTRL::CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  CONTROLLER_PACKED_STATE state;
+  bool notified = WaitSubscription(SubscriptionID, state, TimeoutMS);
+  state.ToState(ControllerState);
+  return notified;
+}
+
+void XKCTRL::XBOX360::GetSubscriptionStats(const int32_t SubscriptionID, XKCTRL::SUBSCRIPTION_STATS& SubscriptionStats)
+{
+  // counts since the subscription was made
+  SubscriptionStats = {0, 0};
+  if (SubscriptionID < 0 || SubscriptionID >= MAX_CONTROLLERS * MAX_SUBSCRIPTIONS)
+    return;
+
+  std::lock_guard<std::mutex> guard(ConfigMutex_);
+  const Subscription& subscription = Subscriptions_[SubscriptionID / MAX_SUBSCRIPTIONS][SubscriptionID % MAX_SUBSCRIPTIONS];
+  SubscriptionStats.DELIVERED = subscription.Delivered.load(std::memory_order_relaxed) - subscription.DeliveredStart;
+  SubscriptionStats.SUPPRESSED = subscription.Suppressed.load(std::memory_order_relaxed) - subscription.SuppressedStart;
+}
+
+void XKCTRL::XBOX360::GetRealtimeStatus(XKCTRL::REALTIME_STATUS& RealtimeStatus)
+{
+  // set once by the device thread before the constructor returned
+  RealtimeStatus = RealtimeStatus_;
+}
+
+void XKCTRL::XBOX360::ProbeRealtime(const uint32_t DurationMS, const uint32_t PeriodUS, XKCTRL::REALTIME_PROBE& Probe)
+{
+  // a thread scheduled like the device thread, memory is already locked if asked for
+  REALTIME_CONFIG config = RealtimeConfig_;
+  config.LOCK_MEMORY = false;
+  RealtimeProbe(config, DurationMS, PeriodUS, Probe);
 }
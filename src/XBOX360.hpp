@@ -25,85 +25,282 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <thread>
 #include <chrono>
 #include <mutex> 
+#include <atomic>
 #include <condition_variable>
-
-// requires "libusb-1.0-0-dev"
-// link against "usb-1.0"
-#include <libusb-1.0/libusb.h>
+#include <future>
+#include <vector>
+#include <memory>
 
 #include "XBOX360Defines.hpp"
+#include "XBOX360Transport.hpp"
+#include "XBOX360SeqLock.hpp"
+#include "XBOX360Timer.hpp"
+#include "XBOX360Ring.hpp"
+#include "XBOX360Stats.hpp"
+#include "XBOX360Analog.hpp"
+#include "XBOX360History.hpp"
+#include "XBOX360Handover.hpp"
+#include "XBOX360Combo.hpp"
+#include "XBOX360Subscription.hpp"
+#include "XBOX360Realtime.hpp"
+#include "XBOX360Waiter.hpp"
+#include "XBOX360Haptics.hpp"
+#include "XBOX360Report.hpp"
+#include "XBOX360Log.hpp"
 
-#define MAX_CONTROLLERS 4
-#define MAX_USB_INBUFF 32
-#define MAX_USB_OUTBUFF 12
-#define MAX_USB_TIMEOUT 50
+#define MAX_CONTROLLER_EVENTS 256
+#define MAX_CONTROLLER_HISTORY 1024
+#define MAX_COMBO_MATCHES 64
 
 namespace XKCTRL
 {
-  class XBOX360
+  class XBOX360 : private TransportSink
   {
     public:
       XBOX360();
+      explicit XBOX360(const REALTIME_CONFIG& RealtimeConfig);
+      explicit XBOX360(std::unique_ptr<Transport> ControllerTransport, const REALTIME_CONFIG& RealtimeConfig = DefaultRealtimeConfig());
       ~XBOX360();
 
       void SetLED(const int32_t ControllerIndex, const LED_SETTING LEDSetting);
       void SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight);
+      std::future<bool> SetLEDAsync(const int32_t ControllerIndex, const LED_SETTING LEDSetting);
+      std::future<bool> SetRumbleAsync(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight);
       void SetRumbleTimed(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight, const uint32_t RumbleTimeMS);
+      void PlayHaptics(const int32_t ControllerIndex, std::shared_ptr<const HapticTrack> Track, const bool Loop = false);
+      void StopHaptics(const int32_t ControllerIndex);
+      void GetHapticStats(const int32_t ControllerIndex, HAPTIC_STATS& HapticStats);
       void GetControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState);
+      void GetControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState);
       bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS);
+      bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS);
+      void GetAllControllerStates(CONTROLLER_SNAPSHOT& Snapshot);
+      void GetControllerInfo(const int32_t ControllerIndex, CONTROLLER_INFO& ControllerInfo);
+      uint64_t WaitAny(const uint64_t* LastGenerations, uint32_t TimeoutMS);
+      bool GetControllerStateAt(const int32_t ControllerIndex, const uint64_t TimestampNS, CONTROLLER_STATE& ControllerState, const bool Interpolate = false);
+      bool GetControllerStateAt(const int32_t ControllerIndex, const uint64_t TimestampNS, CONTROLLER_PACKED_STATE& ControllerState, const bool Interpolate = false);
+      size_t GetControllerChangesSince(const int32_t ControllerIndex, const uint64_t TimestampNS, CONTROLLER_HISTORY_ENTRY* Entries, const size_t MaxEntries);
+      int  GetControllerEventFD(const int32_t ControllerIndex);
+      int  GetReceiverEventFD();
+      size_t ReadControllerEvents(const int32_t ControllerIndex, CONTROLLER_EVENT* Events, const size_t MaxEvents, uint64_t& DroppedEvents);
+      int  OpenEventTap();
+      size_t ReadEventTap(const int32_t ControllerIndex, CONTROLLER_EVENT* Events, const size_t MaxEvents, uint64_t& DroppedEvents);
+      void GetOutputStats(OUTPUT_STATS& OutputStats);
+      void GetReceiverStats(RECEIVER_STATS& ReceiverStats);
+      void GetPerfStats(PERF_STATS& PerfStats);
+      void SetAnalogConfig(const int32_t ControllerIndex, const ANALOG_CONFIG& AnalogConfig);
+      void ClearAnalogConfig(const int32_t ControllerIndex);
+      bool GetAnalogState(const int32_t ControllerIndex, ANALOG_STATE& AnalogState);
+      void SetCombos(const int32_t ControllerIndex, std::shared_ptr<const ComboMachine> Combos);
+      size_t ReadComboMatches(const int32_t ControllerIndex, COMBO_MATCH* Matches, const size_t MaxMatches, uint64_t& DroppedMatches);
+      int32_t Subscribe(const int32_t ControllerIndex, const SUBSCRIPTION_FILTER& Filter);
+      void Unsubscribe(const int32_t SubscriptionID);
+      bool WaitSubscription(const int32_t SubscriptionID, CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS);
+      bool WaitSubscription(const int32_t SubscriptionID, CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS);
+      void GetSubscriptionStats(const int32_t SubscriptionID, SUBSCRIPTION_STATS& SubscriptionStats);
+      void GetRealtimeStatus(REALTIME_STATUS& RealtimeStatus);
+      void WaitAsync(ControllerWaiter& Waiter);
+      void RumbleAsync(ControllerWaiter& Waiter, const uint8_t BigWeight, const uint8_t SmallWeight);
+      bool CancelWait(ControllerWaiter& Waiter);
+      void ProbeRealtime(const uint32_t DurationMS, const uint32_t PeriodUS, REALTIME_PROBE& Probe);
 
     private:
-      enum USBReportType
+      // Output commands queued per controller, lower value is sent first.
+      // Only the latest value of each command is kept.
+      enum USBOutputCommand
       {
-          DATA = 0x00,
-          CONNECTION = 0x08
+          READY = 0x00,
+          LED = 0x01,
+          RUMBLE = 0x02,
+          OUTPUT_COMMANDS = 0x03
       };
 
-      // XBOX 360 Wireless USB Device
-      const uint16_t USBVendorID_ = 0x045E;
-      const uint16_t USBProductID_ = 0x02A9;
-      libusb_context* USBContext_ = nullptr;
-
-      // Device Descriptor for XBOX360 wireless device
-      libusb_device_handle* USBDeviceHandle_ = nullptr;
+      // moves raw reports to and from the controllers
+      std::unique_ptr<Transport> Transport_;
 
-      // XBOX 360 Wireless has only 1 Configuratin Descriptor with
-      // 8 Interface Descriptors, we are interrested in 0,2,4,6
-      // which represents conected controllers 1,2,3 and 4
-      int32_t USBInterfaces_[MAX_CONTROLLERS] = {0,2,4,6};
-
-      // Each Interface Descriptor has 2 Endpoint Descriptors
-      // one for data transfer In and another for Out
-      int32_t USBEndpointsIn_[MAX_CONTROLLERS] =  {0x81, 0x83, 0x85, 0x87};
-      int32_t USBEndpointsOut_[MAX_CONTROLLERS] = {0x01, 0x03, 0x05, 0x07};
-      
-      // USB Input buffer for each controller
+      // last report received per controller, only USBLengthIn_ bytes are valid
       uint8_t USBDataIn_[MAX_CONTROLLERS][MAX_USB_INBUFF];
-      uint8_t USBDataOut_[MAX_CONTROLLERS][MAX_USB_OUTBUFF];
+      size_t USBLengthIn_[MAX_CONTROLLERS] = {0};
+      uint64_t USBTimestampIn_[MAX_CONTROLLERS] = {0};
+
+      // One output report in flight per controller, commands that arrive while
+      // it is in flight wait in the output queue and replace older values.
+      bool USBTXBusy_[MAX_CONTROLLERS] = {false};
+      uint8_t OutputQueue_[MAX_CONTROLLERS][OUTPUT_COMMANDS][MAX_USB_OUTBUFF];
+      bool OutputQueued_[MAX_CONTROLLERS][OUTPUT_COMMANDS] = {{false}};
+      std::vector<std::promise<bool>> OutputWaiters_[MAX_CONTROLLERS][OUTPUT_COMMANDS];
+      std::vector<std::promise<bool>> OutputInFlight_[MAX_CONTROLLERS];
+      OUTPUT_STATS OutputStats_ = {0, 0, 0};
 
       // Thread for continious controller polling
       std::thread USBDeviceThread_;
-      bool USBDeviceThreadRunning_;
+      std::atomic<bool> USBDeviceThreadRunning_;
+
+      //scheduling of the device thread, the status is set by the thread
+      //itself before the constructor returns
+      REALTIME_CONFIG RealtimeConfig_;
+      REALTIME_STATUS RealtimeStatus_;
+      std::promise<void> RealtimeApplied_;
 
-      //Protection of shared resources is done via mutex
+      //Protection of the output queue is done via mutex, it is taken
+      //before the transport's own lock and never held across blocking I/O
       std::mutex mutex_;
       
       //shared object that holds current state for all controllers.
-      CONTROLLER_STATE ControllerStates_[MAX_CONTROLLERS];
+      //only written by the device thread, readers never take a lock.
+      SeqLock<CONTROLLER_PACKED_STATE> ControllerStates_[MAX_CONTROLLERS];
+
+      //device thread's own working copy of the published states
+      CONTROLLER_PACKED_STATE ControllerShadow_[MAX_CONTROLLERS];
+
+      //link, battery and chatpad reports per controller, published like the
+      //states from the device thread's own copy
+      SeqLock<CONTROLLER_INFO> ControllerInfo_[MAX_CONTROLLERS];
+      CONTROLLER_INFO ControllerInfoShadow_[MAX_CONTROLLERS];
+
+      //timestamped copy of every published state, for queries by time
+      StateHistory<MAX_CONTROLLER_HISTORY> ControllerHistory_[MAX_CONTROLLERS];
+
+      //every input change per controller, filled by the device thread
+      SPSCRing<CONTROLLER_EVENT, MAX_CONTROLLER_EVENTS> ControllerEvents_[MAX_CONTROLLERS];
+
+      //second copy of every event for one more reader, such as a SharedPublisher,
+      //only allocated once OpenEventTap is called and kept until destruction
+      std::unique_ptr<SPSCRing<CONTROLLER_EVENT, MAX_CONTROLLER_EVENTS>[]> EventTap_;
+      std::atomic<bool> EventTapOpen_;
+      int EventTapFD_ = -1;
+
+      //optional analog processing per controller, new pipelines are built by
+      //the caller and swapped in by the device thread between two reports
+      Handover<AnalogPipeline> AnalogPipelines_[MAX_CONTROLLERS];
+      std::atomic<bool> AnalogEnabled_[MAX_CONTROLLERS];
+      SeqLock<ANALOG_STATE> AnalogStates_[MAX_CONTROLLERS];
+
+      //optional combo recognition per controller, handed over like the
+      //analog pipelines, matches are queued for the application
+      Handover<ComboRecognizer> Combos_[MAX_CONTROLLERS];
+      SPSCRing<COMBO_MATCH, MAX_COMBO_MATCHES> ComboMatches_[MAX_CONTROLLERS];
 
-      //notifications for Controllers state change
+      //serializes configuration updates handed to the device thread
+      std::mutex ConfigMutex_;
+
+      //single scheduler for timed rumble, the generation lets a newer
+      //timed rumble replace an older one that has not expired yet
+      TimerWheel RumbleScheduler_;
+      TimerWheel::TimerID RumbleTimers_[MAX_CONTROLLERS] = {TimerWheel::INVALID_TIMER};
+      uint32_t RumbleGeneration_[MAX_CONTROLLERS] = {0};
+
+      //haptic tracks streamed frame by frame from the rumble scheduler, a
+      //stream belongs to one rumble generation like a timed rumble. Guarded
+      //by mutex_, the token bucket is kept as time credit in nanoseconds.
+      struct HapticStream
+      {
+        std::shared_ptr<const HapticTrack> Track;
+        bool Loop = false;
+        uint32_t Generation = 0;
+        uint64_t StartNS = 0;
+        uint64_t NextFrame = 0;
+        uint16_t LastFrame = 0;
+        bool LastValid = false;
+        uint64_t CreditNS = 0;
+        uint64_t CreditTimeNS = 0;
+      };
+      HapticStream HapticStreams_[MAX_CONTROLLERS];
+      HAPTIC_STATS HapticStats_[MAX_CONTROLLERS] = {};
+
+      //notifications for Controllers state change, waiters wake when
+      //the generation of their controller moves on. Generations count
+      //published states, they are checked under NotifyMutex_.
+      std::mutex NotifyMutex_;
       std::condition_variable ControllersNotify_[MAX_CONTROLLERS];
+      std::condition_variable AnyNotify_;
+      std::atomic<uint64_t> ControllerGeneration_[MAX_CONTROLLERS];
+
+      //odd while the device thread publishes a state, so a snapshot of all
+      //controllers can tell it raced with a publish and retry
+      std::atomic<uint64_t> SnapshotSequence_;
+
+      //Filtered notifications, a subscriber only wakes when its filter matches.
+      //The device thread picks up a new filter when the slot version moves and
+      //keeps the state the subscriber was last woken for as reference.
+      struct Subscription
+      {
+        SeqLock<SUBSCRIPTION_FILTER> Filter;
+        std::atomic<uint32_t> Version{0};
+        uint32_t SeenVersion = 0;
+        SUBSCRIPTION_FILTER ActiveFilter = {};
+        CONTROLLER_PACKED_STATE Reference = {};
+        // generation is guarded by NotifyMutex_, Consumed is the last one a waiter returned for
+        uint64_t Generation = 0;
+        uint64_t Consumed = 0;
+        std::condition_variable Notify;
+        // part of the subscription API, counted even without XBOX360_STATS
+        std::atomic<uint64_t> Delivered{0};
+        std::atomic<uint64_t> Suppressed{0};
+        // counter values when the slot was last subscribed
+        uint64_t DeliveredStart = 0;
+        uint64_t SuppressedStart = 0;
+      };
+      Subscription Subscriptions_[MAX_CONTROLLERS][MAX_SUBSCRIPTIONS];
+      std::atomic<uint32_t> SubscriptionsActive_[MAX_CONTROLLERS];
+
+      //asynchronous waits per controller, guarded by NotifyMutex_ and
+      //completed by the device thread, their timeout timer or a cancel
+      ControllerWaiter* Waiters_[MAX_CONTROLLERS] = {nullptr};
+
+      //pollable eventfd notifications per controller and for the receiver
+      int ControllerEventFD_[MAX_CONTROLLERS];
+      int ReceiverEventFD_ = -1;
+
+      //hot path instrumentation, see XBOX360Stats.hpp
+      StatsHistogram ReportInterval_[MAX_CONTROLLERS];
+      StatsHistogram DecodeTime_;
+      StatsHistogram MutexWait_;
+      StatsHistogram OutputTime_;
+      StatsCounter   Reports_;
+      StatsCounter   MutexAcquired_;
+      StatsCounter   MutexContended_;
+      StatsCounter   Connects_;
+      StatsCounter   Disconnects_;
+      uint64_t       OutputSubmitTime_[MAX_CONTROLLERS] = {0};
 
       void    USBDeviceThread();
-      void    USBDeviceInit();
-      int32_t USBRXAsync(const int32_t ControllerIndex);
-      bool    USBTXSync(const int32_t ControllerIndex);
+      void    USBTXSubmit(const int32_t ControllerIndex);
+      std::unique_lock<std::mutex> OutputLock();
+      void    TransportReport(const int32_t ControllerIndex, const uint8_t* Report,
+                              const size_t Length, const uint64_t TimestampNS) override;
+      void    TransportSent(const int32_t ControllerIndex, const bool Success) override;
+      void    TransportDetached(const int32_t FirstController, const int32_t ControllerCount) override;
+      void    OutputQueue(const int32_t ControllerIndex, const USBOutputCommand Command, 
+                          const uint8_t* Data, std::promise<bool>* Completion);
+      void    OutputEnqueue(const int32_t ControllerIndex, const USBOutputCommand Command, 
+                            const uint8_t* Data, std::promise<bool>* Completion);
+      void    OutputComplete(std::vector<std::promise<bool>>& Waiters, bool Result);
+      void    RumbleEnqueue(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight);
       void    ControllerDataProcessing(const int32_t ControllerIndex);
-      bool    ControllerInit(const int32_t ControllerIndex);
-      bool    ControllerReady(const int32_t ControllerIndex);
+      void    ControllerInit(const int32_t ControllerIndex);
+      void    ControllerReady(const int32_t ControllerIndex);
       void    ControllerConnect(const int32_t ControllerIndex, bool IsConnected);
+      void    ControllerNotify(const int32_t ControllerIndex);
+      void    ControllerPublish(const int32_t ControllerIndex, const uint64_t TimestampNS);
+      void    ControllerDisconnect(const int32_t FirstController, const int32_t ControllerCount);
       void    ControllerDisconnectAll();
-      void    ControllerRumbleAsync(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight, const uint32_t RumbleTimeMS);  
+      void    ControllerInfoUpdate(const int32_t ControllerIndex, const RECEIVER_REPORT& Report);
+      void    ControllerAnalog(const int32_t ControllerIndex, const CONTROLLER_PACKED_STATE& State);
+      void    ControllerCombos(const int32_t ControllerIndex, const CONTROLLER_EVENT& Event);
+      void    ControllerEventPush(const int32_t ControllerIndex, const CONTROLLER_EVENT& Event);
+      void    ControllerSubscriptions(const int32_t ControllerIndex, const CONTROLLER_PACKED_STATE& Previous, const bool WakeAll);
+      void    SubscriptionWake(const int32_t ControllerIndex, const uint32_t Slots);
+      void    ControllerWaiters(const int32_t ControllerIndex, const CONTROLLER_EVENT* Event);
+      void    WaiterStart(ControllerWaiter& Waiter);
+      bool    WaiterFinish(ControllerWaiter* Waiter, WAIT_RESULT Result);
+      void    WaiterUnlink(ControllerWaiter* Waiter);
+      void    WaitersComplete(ControllerWaiter* Waiters);
+      void    WaitersCancelAll();
+      void    WaiterRelease(ControllerWaiter* Waiter);
+      void    ControllerRumbleStop(const int32_t ControllerIndex, const uint32_t Generation);  
+      void    ControllerHaptics(const int32_t ControllerIndex, const uint32_t Generation);
+      void    ControllerHapticsStop(const int32_t ControllerIndex, const bool Silence);
 
       // debug
       void printbuff(const uint8_t* buff, size_t buffsize)
@@ -0,0 +1,199 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "XBOX360Analog.hpp"
+
+XKCTRL::AnalogPipeline::AnalogPipeline()
+  : Enabled_(false),
+    Filter_(false),
+    LastTimestamp_(0)
+{
+}
+
+XKCTRL::AnalogPipeline::AnalogPipeline(const XKCTRL::ANALOG_CONFIG& Config)
+  : Enabled_(true),
+    Filter_(Config.FILTER.ENABLED),
+    LastTimestamp_(0)
+{
+  const STICK_CONFIG* sticks[2] = {&Config.LSTICK, &Config.RSTICK};
+  for (int32_t s = 0; s < 2; s++)
+  {
+    const STICK_CONFIG& stick = *sticks[s];
+
+    // no deadzone still goes through the radial path so curves keep the direction
+    float inner = (stick.DEADZONE == DEADZONE_NONE) ? 0.0f : std::min(std::max(stick.INNER, 0.0f), 0.99f);
+    float outer = std::min(std::max(stick.OUTER, inner + 0.01f), 1.5f);
+    for (int32_t axis = 0; axis < 2; axis++)
+    {
+      int32_t lane = s * 2 + axis;
+      int16_t range = axis ? stick.RANGE_Y : stick.RANGE_X;
+      Center_[lane] = axis ? stick.CENTER_Y : stick.CENTER_X;
+      InvRange_[lane] = 1.0f / std::max(static_cast<float>(range), 1.0f);
+      Inner_[lane] = inner;
+      InvSpan_[lane] = 1.0f / (outer - inner);
+      Axial_[lane] = (stick.DEADZONE == DEADZONE_AXIAL) ? -1 : 0;
+    }
+
+    float curve = (stick.CURVE > 0.0f) ? stick.CURVE : 1.0f;
+    for (int32_t i = 0; i <= ANALOG_CURVE_POINTS; i++)
+    {
+      float position = std::min(static_cast<float>(i) / (ANALOG_CURVE_POINTS - 1), 1.0f);
+      StickCurve_[s][i] = powf(position, curve);
+    }
+  }
+
+  // deadzone, saturation and curve of each raw trigger value
+  const TRIGGER_CONFIG* triggers[2] = {&Config.LTRIG, &Config.RTRIG};
+  for (int32_t t = 0; t < 2; t++)
+  {
+    const TRIGGER_CONFIG& trigger = *triggers[t];
+    float inner = trigger.INNER;
+    float outer = std::max(static_cast<float>(trigger.OUTER), inner + 1.0f);
+    float curve = (trigger.CURVE > 0.0f) ? trigger.CURVE : 1.0f;
+    for (int32_t raw = 0; raw < 256; raw++)
+    {
+      float position = std::min(std::max((raw - inner) / (outer - inner), 0.0f), 1.0f);
+      TriggerTable_[t][raw] = powf(position, curve);
+    }
+  }
+
+  for (int32_t lane = 0; lane < 4; lane++)
+  {
+    MinCutoff_[lane] = std::max(Config.FILTER.MIN_CUTOFF, 0.001f);
+    Beta_[lane] = Config.FILTER.BETA;
+    DCutoff_[lane] = std::max(Config.FILTER.D_CUTOFF, 0.001f);
+  }
+  Reset();
+}
+
+void XKCTRL::AnalogPipeline::Reset()
+{
+  LastTimestamp_ = 0;
+  StickValue_ = AnalogVector{0, 0, 0, 0};
+  StickDeriv_ = AnalogVector{0, 0, 0, 0};
+  TriggerValue_ = AnalogVector{0, 0, 0, 0};
+  TriggerDeriv_ = AnalogVector{0, 0, 0, 0};
+}
+
+void XKCTRL::AnalogPipeline::Smooth(AnalogVector& Value, AnalogVector& Previous, AnalogVector& Deriv, const float DT)
+{
+  // one euro filter on all lanes: smoothing factor for a cutoff frequency
+  // is 1 / (1 + tau / dt) with tau = 1 / (2 pi cutoff)
+  const AnalogVector one = {1.0f, 1.0f, 1.0f, 1.0f};
+  const AnalogVector twopidt = one * static_cast<float>(2.0 * M_PI) * DT;
+
+  AnalogVector speed = (Value - Previous) / DT;
+  AnalogVector dalpha = one / (one + one / (twopidt * DCutoff_));
+  Deriv = Deriv + dalpha * (speed - Deriv);
+
+  AnalogVector absderiv = (Deriv < 0.0f) ? -Deriv : Deriv;
+  AnalogVector cutoff = MinCutoff_ + Beta_ * absderiv;
+  AnalogVector alpha = one / (one + one / (twopidt * cutoff));
+  Value = Previous + alpha * (Value - Previous);
+  Previous = Value;
+}
+
+void XKCTRL::AnalogPipeline::Process(const XKCTRL::CONTROLLER_PACKED_STATE& State, const uint64_t TimestampNS,
+                                     XKCTRL::ANALOG_STATE& Output)
+{
+  const AnalogVector zero = {0.0f, 0.0f, 0.0f, 0.0f};
+  const AnalogVector one = {1.0f, 1.0f, 1.0f, 1.0f};
+
+  // calibrate and normalize all four stick axes at once
+  AnalogVector raw = {static_cast<float>(State.LSTICK_X), static_cast<float>(State.LSTICK_Y),
+                      static_cast<float>(State.RSTICK_X), static_cast<float>(State.RSTICK_Y)};
+  AnalogVector value = (raw - Center_) * InvRange_;
+  value = (value > one) ? one : value;
+  value = (value < -one) ? -one : value;
+
+  // magnitude per lane, each axis on its own or the length of its stick
+  AnalogVector square = value * value;
+  AnalogVector pairs = square + __builtin_shuffle(square, AnalogMask{1, 0, 3, 2});
+  AnalogVector length;
+  for (int32_t lane = 0; lane < 4; lane++)
+    length[lane] = sqrtf(pairs[lane]);
+  AnalogVector absvalue = (value < zero) ? -value : value;
+  AnalogVector magnitude = Axial_ ? absvalue : length;
+
+  // deadzone and saturation, then the response curve with interpolation
+  AnalogVector scaled = (magnitude - Inner_) * InvSpan_;
+  scaled = (scaled < zero) ? zero : scaled;
+  scaled = (scaled > one) ? one : scaled;
+  AnalogVector position = scaled * static_cast<float>(ANALOG_CURVE_POINTS - 1);
+  AnalogVector response;
+  for (int32_t lane = 0; lane < 4; lane++)
+  {
+    const float* curve = StickCurve_[lane >> 1];
+    int32_t index = static_cast<int32_t>(position[lane]);
+    float fraction = position[lane] - index;
+    response[lane] = curve[index] + fraction * (curve[index + 1] - curve[index]);
+  }
+
+  // scale the calibrated value so its magnitude becomes the response
+  AnalogVector gain = (magnitude > 1e-6f) ? response / magnitude : zero;
+  AnalogVector sticks = value * gain;
+
+  AnalogVector triggers = {TriggerTable_[0][State.LTRIG], TriggerTable_[1][State.RTRIG], 0.0f, 0.0f};
+
+  if (Filter_)
+  {
+    float dt = (LastTimestamp_ != 0 && TimestampNS > LastTimestamp_) ? (TimestampNS - LastTimestamp_) * 1e-9f : 0.0f;
+    if (dt > 0.0f)
+    {
+      Smooth(sticks, StickValue_, StickDeriv_, dt);
+      Smooth(triggers, TriggerValue_, TriggerDeriv_, dt);
+    }
+    else
+    {
+      // first sample starts the filter at the current values
+      StickValue_ = sticks;
+      TriggerValue_ = triggers;
+      StickDeriv_ = zero;
+      TriggerDeriv_ = zero;
+    }
+  }
+  LastTimestamp_ = TimestampNS;
+
+  sticks = (sticks > one) ? one : sticks;
+  sticks = (sticks < -one) ? -one : sticks;
+
+  // Q15 with round to nearest
+  const AnalogVector half = {0.5f, 0.5f, 0.5f, 0.5f};
+  AnalogVector stickfixed = sticks * 32767.0f;
+  AnalogMask stickq15 = __builtin_convertvector(stickfixed + ((stickfixed < zero) ? -half : half), AnalogMask);
+  AnalogMask triggerq15 = __builtin_convertvector(triggers * 32767.0f + half, AnalogMask);
+
+  Output.LSTICK_X = sticks[0];
+  Output.LSTICK_Y = sticks[1];
+  Output.RSTICK_X = sticks[2];
+  Output.RSTICK_Y = sticks[3];
+  Output.LTRIG = triggers[0];
+  Output.RTRIG = triggers[1];
+  Output.LSTICK_X_Q15 = static_cast<int16_t>(stickq15[0]);
+  Output.LSTICK_Y_Q15 = static_cast<int16_t>(stickq15[1]);
+  Output.RSTICK_X_Q15 = static_cast<int16_t>(stickq15[2]);
+  Output.RSTICK_Y_Q15 = static_cast<int16_t>(stickq15[3]);
+  Output.LTRIG_Q15 = static_cast<int16_t>(triggerq15[0]);
+  Output.RTRIG_Q15 = static_cast<int16_t>(triggerq15[1]);
+  Output.TIMESTAMP_NS = TimestampNS;
+}
@@ -0,0 +1,149 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_ANALOG_
+#define _XBOX360_ANALOG_
+
+#include <stdint.h>
+
+#include "XBOX360Defines.hpp"
+
+// Stick response curve lookup table entries over magnitude 0.0-1.0
+#define ANALOG_CURVE_POINTS 256
+
+namespace XKCTRL
+{
+  enum DEADZONE_MODE
+  {
+    DEADZONE_NONE = 0x00,
+    DEADZONE_AXIAL = 0x01,   // each axis on its own, good for dpad like use
+    DEADZONE_RADIAL = 0x02   // on the stick magnitude, keeps the direction
+  };
+
+  struct STICK_CONFIG
+  {
+    DEADZONE_MODE DEADZONE;
+    // deadzone and saturation as fraction of full deflection (0.0-1.0)
+    float INNER, OUTER;
+    // response curve exponent, 1.0 is linear
+    float CURVE;
+    // calibration, raw resting position and raw distance to full deflection
+    int16_t CENTER_X, CENTER_Y;
+    int16_t RANGE_X, RANGE_Y;
+  };
+
+  struct TRIGGER_CONFIG
+  {
+    // raw deadzone and saturation (0-255)
+    uint8_t INNER, OUTER;
+    // response curve exponent, 1.0 is linear
+    float CURVE;
+  };
+
+  // One euro filter, see Casiez et al. 2012
+  struct FILTER_CONFIG
+  {
+    bool ENABLED;
+    // cutoff in Hz at rest, lower smooths more
+    float MIN_CUTOFF;
+    // how fast the cutoff opens up with speed, higher lags less
+    float BETA;
+    // cutoff in Hz for the speed estimate
+    float D_CUTOFF;
+  };
+
+  struct ANALOG_CONFIG
+  {
+    STICK_CONFIG LSTICK, RSTICK;
+    TRIGGER_CONFIG LTRIG, RTRIG;
+    FILTER_CONFIG FILTER;
+  };
+
+  // Processed analog values of one report
+  struct ANALOG_STATE
+  {
+    // sticks -1.0 to 1.0, triggers 0.0 to 1.0
+    float LSTICK_X, LSTICK_Y, RSTICK_X, RSTICK_Y;
+    float LTRIG, RTRIG;
+    // the same values in Q15 fixed point, sticks -32767 to 32767, triggers 0 to 32767
+    int16_t LSTICK_X_Q15, LSTICK_Y_Q15, RSTICK_X_Q15, RSTICK_Y_Q15;
+    int16_t LTRIG_Q15, RTRIG_Q15;
+    // report the values came from
+    uint64_t TIMESTAMP_NS;
+  };
+
+  // radial deadzone of the XInput recommended size, linear, no filter
+  inline ANALOG_CONFIG DefaultAnalogConfig()
+  {
+    ANALOG_CONFIG config;
+    config.LSTICK = {DEADZONE_RADIAL, 7849.0f / 32767.0f, 1.0f, 1.0f, 0, 0, 32767, 32767};
+    config.RSTICK = {DEADZONE_RADIAL, 8689.0f / 32767.0f, 1.0f, 1.0f, 0, 0, 32767, 32767};
+    config.LTRIG = {30, 255, 1.0f};
+    config.RTRIG = {30, 255, 1.0f};
+    config.FILTER = {false, 1.0f, 0.007f, 1.0f};
+    return config;
+  }
+
+  // Deadzones, calibration, response curves and smoothing for one controller.
+  // Everything that depends only on the config is computed up front, so a
+  // report is processed in one pass with the four stick axes in one vector.
+  class AnalogPipeline
+  {
+    public:
+      // a default pipeline is disabled, it only marks processing as off
+      AnalogPipeline();
+      explicit AnalogPipeline(const ANALOG_CONFIG& Config);
+
+      bool Enabled() const { return Enabled_; }
+
+      // forget the filter history, e.g. after a reconnect
+      void Reset();
+
+      void Process(const CONTROLLER_PACKED_STATE& State, const uint64_t TimestampNS, ANALOG_STATE& Output);
+
+    private:
+      typedef float AnalogVector __attribute__((vector_size(16)));
+      typedef int32_t AnalogMask __attribute__((vector_size(16)));
+
+      bool Enabled_;
+
+      // per lane stick constants, lanes are LX, LY, RX, RY
+      AnalogVector Center_;
+      AnalogVector InvRange_;
+      AnalogVector Inner_;
+      AnalogVector InvSpan_;
+      AnalogMask   Axial_;
+
+      // curve tables, one extra entry so interpolation never reads past the end
+      float StickCurve_[2][ANALOG_CURVE_POINTS + 1];
+      // triggers are fully table driven from the raw value
+      float TriggerTable_[2][256];
+
+      // one euro filter state, sticks and triggers (lanes 0 and 1)
+      bool Filter_;
+      AnalogVector MinCutoff_, Beta_, DCutoff_;
+      AnalogVector StickValue_, StickDeriv_;
+      AnalogVector TriggerValue_, TriggerDeriv_;
+      uint64_t LastTimestamp_;
+
+      void Smooth(AnalogVector& Value, AnalogVector& Previous, AnalogVector& Deriv, const float DT);
+  };
+}
+
+#endif //_XBOX360_ANALOG_
@@ -0,0 +1,643 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "XBOX360Bridge.hpp"
+
+// Datagram layout, all values little endian:
+//   0  'X' 'B'
+//   2  version
+//   3  BRIDGE_TYPE
+//   4  sequence (uint32, STATE only)
+//   8  server steady clock time in ns (uint64, STATE only)
+//  16  payload
+// A STATE payload is a list of controller records:
+//   controller index, flags (BRIDGE_FLAG), then for a keyframe the raw
+//   buttons and all six axes as zigzag varints, otherwise the changed
+//   button bits if BRIDGE_FLAG_BUTTONS and a zigzag varint delta per
+//   changed axis. Axes are in AXIS_MASK order.
+// A COMMAND payload is controller index, command, two values.
+#define BRIDGE_HEADER 16
+#define BRIDGE_VERSION 1
+
+namespace XKCTRL
+{
+  enum BRIDGE_TYPE
+  {
+    BRIDGE_STATE = 0x00,
+    BRIDGE_COMMAND = 0x01,
+    BRIDGE_KEYFRAME_REQUEST = 0x02,
+    BRIDGE_KEEPALIVE = 0x03
+  };
+
+  enum BRIDGE_FLAG
+  {
+    BRIDGE_FLAG_KEYFRAME = 0x01,
+    BRIDGE_FLAG_BUTTONS = 0x02,
+    // AXIS_MASK bits shifted up by 2
+    BRIDGE_FLAG_AXES = 0xFC
+  };
+
+  enum BRIDGE_COMMAND_TYPE
+  {
+    BRIDGE_LED = 0x01,
+    BRIDGE_RUMBLE = 0x02
+  };
+}
+
+static void BridgeHeader(uint8_t* Datagram, const uint8_t Type, const uint32_t Sequence, const uint64_t TimestampNS)
+{
+  Datagram[0] = 'X';
+  Datagram[1] = 'B';
+  Datagram[2] = BRIDGE_VERSION;
+  Datagram[3] = Type;
+  for (int32_t i = 0; i < 4; i++)
+    Datagram[4 + i] = static_cast<uint8_t>(Sequence >> (8 * i));
+  for (int32_t i = 0; i < 8; i++)
+    Datagram[8 + i] = static_cast<uint8_t>(TimestampNS >> (8 * i));
+}
+
+static bool BridgeHeaderValid(const uint8_t* Datagram, const size_t Length)
+{
+  return Length >= BRIDGE_HEADER && Datagram[0] == 'X' && Datagram[1] == 'B' && Datagram[2] == BRIDGE_VERSION;
+}
+
+static size_t BridgePutVarint(uint8_t* Out, const int32_t Value)
+{
+  // zigzag, so small negative deltas stay small too
+  uint32_t value = (static_cast<uint32_t>(Value) << 1) ^ static_cast<uint32_t>(Value >> 31);
+  size_t length = 0;
+  while (value >= 0x80)
+  {
+    Out[length++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  Out[length++] = static_cast<uint8_t>(value);
+  return length;
+}
+
+static bool BridgeGetVarint(const uint8_t* Data, const size_t Length, size_t& Position, int32_t& Value)
+{
+  uint32_t value = 0;
+  for (int32_t shift = 0; shift < 35; shift += 7)
+  {
+    if (Position >= Length)
+      return false;
+    uint8_t byte = Data[Position++];
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+    {
+      Value = static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 0x01);
+      return true;
+    }
+  }
+  return false;
+}
+
+// axis values of a packed state in AXIS_MASK order
+static void BridgeAxes(const XKCTRL::CONTROLLER_PACKED_STATE& State, int32_t* Axes)
+{
+  Axes[0] = State.LTRIG;
+  Axes[1] = State.RTRIG;
+  Axes[2] = State.LSTICK_X;
+  Axes[3] = State.LSTICK_Y;
+  Axes[4] = State.RSTICK_X;
+  Axes[5] = State.RSTICK_Y;
+}
+
+static void BridgeSetAxes(XKCTRL::CONTROLLER_PACKED_STATE& State, const int32_t* Axes)
+{
+  State.LTRIG = static_cast<uint8_t>(Axes[0]);
+  State.RTRIG = static_cast<uint8_t>(Axes[1]);
+  State.LSTICK_X = static_cast<int16_t>(Axes[2]);
+  State.LSTICK_Y = static_cast<int16_t>(Axes[3]);
+  State.RSTICK_X = static_cast<int16_t>(Axes[4]);
+  State.RSTICK_Y = static_cast<int16_t>(Axes[5]);
+}
+
+static uint64_t BridgeNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+XKCTRL::BridgeServer::BridgeServer(XKCTRL::XBOX360& Controllers, const XKCTRL::BRIDGE_CONFIG& Config)
+  : Controllers_(Controllers),
+    Config_(Config)
+{
+  Socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (Socket_ < 0)
+    throw std::runtime_error("Error creating bridge socket");
+
+  sockaddr_in address;
+  memset(&address, 0x00, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(Config_.PORT);
+  if (bind(Socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    close(Socket_);
+    throw std::runtime_error("Error binding bridge port " + std::to_string(Config_.PORT));
+  }
+
+  StopFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (StopFD_ < 0)
+  {
+    close(Socket_);
+    throw std::runtime_error("Error creating bridge eventfd");
+  }
+
+  memset(Sent_, 0x00, sizeof(Sent_));
+  BridgeThread_ = std::thread(&BridgeServer::BridgeThread, this);
+}
+
+XKCTRL::BridgeServer::~BridgeServer()
+{
+  uint64_t signal = 1;
+  if (write(StopFD_, &signal, sizeof(signal)) < 0)
+  {
+    // only fails if the counter overflows, the thread is awake then anyway
+  }
+  BridgeThread_.join();
+  close(StopFD_);
+  close(Socket_);
+}
+
+void XKCTRL::BridgeServer::BridgeThread()
+{
+  // one tick every TICK_US, commands and registrations are handled in between
+  pollfd fds[2];
+  fds[0].fd = Socket_;
+  fds[0].events = POLLIN;
+  fds[1].fd = StopFD_;
+  fds[1].events = POLLIN;
+
+  auto tick = std::chrono::steady_clock::now();
+  auto keyframe = tick;
+  while (true)
+  {
+    auto now = std::chrono::steady_clock::now();
+    int32_t timeout = static_cast<int32_t>(std::max<int64_t>(0,
+                        std::chrono::duration_cast<std::chrono::milliseconds>(tick - now).count()));
+    if (poll(fds, 2, timeout) > 0)
+    {
+      if (fds[1].revents & POLLIN)
+        break;
+      if (fds[0].revents & POLLIN)
+        BridgeReceive();
+    }
+
+    now = std::chrono::steady_clock::now();
+    if (now < tick)
+    {
+      // sub millisecond ticks, poll can not wait that precisely
+      if (tick - now < std::chrono::milliseconds(1))
+        std::this_thread::sleep_until(tick);
+      else
+        continue;
+    }
+
+    if (now - keyframe >= std::chrono::milliseconds(Config_.KEYFRAME_MS))
+    {
+      KeyframeDue_ = true;
+      keyframe = now;
+    }
+    BridgeTick(KeyframeDue_);
+    KeyframeDue_ = false;
+
+    // skip ticks that were missed instead of sending a burst
+    tick += std::chrono::microseconds(Config_.TICK_US);
+    if (tick < std::chrono::steady_clock::now())
+      tick = std::chrono::steady_clock::now() + std::chrono::microseconds(Config_.TICK_US);
+  }
+}
+
+void XKCTRL::BridgeServer::BridgeReceive()
+{
+  uint8_t datagram[BRIDGE_MAX_DATAGRAM];
+  sockaddr_in address;
+  socklen_t addresslength = sizeof(address);
+  ssize_t length;
+  while ((length = recvfrom(Socket_, datagram, sizeof(datagram), MSG_DONTWAIT,
+                            reinterpret_cast<sockaddr*>(&address), &addresslength)) > 0)
+  {
+    if (!BridgeHeaderValid(datagram, length) || address.sin_family != AF_INET)
+      continue;
+
+    // any valid datagram registers or refreshes its sender
+    auto now = std::chrono::steady_clock::now();
+    int32_t peer = 0;
+    while (peer < PeerCount_ && (Peers_[peer].Address.sin_addr.s_addr != address.sin_addr.s_addr ||
+                                 Peers_[peer].Address.sin_port != address.sin_port))
+      peer++;
+    if (peer == PeerCount_ && PeerCount_ < BRIDGE_MAX_PEERS)
+    {
+      Peers_[PeerCount_++].Address = address;
+      KeyframeDue_ = true;
+    }
+    if (peer < PeerCount_)
+      Peers_[peer].LastSeen = now;
+
+    if (datagram[3] == BRIDGE_KEYFRAME_REQUEST)
+    {
+      KeyframeDue_ = true;
+      std::lock_guard<std::mutex> guard(StatsMutex_);
+      Stats_.GAPS++;
+    }
+    else if (datagram[3] == BRIDGE_COMMAND && length >= BRIDGE_HEADER + 4)
+    {
+      const uint8_t* command = datagram + BRIDGE_HEADER;
+      if (command[1] == BRIDGE_LED)
+        Controllers_.SetLED(command[0], static_cast<LED_SETTING>(command[2] & 0x0F));
+      else if (command[1] == BRIDGE_RUMBLE)
+        Controllers_.SetRumble(command[0], command[2], command[3]);
+
+      std::lock_guard<std::mutex> guard(StatsMutex_);
+      Stats_.COMMANDS++;
+    }
+    addresslength = sizeof(address);
+  }
+}
+
+void XKCTRL::BridgeServer::BridgeTick(const bool Keyframe)
+{
+  // forget clients that went quiet
+  auto now = std::chrono::steady_clock::now();
+  for (int32_t peer = 0; peer < PeerCount_; )
+  {
+    if (now - Peers_[peer].LastSeen > std::chrono::milliseconds(BRIDGE_PEER_TIMEOUT_MS))
+      Peers_[peer] = Peers_[--PeerCount_];
+    else
+      peer++;
+  }
+
+  uint8_t datagram[BRIDGE_MAX_DATAGRAM];
+  size_t length = BRIDGE_HEADER;
+  for (int32_t c = 0; c < MAX_CONTROLLERS; c++)
+  {
+    CONTROLLER_PACKED_STATE state;
+    Controllers_.GetControllerState(c, state);
+
+    int32_t axes[6], sentaxes[6];
+    BridgeAxes(state, axes);
+    BridgeAxes(Sent_[c], sentaxes);
+
+    uint8_t* record = datagram + length;
+    size_t recordlength = 2;
+    uint8_t flags = 0x00;
+    if (Keyframe)
+    {
+      flags = BRIDGE_FLAG_KEYFRAME;
+      record[recordlength++] = static_cast<uint8_t>(state.BUTTONS);
+      record[recordlength++] = static_cast<uint8_t>(state.BUTTONS >> 8);
+      for (int32_t a = 0; a < 6; a++)
+        recordlength += BridgePutVarint(record + recordlength, axes[a]);
+    }
+    else
+    {
+      uint16_t changed = state.BUTTONS ^ Sent_[c].BUTTONS;
+      if (changed)
+      {
+        flags |= BRIDGE_FLAG_BUTTONS;
+        record[recordlength++] = static_cast<uint8_t>(changed);
+        record[recordlength++] = static_cast<uint8_t>(changed >> 8);
+      }
+      for (int32_t a = 0; a < 6; a++)
+      {
+        if (axes[a] != sentaxes[a])
+        {
+          flags |= (0x04 << a);
+          recordlength += BridgePutVarint(record + recordlength, axes[a] - sentaxes[a]);
+        }
+      }
+      if (!flags)
+        continue;
+    }
+
+    record[0] = static_cast<uint8_t>(c);
+    record[1] = flags;
+    length += recordlength;
+    Sent_[c] = state;
+  }
+
+  if (length == BRIDGE_HEADER || PeerCount_ == 0)
+    return;
+
+  BridgeHeader(datagram, BRIDGE_STATE, Sequence_++, BridgeNow());
+  for (int32_t peer = 0; peer < PeerCount_; peer++)
+  {
+    if (sendto(Socket_, datagram, length, MSG_DONTWAIT,
+               reinterpret_cast<const sockaddr*>(&Peers_[peer].Address), sizeof(sockaddr_in)) < 0)
+    {
+      // a full socket buffer or a vanished peer, the peer recovers with a keyframe
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(StatsMutex_);
+  Stats_.DATAGRAMS += PeerCount_;
+  Stats_.BYTES += length * PeerCount_;
+  Stats_.KEYFRAMES += Keyframe ? PeerCount_ : 0;
+}
+
+void XKCTRL::BridgeServer::GetBridgeStats(XKCTRL::BRIDGE_STATS& BridgeStats)
+{
+  std::lock_guard<std::mutex> guard(StatsMutex_);
+  BridgeStats = Stats_;
+}
+
+XKCTRL::BridgeClient::BridgeClient(const std::string& Host, const uint16_t Port)
+{
+  addrinfo hints;
+  memset(&hints, 0x00, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* server = nullptr;
+  if (getaddrinfo(Host.c_str(), std::to_string(Port).c_str(), &hints, &server) != 0 || !server)
+    throw std::runtime_error("Error resolving bridge server: " + Host);
+
+  Socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (Socket_ < 0 || connect(Socket_, server->ai_addr, server->ai_addrlen) < 0)
+  {
+    freeaddrinfo(server);
+    if (Socket_ >= 0)
+      close(Socket_);
+    throw std::runtime_error("Error connecting to bridge server: " + Host);
+  }
+  freeaddrinfo(server);
+
+  StopFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (StopFD_ < 0)
+  {
+    close(Socket_);
+    throw std::runtime_error("Error creating bridge eventfd");
+  }
+
+  // nothing is known until the first keyframe
+  memset(States_, 0x00, sizeof(States_));
+  for (auto& stale : Stale_)
+    stale = true;
+
+  BridgeSend(BRIDGE_KEYFRAME_REQUEST, nullptr, 0);
+  BridgeThread_ = std::thread(&BridgeClient::BridgeThread, this);
+}
+
+XKCTRL::BridgeClient::~BridgeClient()
+{
+  uint64_t signal = 1;
+  if (write(StopFD_, &signal, sizeof(signal)) < 0)
+  {
+    // only fails if the counter overflows, the thread is awake then anyway
+  }
+  BridgeThread_.join();
+  close(StopFD_);
+  close(Socket_);
+}
+
+void XKCTRL::BridgeClient::BridgeSend(const uint8_t Type, const uint8_t* Payload, const size_t Length)
+{
+  uint8_t datagram[BRIDGE_HEADER + 4];
+  BridgeHeader(datagram, Type, 0, 0);
+  memcpy(datagram + BRIDGE_HEADER, Payload, std::min(Length, static_cast<size_t>(4)));
+  if (send(Socket_, datagram, BRIDGE_HEADER + std::min(Length, static_cast<size_t>(4)), MSG_DONTWAIT) < 0)
+  {
+    // the server is not there (yet), keepalives keep trying
+  }
+}
+
+void XKCTRL::BridgeClient::BridgeThread()
+{
+  pollfd fds[2];
+  fds[0].fd = Socket_;
+  fds[0].events = POLLIN;
+  fds[1].fd = StopFD_;
+  fds[1].events = POLLIN;
+
+  // keepalive well within the server's peer timeout, also retries registering
+  const auto keepalive = std::chrono::milliseconds(BRIDGE_PEER_TIMEOUT_MS / 5);
+  auto nextkeepalive = std::chrono::steady_clock::now() + keepalive;
+  while (true)
+  {
+    int32_t timeout = static_cast<int32_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                        nextkeepalive - std::chrono::steady_clock::now()).count()));
+    if (poll(fds, 2, timeout) > 0)
+    {
+      if (fds[1].revents & POLLIN)
+        break;
+
+      uint8_t datagram[BRIDGE_MAX_DATAGRAM];
+      ssize_t length;
+      while ((length = recv(Socket_, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0)
+        BridgeReceive(datagram, length);
+    }
+
+    if (std::chrono::steady_clock::now() >= nextkeepalive)
+    {
+      BridgeSend(Started_ ? BRIDGE_KEEPALIVE : BRIDGE_KEYFRAME_REQUEST, nullptr, 0);
+      nextkeepalive = std::chrono::steady_clock::now() + keepalive;
+    }
+  }
+}
+
+void XKCTRL::BridgeClient::BridgeReceive(const uint8_t* Datagram, const size_t Length)
+{
+  if (!BridgeHeaderValid(Datagram, Length) || Datagram[3] != BRIDGE_STATE)
+    return;
+
+  uint32_t sequence = 0;
+  uint64_t timestamp = 0;
+  for (int32_t i = 0; i < 4; i++)
+    sequence |= static_cast<uint32_t>(Datagram[4 + i]) << (8 * i);
+  for (int32_t i = 0; i < 8; i++)
+    timestamp |= static_cast<uint64_t>(Datagram[8 + i]) << (8 * i);
+
+  // late duplicates are dropped, a missed datagram makes every controller
+  // stale since its deltas could have touched any of them
+  int32_t gap = static_cast<int32_t>(sequence - Sequence_);
+  if (Started_ && gap <= 0)
+  {
+    std::lock_guard<std::mutex> guard(StatsMutex_);
+    Stats_.GAPS++;
+    return;
+  }
+  if (Started_ && gap > 1)
+  {
+    for (auto& stale : Stale_)
+      stale = true;
+    BridgeSend(BRIDGE_KEYFRAME_REQUEST, nullptr, 0);
+    std::lock_guard<std::mutex> guard(StatsMutex_);
+    Stats_.GAPS++;
+  }
+  Started_ = true;
+  Sequence_ = sequence;
+  TransitTime_.Record(BridgeNow() - timestamp);
+
+  bool keyframe = false;
+  uint64_t changed = 0;
+  size_t position = BRIDGE_HEADER;
+  while (position + 2 <= Length)
+  {
+    int32_t controller = Datagram[position];
+    uint8_t flags = Datagram[position + 1];
+    position += 2;
+    if (controller >= MAX_CONTROLLERS)
+      break;
+
+    CONTROLLER_PACKED_STATE state = States_[controller];
+    int32_t axes[6];
+    BridgeAxes(state, axes);
+    bool valid = true;
+    if (flags & BRIDGE_FLAG_KEYFRAME)
+    {
+      keyframe = true;
+      valid = position + 2 <= Length;
+      if (valid)
+        state.BUTTONS = Datagram[position] | (Datagram[position + 1] << 8);
+      position += 2;
+      for (int32_t a = 0; a < 6 && valid; a++)
+        valid = BridgeGetVarint(Datagram, Length, position, axes[a]);
+    }
+    else
+    {
+      if (flags & BRIDGE_FLAG_BUTTONS)
+      {
+        valid = position + 2 <= Length;
+        if (valid)
+          state.BUTTONS ^= Datagram[position] | (Datagram[position + 1] << 8);
+        position += 2;
+      }
+      for (int32_t a = 0; a < 6 && valid; a++)
+      {
+        int32_t delta = 0;
+        if (flags & (0x04 << a))
+        {
+          valid = BridgeGetVarint(Datagram, Length, position, delta);
+          axes[a] += delta;
+        }
+      }
+    }
+    if (!valid)
+      break;
+
+    // deltas only apply on top of a state we trust
+    if (!(flags & BRIDGE_FLAG_KEYFRAME) && Stale_[controller])
+      continue;
+
+    BridgeSetAxes(state, axes);
+    Stale_[controller] = false;
+    if (memcmp(&state, &States_[controller], sizeof(CONTROLLER_PACKED_STATE)) != 0)
+    {
+      States_[controller] = state;
+      Published_[controller].Store(state);
+      changed |= 1ULL << controller;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(StatsMutex_);
+    Stats_.DATAGRAMS++;
+    Stats_.BYTES += Length;
+    Stats_.KEYFRAMES += keyframe ? 1 : 0;
+  }
+
+  if (changed)
+  {
+    {
+      std::lock_guard<std::mutex> guard(NotifyMutex_);
+      for (uint64_t bits = changed; bits; bits &= bits - 1)
+        ControllerGeneration_[__builtin_ctzll(bits)]++;
+    }
+    for (uint64_t bits = changed; bits; bits &= bits - 1)
+      ControllersNotify_[__builtin_ctzll(bits)].notify_all();
+  }
+}
+
+void XKCTRL::BridgeClient::SetLED(const int32_t ControllerIndex, const XKCTRL::LED_SETTING LEDSetting)
+{
+  uint8_t command[4] = {static_cast<uint8_t>(std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0)),
+                        BRIDGE_LED, static_cast<uint8_t>(LEDSetting), 0x00};
+  BridgeSend(BRIDGE_COMMAND, command, sizeof(command));
+  std::lock_guard<std::mutex> guard(StatsMutex_);
+  Stats_.COMMANDS++;
+}
+
+void XKCTRL::BridgeClient::SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  uint8_t command[4] = {static_cast<uint8_t>(std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0)),
+                        BRIDGE_RUMBLE, BigWeight, SmallWeight};
+  BridgeSend(BRIDGE_COMMAND, command, sizeof(command));
+  std::lock_guard<std::mutex> guard(StatsMutex_);
+  Stats_.COMMANDS++;
+}
+
+void XKCTRL::BridgeClient::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState)
+{
+  int32_t controlleridx = std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0);
+  Published_[controlleridx].Load(ControllerState);
+}
+
+void XKCTRL::BridgeClient::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState)
+{
+  CONTROLLER_PACKED_STATE state;
+  GetControllerState(ControllerIndex, state);
+  state.ToState(ControllerState);
+}
+
+bool XKCTRL::BridgeClient::GetWaitControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  // same semantics as XBOX360::GetWaitControllerState
+  int32_t controlleridx = std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0);
+  std::unique_lock<std::mutex> lock(NotifyMutex_);
+  uint64_t generation = ControllerGeneration_[controlleridx];
+  bool notified = ControllersNotify_[controlleridx].wait_for(lock, std::chrono::milliseconds(TimeoutMS), [&]()
+  {
+    return ControllerGeneration_[controlleridx] != generation;
+  });
+  lock.unlock();
+
+  Published_[controlleridx].Load(ControllerState);
+  return notified;
+}
+
+bool XKCTRL::BridgeClient::GetWaitControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  CONTROLLER_PACKED_STATE state;
+  bool notified = GetWaitControllerState(ControllerIndex, state, TimeoutMS);
+  state.ToState(ControllerState);
+  return notified;
+}
+
+void XKCTRL::BridgeClient::GetBridgeStats(XKCTRL::BRIDGE_STATS& BridgeStats)
+{
+  std::lock_guard<std::mutex> guard(StatsMutex_);
+  BridgeStats = Stats_;
+}
+
+void XKCTRL::BridgeClient::GetTransitTime(XKCTRL::HISTOGRAM& TransitNS)
+{
+  TransitTime_.Snapshot(TransitNS);
+}
@@ -0,0 +1,159 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_BRIDGE_
+#define _XBOX360_BRIDGE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <netinet/in.h>
+
+#include "XBOX360.hpp"
+
+#define BRIDGE_DEFAULT_PORT 36000
+// Clients a server streams to at once, silent ones are dropped after the timeout
+#define BRIDGE_MAX_PEERS 8
+#define BRIDGE_PEER_TIMEOUT_MS 5000
+// Largest datagram, a keyframe of every controller always fits
+#define BRIDGE_MAX_DATAGRAM (16 + MAX_CONTROLLERS * 24)
+
+namespace XKCTRL
+{
+  struct BRIDGE_CONFIG
+  {
+    // UDP port the server listens on, on all interfaces
+    uint16_t PORT;
+    // changes of all controllers within one tick go out in one datagram
+    uint32_t TICK_US;
+    // full state of every controller this often, for loss recovery
+    uint32_t KEYFRAME_MS;
+  };
+
+  inline BRIDGE_CONFIG DefaultBridgeConfig()
+  {
+    return {BRIDGE_DEFAULT_PORT, 1000, 250};
+  }
+
+  // Counters of one side of the bridge, sent on the server, received on the client
+  struct BRIDGE_STATS
+  {
+    uint64_t DATAGRAMS;
+    uint64_t BYTES;
+    uint64_t KEYFRAMES;
+    // datagrams lost or out of order seen by the client, keyframe requests on the server
+    uint64_t GAPS;
+    // LED and rumble commands
+    uint64_t COMMANDS;
+  };
+
+  // Streams the controller states of an XBOX360 to bridge clients over UDP
+  // and carries out the LED and rumble commands they send back. Clients
+  // register by sending to the server port. Every datagram has a sequence
+  // number and holds, per changed controller, the changed button bits and
+  // varint encoded axis deltas. A client that misses a datagram asks for a
+  // keyframe. There is no authentication, only use it on trusted networks.
+  class BridgeServer
+  {
+    public:
+      explicit BridgeServer(XBOX360& Controllers, const BRIDGE_CONFIG& Config = DefaultBridgeConfig());
+      ~BridgeServer();
+
+      void GetBridgeStats(BRIDGE_STATS& BridgeStats);
+
+    private:
+      struct BridgePeer
+      {
+        sockaddr_in Address;
+        std::chrono::steady_clock::time_point LastSeen;
+      };
+
+      XBOX360& Controllers_;
+      BRIDGE_CONFIG Config_;
+      int Socket_ = -1;
+      int StopFD_ = -1;
+      std::thread BridgeThread_;
+
+      // only touched by the bridge thread
+      BridgePeer Peers_[BRIDGE_MAX_PEERS];
+      int32_t PeerCount_ = 0;
+      uint32_t Sequence_ = 0;
+      bool KeyframeDue_ = true;
+      CONTROLLER_PACKED_STATE Sent_[MAX_CONTROLLERS];
+
+      std::mutex StatsMutex_;
+      BRIDGE_STATS Stats_ = {0, 0, 0, 0, 0};
+
+      void BridgeThread();
+      void BridgeReceive();
+      void BridgeTick(const bool Keyframe);
+  };
+
+  // Receives the stream of a BridgeServer and offers the same state calls as
+  // XBOX360. LED and rumble commands are sent back to the server, like all
+  // UDP they can get lost.
+  class BridgeClient
+  {
+    public:
+      BridgeClient(const std::string& Host, const uint16_t Port = BRIDGE_DEFAULT_PORT);
+      ~BridgeClient();
+
+      void SetLED(const int32_t ControllerIndex, const LED_SETTING LEDSetting);
+      void SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight);
+      void GetControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState);
+      void GetControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState);
+      bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS);
+      bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS);
+      void GetBridgeStats(BRIDGE_STATS& BridgeStats);
+
+      // time from the server sampling states to this client decoding them,
+      // only meaningful when both run on the same host
+      void GetTransitTime(HISTOGRAM& TransitNS);
+
+    private:
+      int Socket_ = -1;
+      int StopFD_ = -1;
+      std::thread BridgeThread_;
+
+      // only touched by the bridge thread, stale controllers wait for a keyframe
+      CONTROLLER_PACKED_STATE States_[MAX_CONTROLLERS];
+      bool Stale_[MAX_CONTROLLERS];
+      bool Started_ = false;
+      uint32_t Sequence_ = 0;
+
+      SeqLock<CONTROLLER_PACKED_STATE> Published_[MAX_CONTROLLERS];
+      std::mutex NotifyMutex_;
+      std::condition_variable ControllersNotify_[MAX_CONTROLLERS];
+      uint64_t ControllerGeneration_[MAX_CONTROLLERS] = {0};
+
+      std::mutex StatsMutex_;
+      BRIDGE_STATS Stats_ = {0, 0, 0, 0, 0};
+      StatsHistogram TransitTime_;
+
+      void BridgeThread();
+      void BridgeReceive(const uint8_t* Datagram, const size_t Length);
+      void BridgeSend(const uint8_t Type, const uint8_t* Payload, const size_t Length);
+  };
+}
+
+#endif //_XBOX360_BRIDGE_
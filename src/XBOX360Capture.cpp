@@ -0,0 +1,248 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+
+#include "XBOX360Transport.hpp"
+
+#define CAPTURE_MAGIC "X360CAP"
+#define CAPTURE_VERSION 1
+
+XKCTRL::RecordTransport::RecordTransport(std::unique_ptr<Transport> Inner, const std::string& CaptureFile)
+  : Inner_(std::move(Inner))
+{
+  // append to an existing capture, or start a new one with a header
+  CaptureFile_ = fopen(CaptureFile.c_str(), "ab");
+  if (!CaptureFile_)
+    throw std::runtime_error("Error opening capture file: " + CaptureFile);
+
+  if (fseek(CaptureFile_, 0, SEEK_END) == 0 && ftell(CaptureFile_) == 0)
+  {
+    CAPTURE_HEADER header;
+    memset(&header, 0x00, sizeof(CAPTURE_HEADER));
+    memcpy(header.MAGIC, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.VERSION = CAPTURE_VERSION;
+    header.RECORD_SIZE = sizeof(CAPTURE_RECORD);
+    fwrite(&header, sizeof(CAPTURE_HEADER), 1, CaptureFile_);
+  }
+}
+
+XKCTRL::RecordTransport::~RecordTransport()
+{
+  if (CaptureFile_)
+    fclose(CaptureFile_);
+}
+
+void XKCTRL::RecordTransport::Run(XKCTRL::TransportSink* Sink)
+{
+  Sink_ = Sink;
+  Inner_->Run(this);
+
+  // everything delivered so far is on disk once Run returns
+  fflush(CaptureFile_);
+}
+
+void XKCTRL::RecordTransport::Stop()
+{
+  Inner_->Stop();
+}
+
+bool XKCTRL::RecordTransport::Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length)
+{
+  return Inner_->Send(ControllerIndex, Data, Length);
+}
+
+void XKCTRL::RecordTransport::GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats)
+{
+  Inner_->GetReceiverStats(ReceiverStats);
+}
+
+void XKCTRL::RecordTransport::TransportReport(const int32_t ControllerIndex, const uint8_t* Report,
+                                              const size_t Length, const uint64_t TimestampNS)
+{
+  CAPTURE_RECORD record;
+  memset(&record, 0x00, sizeof(CAPTURE_RECORD));
+  record.TIMESTAMP_NS = TimestampNS;
+  record.CONTROLLER = ControllerIndex;
+  record.TYPE = CAPTURE_REPORT;
+  record.LENGTH = static_cast<uint8_t>(std::min(Length, static_cast<size_t>(MAX_USB_INBUFF)));
+  memcpy(record.DATA, Report, record.LENGTH);
+  CaptureWrite(record);
+
+  Sink_->TransportReport(ControllerIndex, Report, Length, TimestampNS);
+}
+
+void XKCTRL::RecordTransport::TransportSent(const int32_t ControllerIndex, const bool Success)
+{
+  Sink_->TransportSent(ControllerIndex, Success);
+}
+
+void XKCTRL::RecordTransport::TransportDetached(const int32_t FirstController, const int32_t ControllerCount)
+{
+  CAPTURE_RECORD record;
+  memset(&record, 0x00, sizeof(CAPTURE_RECORD));
+  record.TIMESTAMP_NS = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch()).count();
+  record.CONTROLLER = FirstController;
+  record.TYPE = CAPTURE_DETACHED;
+  record.LENGTH = static_cast<uint8_t>(ControllerCount);
+  CaptureWrite(record);
+
+  Sink_->TransportDetached(FirstController, ControllerCount);
+}
+
+void XKCTRL::RecordTransport::CaptureWrite(const XKCTRL::CAPTURE_RECORD& Record)
+{
+  // buffered by stdio, a full disk only loses records, never input
+  fwrite(&Record, sizeof(CAPTURE_RECORD), 1, CaptureFile_);
+}
+
+XKCTRL::ReplayTransport::ReplayTransport(const std::string& CaptureFile, const ReplaySpeed Speed, const double SpeedFactor)
+  : Speed_(Speed),
+    SpeedFactor_(SpeedFactor > 0.0 ? SpeedFactor : 1.0),
+    Running_(true),
+    Finished_(false)
+{
+  for (auto& pending : SentPending_)
+    pending = 0;
+
+  int fd = open(CaptureFile.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Error opening capture file: " + CaptureFile);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CAPTURE_HEADER))
+  {
+    close(fd);
+    throw std::runtime_error("Invalid capture file: " + CaptureFile);
+  }
+
+  // the whole capture is mapped, records are read straight from the page cache
+  void* capture = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (capture == MAP_FAILED)
+    throw std::runtime_error("Error mapping capture file: " + CaptureFile);
+  Capture_ = static_cast<const uint8_t*>(capture);
+  CaptureSize_ = info.st_size;
+  madvise(capture, CaptureSize_, MADV_SEQUENTIAL);
+
+  CAPTURE_HEADER header;
+  memcpy(&header, Capture_, sizeof(CAPTURE_HEADER));
+  if (memcmp(header.MAGIC, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+      header.VERSION != CAPTURE_VERSION || header.RECORD_SIZE != sizeof(CAPTURE_RECORD))
+  {
+    munmap(capture, CaptureSize_);
+    throw std::runtime_error("Invalid capture file: " + CaptureFile);
+  }
+}
+
+XKCTRL::ReplayTransport::~ReplayTransport()
+{
+  munmap(const_cast<uint8_t*>(Capture_), CaptureSize_);
+}
+
+void XKCTRL::ReplayTransport::Run(XKCTRL::TransportSink* Sink)
+{
+  size_t count = (CaptureSize_ - sizeof(CAPTURE_HEADER)) / sizeof(CAPTURE_RECORD);
+  const uint8_t* records = Capture_ + sizeof(CAPTURE_HEADER);
+  uint64_t firsttime = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < count && Running_; i++)
+  {
+    CAPTURE_RECORD record;
+    memcpy(&record, records + i * sizeof(CAPTURE_RECORD), sizeof(CAPTURE_RECORD));
+    if (i == 0)
+      firsttime = record.TIMESTAMP_NS;
+
+    // wait for the record's time relative to the first one
+    if (Speed_ != MAXIMUM)
+    {
+      double offset = static_cast<double>(record.TIMESTAMP_NS - firsttime);
+      if (Speed_ == ACCELERATED)
+        offset /= SpeedFactor_;
+      auto due = start + std::chrono::nanoseconds(static_cast<uint64_t>(offset));
+
+      auto now = std::chrono::steady_clock::now();
+      while (now < due && Running_)
+      {
+        ReplaySent(Sink);
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(due - now, std::chrono::milliseconds(1)));
+        now = std::chrono::steady_clock::now();
+      }
+    }
+    ReplaySent(Sink);
+
+    // reports are stamped with the replay clock, like a live transport would
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (record.TYPE == CAPTURE_REPORT)
+      Sink->TransportReport(record.CONTROLLER, record.DATA, std::min<size_t>(record.LENGTH, MAX_USB_INBUFF), timestamp);
+    else if (record.TYPE == CAPTURE_DETACHED)
+      Sink->TransportDetached(record.CONTROLLER, record.LENGTH);
+  }
+  Finished_ = true;
+
+  // keep completing output until stopped
+  while (Running_)
+  {
+    ReplaySent(Sink);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ReplaySent(Sink);
+}
+
+void XKCTRL::ReplayTransport::Stop()
+{
+  Running_ = false;
+}
+
+bool XKCTRL::ReplayTransport::Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length)
+{
+  if (ControllerIndex < 0 || ControllerIndex >= MAX_CONTROLLERS || Length > MAX_USB_OUTBUFF)
+    return false;
+
+  // output goes nowhere, it completes on the next pass of the replay loop
+  SentPending_[ControllerIndex / 64].fetch_or(1ULL << (ControllerIndex % 64));
+  return true;
+}
+
+void XKCTRL::ReplayTransport::GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats)
+{
+  ReceiverStats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+}
+
+void XKCTRL::ReplayTransport::ReplaySent(XKCTRL::TransportSink* Sink)
+{
+  for (int32_t word = 0; word < static_cast<int32_t>(sizeof(SentPending_) / sizeof(SentPending_[0])); word++)
+  {
+    uint64_t pending = SentPending_[word].exchange(0);
+    while (pending)
+    {
+      int32_t bit = __builtin_ctzll(pending);
+      pending &= pending - 1;
+      Sink->TransportSent(word * 64 + bit, true);
+    }
+  }
+}
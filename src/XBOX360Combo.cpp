@@ -0,0 +1,164 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <map>
+#include <deque>
+
+#include "XBOX360Combo.hpp"
+
+int32_t XKCTRL::ComboPatterns::Add(const std::vector<XKCTRL::COMBO_STEP>& Steps)
+{
+  if (Steps.empty() || Steps.size() > MAX_COMBO_STEPS)
+    return -1;
+
+  // the automaton has one state per step at most, states are 16 bit
+  size_t steps = Steps.size();
+  for (const auto& pattern : Patterns_)
+    steps += pattern.size();
+  if (steps >= 0xFFFF)
+    return -1;
+
+  for (const auto& step : Steps)
+  {
+    if (!(step.BUTTONS & MASK_ALL_BUTTONS))
+      return -1;
+  }
+
+  Patterns_.push_back(Steps);
+  for (auto& step : Patterns_.back())
+    step.BUTTONS &= MASK_ALL_BUTTONS;
+  return static_cast<int32_t>(Patterns_.size() - 1);
+}
+
+std::shared_ptr<const XKCTRL::ComboMachine> XKCTRL::ComboPatterns::Compile() const
+{
+  std::shared_ptr<ComboMachine> machine = std::make_shared<ComboMachine>();
+
+  // one symbol per distinct button set used by any step
+  std::map<uint16_t, uint16_t> symbols;
+  for (const auto& pattern : Patterns_)
+  {
+    for (const auto& step : pattern)
+    {
+      if (symbols.find(step.BUTTONS) == symbols.end())
+      {
+        uint16_t symbol = static_cast<uint16_t>(symbols.size() + 1);
+        symbols[step.BUTTONS] = symbol;
+      }
+    }
+  }
+  machine->SymbolCount_ = static_cast<uint32_t>(symbols.size() + 1);
+
+  // symbol table at most half full
+  uint32_t tablesize = 16;
+  while (tablesize < symbols.size() * 2)
+    tablesize <<= 1;
+  machine->SymbolMask_ = tablesize - 1;
+  machine->SymbolTable_.assign(tablesize, {ComboMachine::EMPTY_KEY, 0});
+  for (const auto& symbol : symbols)
+  {
+    uint32_t slot = (symbol.first * 0x9E37u >> 4) & machine->SymbolMask_;
+    while (machine->SymbolTable_[slot].BUTTONS != ComboMachine::EMPTY_KEY)
+      slot = (slot + 1) & machine->SymbolMask_;
+    machine->SymbolTable_[slot] = {symbol.first, symbol.second};
+  }
+
+  // trie of all combos, -1 for missing edges
+  uint32_t symbolcount = machine->SymbolCount_;
+  std::vector<int32_t> trie(symbolcount, -1);
+  std::vector<std::vector<int32_t>> outputs(1);
+  for (size_t p = 0; p < Patterns_.size(); p++)
+  {
+    int32_t state = 0;
+    for (const auto& step : Patterns_[p])
+    {
+      uint16_t symbol = symbols[step.BUTTONS];
+      if (trie[state * symbolcount + symbol] < 0)
+      {
+        trie[state * symbolcount + symbol] = static_cast<int32_t>(outputs.size());
+        trie.resize(trie.size() + symbolcount, -1);
+        outputs.emplace_back();
+      }
+      state = trie[state * symbolcount + symbol];
+    }
+    outputs[state].push_back(static_cast<int32_t>(p));
+  }
+
+  // breadth first over the trie, missing edges follow the failure link
+  uint32_t states = static_cast<uint32_t>(outputs.size());
+  std::vector<uint16_t>& delta = machine->Delta_;
+  std::vector<uint32_t> fail(states, 0);
+  delta.assign(static_cast<size_t>(states) * symbolcount, 0);
+  std::deque<uint32_t> queue;
+  for (uint32_t symbol = 0; symbol < symbolcount; symbol++)
+  {
+    int32_t child = trie[symbol];
+    if (child > 0)
+    {
+      delta[symbol] = static_cast<uint16_t>(child);
+      queue.push_back(child);
+    }
+  }
+  while (!queue.empty())
+  {
+    uint32_t state = queue.front();
+    queue.pop_front();
+
+    // a state also completes every combo its longest proper suffix completes
+    const auto& inherited = outputs[fail[state]];
+    outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+
+    for (uint32_t symbol = 0; symbol < symbolcount; symbol++)
+    {
+      int32_t child = trie[state * symbolcount + symbol];
+      uint16_t next = delta[fail[state] * symbolcount + symbol];
+      if (child > 0)
+      {
+        fail[child] = next;
+        delta[state * symbolcount + symbol] = static_cast<uint16_t>(child);
+        queue.push_back(child);
+      }
+      else
+      {
+        delta[state * symbolcount + symbol] = next;
+      }
+    }
+  }
+  machine->States_ = states;
+
+  // flatten the output lists
+  machine->OutputStart_.reserve(states + 1);
+  for (uint32_t state = 0; state < states; state++)
+  {
+    machine->OutputStart_.push_back(static_cast<uint32_t>(machine->Outputs_.size()));
+    machine->Outputs_.insert(machine->Outputs_.end(), outputs[state].begin(), outputs[state].end());
+  }
+  machine->OutputStart_.push_back(static_cast<uint32_t>(machine->Outputs_.size()));
+
+  // time limits of every step
+  for (const auto& pattern : Patterns_)
+  {
+    machine->StepStart_.push_back(static_cast<uint32_t>(machine->WithinNS_.size()));
+    for (const auto& step : pattern)
+      machine->WithinNS_.push_back(static_cast<uint64_t>(step.WITHIN_MS) * 1000000ULL);
+  }
+  machine->StepStart_.push_back(static_cast<uint32_t>(machine->WithinNS_.size()));
+
+  return machine;
+}
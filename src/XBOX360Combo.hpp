@@ -0,0 +1,182 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_COMBO_
+#define _XBOX360_COMBO_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+#include "XBOX360Defines.hpp"
+
+// Longest combo, also the number of press timestamps kept per controller
+#define MAX_COMBO_STEPS 16
+
+namespace XKCTRL
+{
+  // One step of a combo: a press after which exactly BUTTONS are held, e.g.
+  // MASK_BTN_LB | MASK_BTN_RB for "LB+RB held". WITHIN_MS limits the time
+  // since the previous step, 0 allows any time.
+  struct COMBO_STEP
+  {
+    uint16_t BUTTONS;
+    uint32_t WITHIN_MS;
+  };
+
+  struct COMBO_MATCH
+  {
+    // time of the press that completed the combo
+    uint64_t TIMESTAMP_NS;
+    int32_t CONTROLLER;
+    // id returned by ComboPatterns::Add
+    int32_t COMBO;
+  };
+
+  class ComboMachine;
+
+  // Combos registered up front, compiled once into a ComboMachine
+  class ComboPatterns
+  {
+    public:
+      // returns the combo id, or -1 if there are no steps, too many steps or
+      // a step without buttons
+      int32_t Add(const std::vector<COMBO_STEP>& Steps);
+
+      size_t Count() const { return Patterns_.size(); }
+
+      std::shared_ptr<const ComboMachine> Compile() const;
+
+    private:
+      std::vector<std::vector<COMBO_STEP>> Patterns_;
+  };
+
+  // All combos of a ComboPatterns as one deterministic automaton (Aho-Corasick
+  // over the held button sets of presses). Each press costs one table lookup
+  // for its symbol and one transition no matter how many combos there are,
+  // timing is only checked for combos that end in the new state. The machine
+  // is immutable and can be shared, all progress lives in a ComboCursor.
+  class ComboMachine
+  {
+    public:
+      // progress through the machine for one controller
+      struct ComboCursor
+      {
+        uint32_t STATE = 0;
+        uint64_t POSITION = 0;
+        uint64_t TIMES_NS[MAX_COMBO_STEPS] = {0};
+      };
+
+      // Feed one report, OnMatch(ComboID) is called for every combo that
+      // completes with it. Reports without new presses are ignored.
+      template <typename F>
+      void Advance(ComboCursor& Cursor, const uint16_t Pressed, const uint16_t Buttons,
+                   const uint64_t TimestampNS, F&& OnMatch) const
+      {
+        if (!(Pressed & MASK_ALL_BUTTONS))
+          return;
+
+        Cursor.STATE = Delta_[Cursor.STATE * SymbolCount_ + Symbol(Buttons & MASK_ALL_BUTTONS)];
+        Cursor.TIMES_NS[Cursor.POSITION % MAX_COMBO_STEPS] = TimestampNS;
+        Cursor.POSITION++;
+
+        for (uint32_t o = OutputStart_[Cursor.STATE]; o < OutputStart_[Cursor.STATE + 1]; o++)
+        {
+          int32_t combo = Outputs_[o];
+          if (InTime(Cursor, combo))
+            OnMatch(combo);
+        }
+      }
+
+      // start over, e.g. after a disconnect
+      static void Reset(ComboCursor& Cursor)
+      {
+        Cursor.STATE = 0;
+        Cursor.POSITION = 0;
+      }
+
+      uint32_t States() const { return States_; }
+      uint32_t Symbols() const { return SymbolCount_; }
+
+    private:
+      friend class ComboPatterns;
+
+      // open addressing table from held buttons to symbol, symbol 0 stands for
+      // every button set no combo uses. MASK_CONNECTED is never part of a key.
+      static constexpr uint16_t EMPTY_KEY = MASK_CONNECTED;
+      struct SymbolSlot
+      {
+        uint16_t BUTTONS;
+        uint16_t SYMBOL;
+      };
+      std::vector<SymbolSlot> SymbolTable_;
+      uint32_t SymbolMask_ = 0;
+      uint32_t SymbolCount_ = 1;
+
+      // transitions of every state on every symbol
+      uint32_t States_ = 1;
+      std::vector<uint16_t> Delta_;
+
+      // combos ending in each state, including those ending in a suffix of it
+      std::vector<uint32_t> OutputStart_;
+      std::vector<int32_t> Outputs_;
+
+      // per combo its step count and time limits, steps in StepStart_ order
+      std::vector<uint32_t> StepStart_;
+      std::vector<uint64_t> WithinNS_;
+
+      uint16_t Symbol(const uint16_t Buttons) const
+      {
+        uint32_t slot = (Buttons * 0x9E37u >> 4) & SymbolMask_;
+        while (SymbolTable_[slot].BUTTONS != EMPTY_KEY)
+        {
+          if (SymbolTable_[slot].BUTTONS == Buttons)
+            return SymbolTable_[slot].SYMBOL;
+          slot = (slot + 1) & SymbolMask_;
+        }
+        return 0;
+      }
+
+      // the presses that completed the combo, the newest last, kept the time limits
+      bool InTime(const ComboCursor& Cursor, const int32_t Combo) const
+      {
+        uint32_t first = StepStart_[Combo];
+        uint32_t steps = StepStart_[Combo + 1] - first;
+        uint64_t position = Cursor.POSITION - steps;
+        for (uint32_t s = 1; s < steps; s++)
+        {
+          uint64_t limit = WithinNS_[first + s];
+          if (limit && Cursor.TIMES_NS[(position + s) % MAX_COMBO_STEPS] -
+                       Cursor.TIMES_NS[(position + s - 1) % MAX_COMBO_STEPS] > limit)
+            return false;
+        }
+        return true;
+      }
+  };
+
+  // A compiled machine together with one controller's progress through it
+  struct ComboRecognizer
+  {
+    std::shared_ptr<const ComboMachine> MACHINE;
+    ComboMachine::ComboCursor CURSOR;
+  };
+}
+
+#endif //_XBOX360_COMBO_
@@ -0,0 +1,287 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_CORO_
+#define _XBOX360_CORO_
+
+// Coroutine awaitables on top of XBOX360::WaitAsync. Only this header needs
+// C++20, the library itself still builds as C++17.
+#if __cplusplus < 202002L
+#error "XBOX360Coro.hpp needs C++20, build with -std=c++20"
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "XBOX360.hpp"
+
+namespace XKCTRL
+{
+  // Where suspended coroutines continue. Post is called on the device thread,
+  // the timer thread or a cancelling thread, so it must queue the handle and
+  // never resume it in place.
+  class CoroExecutor
+  {
+    public:
+      virtual ~CoroExecutor() {}
+      virtual void Post(std::coroutine_handle<> Handle) = 0;
+  };
+
+  // Plain run queue, any number of threads can call Run
+  class CoroQueue : public CoroExecutor
+  {
+    public:
+      void Post(std::coroutine_handle<> Handle) override
+      {
+        {
+          std::lock_guard<std::mutex> guard(Mutex_);
+          Queue_.push_back(Handle);
+        }
+        Notify_.notify_one();
+      }
+
+      // resumes coroutines until Stop is called
+      void Run()
+      {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        while (true)
+        {
+          Notify_.wait(lock, [&]() { return Stopped_ || !Queue_.empty(); });
+          if (Queue_.empty())
+            return;
+          std::coroutine_handle<> handle = Queue_.front();
+          Queue_.pop_front();
+          lock.unlock();
+          handle.resume();
+          lock.lock();
+        }
+      }
+
+      // lets Run return once the queue is empty
+      void Stop()
+      {
+        {
+          std::lock_guard<std::mutex> guard(Mutex_);
+          Stopped_ = true;
+        }
+        Notify_.notify_all();
+      }
+
+    private:
+      std::mutex Mutex_;
+      std::condition_variable Notify_;
+      std::deque<std::coroutine_handle<>> Queue_;
+      bool Stopped_ = false;
+  };
+
+  // Cancels every await it was passed to, including ones that start later
+  class CoroCancel
+  {
+    public:
+      void Cancel()
+      {
+        // the awaits only go away after they removed themselves below
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Cancelled_ = true;
+        for (auto& waiter : Waiters_)
+          waiter.first->CancelWait(*waiter.second);
+      }
+
+      bool Cancelled()
+      {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        return Cancelled_;
+      }
+
+    private:
+      friend class CoroAwait;
+      std::mutex Mutex_;
+      bool Cancelled_ = false;
+      std::vector<std::pair<XBOX360*, ControllerWaiter*>> Waiters_;
+  };
+
+  struct CORO_STATE
+  {
+    WAIT_RESULT RESULT;
+    CONTROLLER_PACKED_STATE STATE;
+  };
+
+  struct CORO_EVENT
+  {
+    WAIT_RESULT RESULT;
+    CONTROLLER_EVENT EVENT;
+  };
+
+  // Common part of the awaitables, suspends on a ControllerWaiter and posts
+  // the coroutine to the executor once the wait completes
+  class CoroAwait
+  {
+    public:
+      // a rumble await rumbles with the weights for TimeoutMS
+      CoroAwait(XBOX360& Controllers, CoroExecutor& Executor, CoroCancel* Cancel, const int32_t ControllerIndex,
+                const uint16_t Buttons, const uint8_t Axes, const uint32_t TimeoutMS,
+                const bool Rumble = false, const uint8_t BigWeight = 0, const uint8_t SmallWeight = 0)
+        : Controllers_(Controllers), Executor_(Executor), Cancel_(Cancel),
+          Rumble_(Rumble), BigWeight_(BigWeight), SmallWeight_(SmallWeight)
+      {
+        Waiter_.Controller = ControllerIndex;
+        Waiter_.Buttons = Buttons;
+        Waiter_.Axes = Axes;
+        Waiter_.TimeoutMS = TimeoutMS;
+      }
+      CoroAwait(const CoroAwait&) = delete;
+      CoroAwait& operator=(const CoroAwait&) = delete;
+
+      bool await_ready() const noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> Handle)
+      {
+        Handle_ = Handle;
+        Waiter_.Context = this;
+        Waiter_.Complete = &CoroAwait::Resume;
+        if (!Cancel_)
+        {
+          // may resume on another thread right away, nothing is touched after
+          Start();
+          return true;
+        }
+
+        std::lock_guard<std::mutex> guard(Cancel_->Mutex_);
+        if (Cancel_->Cancelled_)
+        {
+          Waiter_.Result = WAIT_CANCELLED;
+          return false;
+        }
+        Cancel_->Waiters_.emplace_back(&Controllers_, &Waiter_);
+        Start();
+        return true;
+      }
+
+    protected:
+      XBOX360& Controllers_;
+      CoroExecutor& Executor_;
+      CoroCancel* Cancel_;
+      std::coroutine_handle<> Handle_;
+      ControllerWaiter Waiter_;
+      bool Rumble_;
+      uint8_t BigWeight_, SmallWeight_;
+
+      WAIT_RESULT Finish()
+      {
+        if (Cancel_)
+        {
+          std::lock_guard<std::mutex> guard(Cancel_->Mutex_);
+          auto& waiters = Cancel_->Waiters_;
+          waiters.erase(std::remove(waiters.begin(), waiters.end(), std::make_pair(&Controllers_, &Waiter_)), waiters.end());
+        }
+        return static_cast<WAIT_RESULT>(Waiter_.Result.load());
+      }
+
+    private:
+      void Start()
+      {
+        if (Rumble_)
+          Controllers_.RumbleAsync(Waiter_, BigWeight_, SmallWeight_);
+        else
+          Controllers_.WaitAsync(Waiter_);
+      }
+
+      static void Resume(ControllerWaiter* Waiter)
+      {
+        CoroAwait* await = static_cast<CoroAwait*>(Waiter->Context);
+        await->Executor_.Post(await->Handle_);
+      }
+  };
+
+  class CoroStateAwait : public CoroAwait
+  {
+    public:
+      using CoroAwait::CoroAwait;
+      CORO_STATE await_resume()
+      {
+        WAIT_RESULT result = Finish();
+        return {result, Waiter_.State};
+      }
+  };
+
+  class CoroEventAwait : public CoroAwait
+  {
+    public:
+      using CoroAwait::CoroAwait;
+      CORO_EVENT await_resume()
+      {
+        WAIT_RESULT result = Finish();
+        return {result, Waiter_.Event};
+      }
+  };
+
+  class CoroRumbleAwait : public CoroAwait
+  {
+    public:
+      using CoroAwait::CoroAwait;
+      WAIT_RESULT await_resume()
+      {
+        return Finish();
+      }
+  };
+
+  // Awaitable input of an XBOX360, coroutines resume on the given executor.
+  // Waiting takes no thread, any number of coroutines can wait at once.
+  //   CoroController input(x360, queue);
+  //   CORO_EVENT press = co_await input.NextEvent(0, MASK_BTN_A, 0, 5000);
+  class CoroController
+  {
+    public:
+      CoroController(XBOX360& Controllers, CoroExecutor& Executor)
+        : Controllers_(Controllers), Executor_(Executor)
+      {
+      }
+
+      // the next report or connection change, TimeoutMS 0 waits forever
+      CoroStateAwait NextState(const int32_t ControllerIndex, const uint32_t TimeoutMS = 0, CoroCancel* Cancel = nullptr)
+      {
+        return CoroStateAwait(Controllers_, Executor_, Cancel, ControllerIndex, 0, 0, TimeoutMS);
+      }
+
+      // the next press or release of any of Buttons or change of any of Axes,
+      // WAIT_DISCONNECTED if the controller goes away first
+      CoroEventAwait NextEvent(const int32_t ControllerIndex, const uint16_t Buttons, const uint8_t Axes = 0,
+                               const uint32_t TimeoutMS = 0, CoroCancel* Cancel = nullptr)
+      {
+        return CoroEventAwait(Controllers_, Executor_, Cancel, ControllerIndex, Buttons, Axes, TimeoutMS);
+      }
+
+      // rumbles for DurationMS and resumes when it stopped, cancelling stops it early
+      CoroRumbleAwait RumbleFor(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight,
+                                const uint32_t DurationMS, CoroCancel* Cancel = nullptr)
+      {
+        return CoroRumbleAwait(Controllers_, Executor_, Cancel, ControllerIndex, 0, 0, DurationMS, true, BigWeight, SmallWeight);
+      }
+
+    private:
+      XBOX360& Controllers_;
+      CoroExecutor& Executor_;
+  };
+}
+
+#endif //_XBOX360_CORO_
@@ -0,0 +1,70 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "XBOX360Decode.hpp"
+
+void XKCTRL::DecodeReports(const uint8_t* Reports, const size_t ReportSize, CONTROLLER_PACKED_STATE* States, const size_t Count)
+{
+  // every vector lane load reads 16 bytes starting at the layout offset,
+  // and every store writes 16 bytes, 4 of which spill into the next state.
+  // Spilled bytes are overwritten by the next iteration, so the last state
+  // and reports too small for a 16 byte load are decoded one at a time.
+  size_t i = 0;
+
+  if (ReportSize >= REPORT_LAYOUT_OFFSET + 16 && Count > 1)
+  {
+    uint8_t* out = reinterpret_cast<uint8_t*>(States);
+    const uint8_t* in = Reports + REPORT_LAYOUT_OFFSET;
+
+#if defined(__SSE2__)
+    const __m128i clear = _mm_setr_epi8(static_cast<char>(MASK_ALL_BUTTONS & 0xFF), static_cast<char>(MASK_ALL_BUTTONS >> 8),
+                                        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i set = _mm_setr_epi8(MASK_CONNECTED & 0xFF, MASK_CONNECTED >> 8, 
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; i < Count - 1; i++)
+    {
+      __m128i layout = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * ReportSize));
+      layout = _mm_or_si128(_mm_and_si128(layout, clear), set);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * sizeof(CONTROLLER_PACKED_STATE)), layout);
+    }
+#elif defined(__ARM_NEON)
+    const uint8_t clear_bytes[16] = {MASK_ALL_BUTTONS & 0xFF, MASK_ALL_BUTTONS >> 8, 
+                                     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    const uint8_t set_bytes[16] = {MASK_CONNECTED & 0xFF, MASK_CONNECTED >> 8};
+    const uint8x16_t clear = vld1q_u8(clear_bytes);
+    const uint8x16_t set = vld1q_u8(set_bytes);
+    for (; i < Count - 1; i++)
+    {
+      uint8x16_t layout = vld1q_u8(in + i * ReportSize);
+      layout = vorrq_u8(vandq_u8(layout, clear), set);
+      vst1q_u8(out + i * sizeof(CONTROLLER_PACKED_STATE), layout);
+    }
+#endif
+  }
+
+  // remaining states (or all of them without SIMD support)
+  for (; i < Count; i++)
+    DecodeReport(Reports + i * ReportSize, true, States[i]);
+}
@@ -0,0 +1,47 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_DECODE_
+#define _XBOX360_DECODE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "XBOX360Defines.hpp"
+
+// Offset of CONTROLLER_LAYOUT in a wireless data report
+#define REPORT_LAYOUT_OFFSET 0x06
+
+namespace XKCTRL
+{
+  // Decode the controller layout of one data report into a packed state.
+  // Reports are little endian and the copy does not care about alignment.
+  inline void DecodeReport(const uint8_t* Report, const bool Connected, CONTROLLER_PACKED_STATE& State)
+  {
+    memcpy(&State, Report + REPORT_LAYOUT_OFFSET, sizeof(CONTROLLER_PACKED_STATE));
+    State.BUTTONS = (State.BUTTONS & MASK_ALL_BUTTONS) | (Connected ? MASK_CONNECTED : 0x00);
+  }
+
+  // Decode Count data reports, each ReportSize bytes apart, into Count packed 
+  // states for connected controllers. Uses SSE2 or NEON when available.
+  void DecodeReports(const uint8_t* Reports, const size_t ReportSize, CONTROLLER_PACKED_STATE* States, const size_t Count);
+}
+
+#endif //_XBOX360_DECODE_
@@ -20,6 +20,26 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #ifndef _XBOX360_DEFINES_
 #define _XBOX360_DEFINES_
 
+#include <stdint.h>
+
+// Each Wireless Receiver serves 4 controllers, controller indexes
+// are receiver slot * 4 + controller slot on that receiver.
+#ifndef MAX_RECEIVERS
+#define MAX_RECEIVERS 4
+#endif
+#define RECEIVER_CONTROLLERS 4
+#define MAX_CONTROLLERS (MAX_RECEIVERS * RECEIVER_CONTROLLERS)
+#define MAX_USB_PORTPATH 7
+#define MAX_USB_INBUFF 32
+#define MAX_USB_OUTBUFF 12
+#define MAX_USB_TIMEOUT 50
+// IN transfers failing in a row before the device is reopened
+#define MAX_USB_RX_ERRORS 8
+// delay before opening a device again after it failed to open, doubled on
+// every failure in a row up to the maximum
+#define MIN_USB_RETRY_MS 50
+#define MAX_USB_RETRY_MS 5000
+
 namespace XKCTRL
 {
   enum LED_SETTING
@@ -61,6 +81,23 @@ namespace XKCTRL
     MASK_BTN_Y =      0x8000
   };
 
+  // bit 0x0800 is never set by the controller, packed states use it for CONNECTED
+  enum STATUS_MASK
+  {
+    MASK_CONNECTED =   0x0800,
+    MASK_ALL_BUTTONS = 0xF7FF
+  };
+
+  enum AXIS_MASK
+  {
+    MASK_AXIS_LTRIG =    0x01,
+    MASK_AXIS_RTRIG =    0x02,
+    MASK_AXIS_LSTICK_X = 0x04,
+    MASK_AXIS_LSTICK_Y = 0x08,
+    MASK_AXIS_RSTICK_X = 0x10,
+    MASK_AXIS_RSTICK_Y = 0x20
+  };
+
   struct CONTROLLER_LAYOUT
   {
     uint16_t BUTTONS;
@@ -81,6 +118,125 @@ namespace XKCTRL
     bool CONNECTED;
   };
 
+  // Same layout as CONTROLLER_LAYOUT, so a report decodes with a single copy.
+  // Holds the full state of a controller in 12 bytes.
+  struct CONTROLLER_PACKED_STATE
+  {
+    // BUTTON_MASK bits, plus MASK_CONNECTED
+    uint16_t BUTTONS;
+    // Analog Controls
+    uint8_t LTRIG, RTRIG;
+    int16_t LSTICK_X, LSTICK_Y, RSTICK_X, RSTICK_Y;
+
+    // DPad
+    bool UP() const    { return (BUTTONS & MASK_DPAD_UP) != 0; }
+    bool DOWN() const  { return (BUTTONS & MASK_DPAD_DOWN) != 0; }
+    bool LEFT() const  { return (BUTTONS & MASK_DPAD_LEFT) != 0; }
+    bool RIGHT() const { return (BUTTONS & MASK_DPAD_RIGHT) != 0; }
+    // Buttons
+    bool START() const { return (BUTTONS & MASK_BTN_START) != 0; }
+    bool BACK() const  { return (BUTTONS & MASK_BTN_BACK) != 0; }
+    bool LH() const    { return (BUTTONS & MASK_BTN_LH) != 0; }
+    bool RH() const    { return (BUTTONS & MASK_BTN_RH) != 0; }
+    bool LB() const    { return (BUTTONS & MASK_BTN_LB) != 0; }
+    bool RB() const    { return (BUTTONS & MASK_BTN_RB) != 0; }
+    bool XBOX() const  { return (BUTTONS & MASK_BTN_XBOX) != 0; }
+    bool A() const     { return (BUTTONS & MASK_BTN_A) != 0; }
+    bool B() const     { return (BUTTONS & MASK_BTN_B) != 0; }
+    bool X() const     { return (BUTTONS & MASK_BTN_X) != 0; }
+    bool Y() const     { return (BUTTONS & MASK_BTN_Y) != 0; }
+    //Is connected
+    bool CONNECTED() const { return (BUTTONS & MASK_CONNECTED) != 0; }
+
+    // conversion to the legacy state struct
+    void ToState(CONTROLLER_STATE& State) const
+    {
+      State.UP = UP();
+      State.DOWN = DOWN();
+      State.RIGHT = RIGHT();
+      State.LEFT = LEFT();
+      State.START = START();
+      State.BACK = BACK();
+      State.LH = LH();
+      State.RH = RH();
+      State.LB = LB();
+      State.RB = RB();
+      State.XBOX = XBOX();
+      State.A = A();
+      State.B = B();
+      State.X = X();
+      State.Y = Y();
+      State.LTRIG = LTRIG;
+      State.RTRIG = RTRIG;
+      State.LSTICK_X = LSTICK_X;
+      State.LSTICK_Y = LSTICK_Y;
+      State.RSTICK_X = RSTICK_X;
+      State.RSTICK_Y = RSTICK_Y;
+      State.CONNECTED = CONNECTED();
+    }
+  };
+  static_assert(sizeof(CONTROLLER_PACKED_STATE) == 12, "CONTROLLER_PACKED_STATE must stay 12 bytes");
+
+  struct CONTROLLER_EVENT
+  {
+    // steady clock time the USB transfer completed, in nanoseconds
+    uint64_t TIMESTAMP_NS;
+    // BUTTON_MASK bits pressed / released by this report and all buttons held after it
+    uint16_t PRESSED, RELEASED, BUTTONS;
+    // AXIS_MASK bits for analog values that changed with this report
+    uint8_t CHANGED_AXES;
+    // Analog values after this report
+    uint8_t LTRIG, RTRIG;
+    int16_t LSTICK_X, LSTICK_Y, RSTICK_X, RSTICK_Y;
+  };
+
+  // Controller state with the time of the report it came from,
+  // steady clock nanoseconds like CONTROLLER_EVENT
+  struct CONTROLLER_HISTORY_ENTRY
+  {
+    uint64_t TIMESTAMP_NS;
+    CONTROLLER_PACKED_STATE STATE;
+  };
+
+  // States of all controllers at one instant, with how many states each
+  // controller has published so far
+  struct CONTROLLER_SNAPSHOT
+  {
+    uint64_t GENERATIONS[MAX_CONTROLLERS];
+    CONTROLLER_PACKED_STATE STATES[MAX_CONTROLLERS];
+  };
+  static_assert(MAX_CONTROLLERS <= 64, "changed controllers are reported in a 64 bit mask");
+
+  struct OUTPUT_STATS
+  {
+    // LED and rumble commands accepted from callers
+    uint64_t SUBMITTED;
+    // commands replaced by a newer value before being sent
+    uint64_t COALESCED;
+    // commands whose USB transfer failed or could not be queued
+    uint64_t FAILED;
+  };
+
+  struct RECEIVER_STATS
+  {
+    // USB devices, receivers and wired controllers, opened and lost
+    uint64_t ATTACHED;
+    uint64_t DETACHED;
+    // time from the receiver showing up on USB until its transfers were queued,
+    // without hotplug support this is measured from the start of the scan
+    uint64_t LAST_ATTACH_US;
+    uint64_t MAX_ATTACH_US;
+    // time from losing a receiver until it was back in the same slot
+    uint64_t LAST_RECONNECT_US;
+    // devices that failed to open and were tried again later
+    uint64_t OPEN_RETRIES;
+    // transfers that timed out or failed, per direction
+    uint64_t TIMEOUTS_IN;
+    uint64_t TIMEOUTS_OUT;
+    uint64_t ERRORS_IN;
+    uint64_t ERRORS_OUT;
+  };
+
 }
 
 #endif //_XBOX360_DEFINES_
\ No newline at end of file
@@ -0,0 +1,82 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_HANDOVER_
+#define _XBOX360_HANDOVER_
+
+#include <atomic>
+
+namespace XKCTRL
+{
+  // Hands objects built on caller threads to the device thread without
+  // either side blocking. The device thread swaps a pending object in
+  // between two reports and hands the old one back through Retired, the
+  // next Publish frees it so the device thread never has to.
+  template <typename T>
+  class Handover
+  {
+    public:
+      Handover()
+        : Active_(nullptr), Pending_(nullptr), Retired_(nullptr)
+      {
+      }
+
+      // only once the device thread is gone
+      ~Handover()
+      {
+        delete Active_;
+        delete Pending_.exchange(nullptr);
+        delete Retired_.exchange(nullptr);
+      }
+
+      // caller side, calls for one handover must be serialized by the caller.
+      // A pending object the device thread never picked up is replaced.
+      void Publish(T* Next)
+      {
+        delete Retired_.exchange(nullptr, std::memory_order_acq_rel);
+        delete Pending_.exchange(Next, std::memory_order_acq_rel);
+      }
+
+      // device thread side, returns true if a new object became active
+      bool Acquire()
+      {
+        if (!Pending_.load(std::memory_order_relaxed))
+          return false;
+
+        T* next = Pending_.exchange(nullptr, std::memory_order_acquire);
+        if (!next)
+          return false;
+
+        // only a Publish racing with the previous swap leaves one here to free
+        delete Retired_.exchange(Active_, std::memory_order_acq_rel);
+        Active_ = next;
+        return true;
+      }
+
+      // device thread side
+      T* Active() const { return Active_; }
+
+    private:
+      T* Active_;
+      std::atomic<T*> Pending_;
+      std::atomic<T*> Retired_;
+  };
+}
+
+#endif //_XBOX360_HANDOVER_
@@ -0,0 +1,142 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "XBOX360Haptics.hpp"
+
+static void HapticResample(const uint8_t* Samples, const size_t Count, const uint32_t SampleRateHz,
+                           std::vector<uint8_t>& Frames)
+{
+  if (!Samples)
+  {
+    std::fill(Frames.begin(), Frames.end(), 0);
+    return;
+  }
+
+  // samples per frame, above 1 every frame averages the samples it covers so
+  // short peaks still count, below 1 frames interpolate between two samples
+  double step = static_cast<double>(SampleRateHz) / HAPTIC_FRAME_HZ;
+  for (size_t f = 0; f < Frames.size(); f++)
+  {
+    double start = f * step;
+    size_t first = static_cast<size_t>(ceil(start));
+    size_t last = std::min(static_cast<size_t>(ceil(start + step)), Count);
+    if (step >= 1.0 && first < last)
+    {
+      uint32_t sum = 0;
+      for (size_t s = first; s < last; s++)
+        sum += Samples[s];
+      Frames[f] = static_cast<uint8_t>((sum + (last - first) / 2) / (last - first));
+    }
+    else
+    {
+      size_t s = std::min(static_cast<size_t>(start), Count - 1);
+      double fraction = start - s;
+      double next = (s + 1 < Count) ? Samples[s + 1] : Samples[s];
+      Frames[f] = static_cast<uint8_t>(lround(Samples[s] + (next - Samples[s]) * fraction));
+    }
+  }
+}
+
+static uint64_t HapticEnvelopeMS(const XKCTRL::HAPTIC_ENVELOPE& Envelope)
+{
+  return static_cast<uint64_t>(Envelope.ATTACK_MS) + Envelope.DECAY_MS + Envelope.SUSTAIN_MS + Envelope.RELEASE_MS;
+}
+
+static double HapticEnvelopeLevel(const XKCTRL::HAPTIC_ENVELOPE& Envelope, double TimeMS)
+{
+  double sustain = std::max(std::min(static_cast<double>(Envelope.SUSTAIN), 1.0), 0.0);
+  if (TimeMS < Envelope.ATTACK_MS)
+    return TimeMS / Envelope.ATTACK_MS;
+  TimeMS -= Envelope.ATTACK_MS;
+  if (TimeMS < Envelope.DECAY_MS)
+    return 1.0 - (1.0 - sustain) * TimeMS / Envelope.DECAY_MS;
+  TimeMS -= Envelope.DECAY_MS;
+  if (TimeMS < Envelope.SUSTAIN_MS)
+    return sustain;
+  TimeMS -= Envelope.SUSTAIN_MS;
+  if (TimeMS < Envelope.RELEASE_MS)
+    return sustain * (1.0 - TimeMS / Envelope.RELEASE_MS);
+  return 0.0;
+}
+
+static void HapticRender(const XKCTRL::HAPTIC_ENVELOPE& Envelope, uint32_t& Random, std::vector<uint8_t>& Frames)
+{
+  double frequency = std::max(std::min(static_cast<double>(Envelope.FREQUENCY_HZ), HAPTIC_FRAME_HZ / 2.0), 0.0);
+  size_t hold = (frequency > 0.0) ? std::max<size_t>(lround(HAPTIC_FRAME_HZ / frequency), 1) : 1;
+  double noise = 0.0;
+  for (size_t f = 0; f < Frames.size(); f++)
+  {
+    double time = f * 1000.0 / HAPTIC_FRAME_HZ;
+    double wave = 1.0;
+    if (Envelope.WAVE == XKCTRL::HAPTIC_SINE)
+    {
+      wave = 0.5 + 0.5 * sin(2.0 * M_PI * frequency * time / 1000.0);
+    }
+    else if (Envelope.WAVE == XKCTRL::HAPTIC_NOISE)
+    {
+      // xorshift32, a new level every hold frames
+      if (f % hold == 0)
+      {
+        Random ^= Random << 13;
+        Random ^= Random >> 17;
+        Random ^= Random << 5;
+        noise = (Random & 0xFFFF) / 65535.0;
+      }
+      wave = noise;
+    }
+    Frames[f] = static_cast<uint8_t>(lround(Envelope.LEVEL * HapticEnvelopeLevel(Envelope, time) * wave));
+  }
+}
+
+std::shared_ptr<const XKCTRL::HapticTrack> XKCTRL::HapticTrack::FromSamples(const uint8_t* Big, const uint8_t* Small,
+                                                                           const size_t Samples, const uint32_t SampleRateHz)
+{
+  if (!Samples || !SampleRateHz || (!Big && !Small) ||
+      Samples / SampleRateHz >= HAPTIC_MAX_MS / 1000)
+    return nullptr;
+
+  size_t frames = std::max<size_t>((Samples * HAPTIC_FRAME_HZ + SampleRateHz - 1) / SampleRateHz, 1);
+  std::shared_ptr<HapticTrack> track(new HapticTrack());
+  track->Big_.resize(frames);
+  track->Small_.resize(frames);
+  HapticResample(Big, Samples, SampleRateHz, track->Big_);
+  HapticResample(Small, Samples, SampleRateHz, track->Small_);
+  return track;
+}
+
+std::shared_ptr<const XKCTRL::HapticTrack> XKCTRL::HapticTrack::FromEnvelopes(const XKCTRL::HAPTIC_ENVELOPE& Big,
+                                                                             const XKCTRL::HAPTIC_ENVELOPE& Small,
+                                                                             const uint32_t Seed)
+{
+  uint64_t duration = std::max(HapticEnvelopeMS(Big), HapticEnvelopeMS(Small));
+  if (!duration || duration > HAPTIC_MAX_MS)
+    return nullptr;
+
+  size_t frames = (duration * HAPTIC_FRAME_HZ + 999) / 1000;
+  std::shared_ptr<HapticTrack> track(new HapticTrack());
+  track->Big_.resize(frames);
+  track->Small_.resize(frames);
+  uint32_t random = Seed ? Seed : 1;
+  HapticRender(Big, random, track->Big_);
+  HapticRender(Small, random, track->Small_);
+  return track;
+}
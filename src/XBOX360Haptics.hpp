@@ -0,0 +1,117 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_HAPTICS_
+#define _XBOX360_HAPTICS_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+// Rumble reports per second a controller is streamed. The receiver forwards
+// output reports over the wireless link in the controller's 8ms report slots,
+// anything faster only piles up in the receiver.
+#ifndef HAPTIC_FRAME_HZ
+#define HAPTIC_FRAME_HZ 125
+#endif
+
+// frames that may be sent back to back after the stream fell behind
+#define HAPTIC_BURST 2
+
+// longest track, samples and envelopes beyond it are rejected
+#define HAPTIC_MAX_MS 600000
+
+namespace XKCTRL
+{
+  enum HAPTIC_WAVE
+  {
+    HAPTIC_CONSTANT = 0x00,  // the envelope alone
+    HAPTIC_SINE = 0x01,      // envelope times a sine between 0 and 1
+    HAPTIC_NOISE = 0x02      // envelope times random levels
+  };
+
+  // Parametric effect for one motor. The weight rises to LEVEL in ATTACK_MS,
+  // falls to SUSTAIN * LEVEL in DECAY_MS, holds for SUSTAIN_MS and fades out
+  // in RELEASE_MS.
+  struct HAPTIC_ENVELOPE
+  {
+    HAPTIC_WAVE WAVE;
+    uint8_t LEVEL;
+    // sine frequency, or how often noise draws a new level (0 every frame).
+    // Limited to half of HAPTIC_FRAME_HZ, faster changes can not be streamed.
+    float FREQUENCY_HZ;
+    uint32_t ATTACK_MS;
+    uint32_t DECAY_MS;
+    float SUSTAIN;
+    uint32_t SUSTAIN_MS;
+    uint32_t RELEASE_MS;
+  };
+
+  inline HAPTIC_ENVELOPE DefaultHapticEnvelope()
+  {
+    return {HAPTIC_CONSTANT, 0, 0.0f, 0, 0, 1.0f, 0, 0};
+  }
+
+  struct HAPTIC_STATS
+  {
+    // a track is streaming right now
+    bool PLAYING;
+    // frames that came due since the controller was first played
+    uint64_t FRAMES;
+    // frames handed to the output queue
+    uint64_t QUEUED;
+    // frames equal to the previous one, nothing had to be sent
+    uint64_t UNCHANGED;
+    // frames never sent: skipped by a late timer, held back by the rate
+    // limit or replaced in the output queue before the endpoint was free
+    uint64_t DROPPED;
+    // frames sent more than half a frame after they were due
+    uint64_t LATE;
+  };
+
+  // Motor weights of an effect at HAPTIC_FRAME_HZ, immutable once built so
+  // one track can be played on any number of controllers at once.
+  class HapticTrack
+  {
+    public:
+      // Resamples buffers of Samples weights each taken at SampleRateHz, a
+      // buffer may be nullptr for a motor that stays off. Returns nullptr
+      // without samples, without a rate or if longer than HAPTIC_MAX_MS.
+      static std::shared_ptr<const HapticTrack> FromSamples(const uint8_t* Big, const uint8_t* Small,
+                                                            const size_t Samples, const uint32_t SampleRateHz);
+
+      // Renders an envelope per motor, the track lasts as long as the longer
+      // one. Seed picks the noise, the same seed gives the same track.
+      static std::shared_ptr<const HapticTrack> FromEnvelopes(const HAPTIC_ENVELOPE& Big, const HAPTIC_ENVELOPE& Small,
+                                                              const uint32_t Seed = 1);
+
+      size_t Frames() const { return Big_.size(); }
+      uint32_t DurationMS() const { return static_cast<uint32_t>(Big_.size() * 1000 / HAPTIC_FRAME_HZ); }
+      uint8_t Big(const size_t Frame) const { return Big_[Frame]; }
+      uint8_t Small(const size_t Frame) const { return Small_[Frame]; }
+
+    private:
+      HapticTrack() {}
+      std::vector<uint8_t> Big_;
+      std::vector<uint8_t> Small_;
+  };
+}
+
+#endif //_XBOX360_HAPTICS_
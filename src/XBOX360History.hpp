@@ -0,0 +1,201 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_HISTORY_
+#define _XBOX360_HISTORY_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+#include "XBOX360Defines.hpp"
+#include "XBOX360SeqLock.hpp"
+
+namespace XKCTRL
+{
+  // Bounded history of controller state changes with timestamps, oldest
+  // entries are overwritten. A state equal to the newest entry is not kept,
+  // an entry holds until the next one. Storage is fixed at compile time. Every slot has its own
+  // seqlock, so the single writer never waits for readers and readers can
+  // binary search by time while the writer keeps going.
+  template <size_t CAPACITY>
+  class StateHistory
+  {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "StateHistory capacity must be a power of 2");
+
+    public:
+      StateHistory()
+        : Head_(0)
+      {
+      }
+
+      // writer side, timestamps must not go backwards. Returns false if
+      // State equals the newest entry and was not added.
+      bool Push(const uint64_t TimestampNS, const CONTROLLER_PACKED_STATE& State)
+      {
+        uint64_t head = Head_.load(std::memory_order_relaxed);
+        if (head && memcmp(&State, &Last_, sizeof(CONTROLLER_PACKED_STATE)) == 0)
+          return false;
+        Last_ = State;
+
+        HistorySlot slot;
+        slot.INDEX = head;
+        slot.ENTRY.TIMESTAMP_NS = TimestampNS;
+        slot.ENTRY.STATE = State;
+        Slots_[head & (CAPACITY - 1)].Store(slot);
+        Head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      // State as of TimestampNS, i.e. the last entry at or before it. With
+      // Interpolate the analog values are blended linearly towards the next
+      // entry. Returns false if there is no entry that old, State then holds
+      // the oldest entry still available (or is cleared if there is none).
+      bool StateAt(const uint64_t TimestampNS, const bool Interpolate, CONTROLLER_PACKED_STATE& State) const
+      {
+        CONTROLLER_HISTORY_ENTRY before, after;
+        uint64_t index = Find(TimestampNS, before, after);
+        if (index == NOT_FOUND)
+        {
+          State = after.STATE;
+          return false;
+        }
+
+        State = before.STATE;
+        if (Interpolate && after.TIMESTAMP_NS > before.TIMESTAMP_NS &&
+            before.STATE.CONNECTED() && after.STATE.CONNECTED())
+        {
+          float fraction = static_cast<float>(TimestampNS - before.TIMESTAMP_NS) /
+                           static_cast<float>(after.TIMESTAMP_NS - before.TIMESTAMP_NS);
+          State.LTRIG = Blend(before.STATE.LTRIG, after.STATE.LTRIG, fraction);
+          State.RTRIG = Blend(before.STATE.RTRIG, after.STATE.RTRIG, fraction);
+          State.LSTICK_X = Blend(before.STATE.LSTICK_X, after.STATE.LSTICK_X, fraction);
+          State.LSTICK_Y = Blend(before.STATE.LSTICK_Y, after.STATE.LSTICK_Y, fraction);
+          State.RSTICK_X = Blend(before.STATE.RSTICK_X, after.STATE.RSTICK_X, fraction);
+          State.RSTICK_Y = Blend(before.STATE.RSTICK_Y, after.STATE.RSTICK_Y, fraction);
+        }
+        return true;
+      }
+
+      // Entries newer than TimestampNS, oldest first. Copies at most MaxEntries,
+      // pass the last timestamp returned to continue where this call stopped.
+      size_t Since(const uint64_t TimestampNS, CONTROLLER_HISTORY_ENTRY* Entries, const size_t MaxEntries) const
+      {
+        CONTROLLER_HISTORY_ENTRY before, after;
+        uint64_t index = Find(TimestampNS, before, after);
+        uint64_t next = (index == NOT_FOUND) ? Oldest() : index + 1;
+        uint64_t head = Head_.load(std::memory_order_acquire);
+
+        size_t count = 0;
+        for (; next < head && count < MaxEntries; next++)
+        {
+          // entries overwritten while copying are skipped
+          if (Read(next, Entries[count]) && Entries[count].TIMESTAMP_NS > TimestampNS)
+            count++;
+        }
+        return count;
+      }
+
+    private:
+      static constexpr uint64_t NOT_FOUND = ~0ULL;
+
+      struct HistorySlot
+      {
+        uint64_t INDEX;
+        CONTROLLER_HISTORY_ENTRY ENTRY;
+      };
+
+      std::atomic<uint64_t> Head_;
+      SeqLock<HistorySlot> Slots_[CAPACITY];
+      // newest entry, only used by the writer
+      CONTROLLER_PACKED_STATE Last_;
+
+      uint64_t Oldest() const
+      {
+        uint64_t head = Head_.load(std::memory_order_acquire);
+        return (head > CAPACITY) ? head - CAPACITY : 0;
+      }
+
+      // false if the entry was not written yet or was already overwritten
+      bool Read(const uint64_t Index, CONTROLLER_HISTORY_ENTRY& Entry) const
+      {
+        HistorySlot slot;
+        Slots_[Index & (CAPACITY - 1)].Load(slot);
+        if (slot.INDEX != Index || Index >= Head_.load(std::memory_order_acquire))
+          return false;
+        Entry = slot.ENTRY;
+        return true;
+      }
+
+      // index of the last entry at or before TimestampNS, Before holds that
+      // entry and After the one following it (or the newest entry)
+      uint64_t Find(const uint64_t TimestampNS, CONTROLLER_HISTORY_ENTRY& Before, CONTROLLER_HISTORY_ENTRY& After) const
+      {
+        memset(&Before, 0x00, sizeof(CONTROLLER_HISTORY_ENTRY));
+        memset(&After, 0x00, sizeof(CONTROLLER_HISTORY_ENTRY));
+
+        uint64_t head = Head_.load(std::memory_order_acquire);
+        if (head == 0 || !Read(head - 1, After))
+          return NOT_FOUND;
+
+        // the newest entry answers most queries
+        if (After.TIMESTAMP_NS <= TimestampNS)
+        {
+          Before = After;
+          return head - 1;
+        }
+
+        // search [low, high) knowing entry high is newer than TimestampNS
+        uint64_t low = (head > CAPACITY) ? head - CAPACITY : 0;
+        uint64_t high = head - 1;
+        uint64_t found = NOT_FOUND;
+        while (low < high)
+        {
+          uint64_t mid = low + (high - low) / 2;
+          CONTROLLER_HISTORY_ENTRY entry;
+          if (!Read(mid, entry))
+          {
+            // overwritten while searching, it was too old anyway
+            low = mid + 1;
+          }
+          else if (entry.TIMESTAMP_NS <= TimestampNS)
+          {
+            found = mid;
+            Before = entry;
+            low = mid + 1;
+          }
+          else
+          {
+            After = entry;
+            high = mid;
+          }
+        }
+        return found;
+      }
+
+      template <typename T>
+      static T Blend(const T From, const T To, const float Fraction)
+      {
+        return static_cast<T>(From + (static_cast<float>(To) - static_cast<float>(From)) * Fraction);
+      }
+  };
+}
+
+#endif //_XBOX360_HISTORY_
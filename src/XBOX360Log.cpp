@@ -0,0 +1,208 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "XBOX360Log.hpp"
+
+namespace
+{
+  // Bounded multi producer, multi consumer ring. Every slot carries a
+  // sequence number telling whether it is free for the writer at that
+  // position or holds an entry for the reader at that position.
+  class LogRing
+  {
+    static_assert((LOG_CAPACITY & (LOG_CAPACITY - 1)) == 0, "LOG_CAPACITY must be a power of 2");
+
+    public:
+      LogRing()
+        : Head_(0), Tail_(0), Dropped_(0)
+      {
+        for (uint64_t i = 0; i < LOG_CAPACITY; i++)
+          Slots_[i].Sequence.store(i, std::memory_order_relaxed);
+      }
+
+      void Write(const XKCTRL::LOG_LEVEL Level, const char* Format, va_list Args)
+      {
+        uint64_t pos = Head_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true)
+        {
+          slot = &Slots_[pos & (LOG_CAPACITY - 1)];
+          int64_t diff = static_cast<int64_t>(slot->Sequence.load(std::memory_order_acquire) - pos);
+          if (diff == 0 && Head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+          if (diff < 0)
+          {
+            // full, the reader has not caught up
+            Dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+          if (diff > 0)
+            pos = Head_.load(std::memory_order_relaxed);
+        }
+
+        slot->Entry.TIMESTAMP_NS = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch()).count();
+        slot->Entry.LEVEL = Level;
+        vsnprintf(slot->Entry.MESSAGE, LOG_MESSAGE_SIZE, Format, Args);
+        slot->Sequence.store(pos + 1, std::memory_order_release);
+      }
+
+      size_t Read(XKCTRL::LOG_ENTRY* Entries, const size_t MaxEntries, uint64_t& Dropped)
+      {
+        size_t count = 0;
+        uint64_t pos = Tail_.load(std::memory_order_relaxed);
+        while (count < MaxEntries)
+        {
+          Slot* slot = &Slots_[pos & (LOG_CAPACITY - 1)];
+          int64_t diff = static_cast<int64_t>(slot->Sequence.load(std::memory_order_acquire) - (pos + 1));
+          if (diff < 0)
+            break;
+          if (diff > 0 || !Tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            // another reader took it
+            pos = Tail_.load(std::memory_order_relaxed);
+            continue;
+          }
+
+          Entries[count++] = slot->Entry;
+          slot->Sequence.store(pos + LOG_CAPACITY, std::memory_order_release);
+          pos++;
+        }
+
+        Dropped = Dropped_.exchange(0, std::memory_order_relaxed);
+        return count;
+      }
+
+    private:
+      struct Slot
+      {
+        std::atomic<uint64_t> Sequence;
+        XKCTRL::LOG_ENTRY Entry;
+      };
+
+      alignas(64) std::atomic<uint64_t> Head_;
+      alignas(64) std::atomic<uint64_t> Tail_;
+      std::atomic<uint64_t> Dropped_;
+      alignas(64) Slot Slots_[LOG_CAPACITY];
+  };
+
+  LogRing& Log()
+  {
+    // built on first use, static storage so it never allocates
+    static LogRing ring;
+    return ring;
+  }
+
+  struct LogPrinter
+  {
+    // starting and stopping, held until the thread is up or joined
+    std::mutex Control;
+    std::mutex Mutex;
+    std::condition_variable Wake;
+    std::thread Thread;
+    int32_t References = 0;
+    bool Stopping = false;
+  };
+
+  LogPrinter& Printer()
+  {
+    static LogPrinter printer;
+    return printer;
+  }
+
+  void LogPrint()
+  {
+    XKCTRL::LOG_ENTRY entries[16];
+    uint64_t dropped;
+    size_t count;
+    do
+    {
+      count = Log().Read(entries, 16, dropped);
+      if (dropped)
+        fprintf(stderr, "WARNING: %llu log messages dropped\n", static_cast<unsigned long long>(dropped));
+      for (size_t i = 0; i < count; i++)
+        fprintf(stderr, "%s\n", entries[i].MESSAGE);
+    } while (count == 16);
+  }
+
+  void LogPrinterThread()
+  {
+    // diagnostics are never urgent, a few prints a second keep stderr off the hot path
+    LogPrinter& printer = Printer();
+    std::unique_lock<std::mutex> lock(printer.Mutex);
+    while (!printer.Stopping)
+    {
+      printer.Wake.wait_for(lock, std::chrono::milliseconds(100));
+      lock.unlock();
+      LogPrint();
+      lock.lock();
+    }
+  }
+}
+
+void XKCTRL::LogWrite(const XKCTRL::LOG_LEVEL Level, const char* Format, ...)
+{
+  va_list args;
+  va_start(args, Format);
+  Log().Write(Level, Format, args);
+  va_end(args);
+}
+
+size_t XKCTRL::LogRead(XKCTRL::LOG_ENTRY* Entries, const size_t MaxEntries, uint64_t& Dropped)
+{
+  return Log().Read(Entries, MaxEntries, Dropped);
+}
+
+void XKCTRL::LogPrinterStart()
+{
+  LogPrinter& printer = Printer();
+  std::lock_guard<std::mutex> control(printer.Control);
+  if (printer.References++ == 0)
+  {
+    printer.Stopping = false;
+    printer.Thread = std::thread(&LogPrinterThread);
+  }
+}
+
+void XKCTRL::LogPrinterStop()
+{
+  LogPrinter& printer = Printer();
+  std::lock_guard<std::mutex> control(printer.Control);
+  if (printer.References == 0 || --printer.References > 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(printer.Mutex);
+    printer.Stopping = true;
+  }
+  printer.Wake.notify_all();
+  printer.Thread.join();
+
+  // whatever came in after the last pass
+  LogPrint();
+}
@@ -0,0 +1,72 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#ifndef _XBOX360_LOG_
+#define _XBOX360_LOG_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Diagnostics of the library go to a fixed size ring instead of stderr, so
+// the device thread never allocates or blocks on a slow pipe to report them.
+// By default a background thread prints the ring to stderr while any XBOX360
+// exists. Build with -DXBOX360_NO_LOG_PRINTER to drain it with LogRead.
+#ifndef XBOX360_NO_LOG_PRINTER
+#define XBOX360_LOG_PRINTER 1
+#else
+#define XBOX360_LOG_PRINTER 0
+#endif
+
+// entries the ring holds, messages logged while it is full are dropped
+#define LOG_CAPACITY 256
+// longest message including the terminating zero, longer ones are cut
+#define LOG_MESSAGE_SIZE 112
+
+namespace XKCTRL
+{
+  enum LOG_LEVEL
+  {
+    LOG_INFO = 0x00,
+    LOG_WARNING = 0x01,
+    LOG_ERROR = 0x02
+  };
+
+  struct LOG_ENTRY
+  {
+    // steady clock time the message was logged, in nanoseconds
+    uint64_t TIMESTAMP_NS;
+    uint8_t LEVEL;
+    char MESSAGE[LOG_MESSAGE_SIZE];
+  };
+
+  // printf style, safe from any thread. Never allocates, locks or blocks.
+  void LogWrite(const LOG_LEVEL Level, const char* Format, ...) __attribute__((format(printf, 2, 3)));
+
+  // oldest entries first, copies up to MaxEntries and returns how many were
+  // read. Dropped is set to the messages lost to a full ring since the last read.
+  size_t LogRead(LOG_ENTRY* Entries, const size_t MaxEntries, uint64_t& Dropped);
+
+  // Background thread printing the ring to stderr, reference counted so any
+  // number of XBOX360 instances share one. Stopping prints what is left.
+  void LogPrinterStart();
+  void LogPrinterStop();
+}
+
+#endif //_XBOX360_LOG_
@@ -0,0 +1,189 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <alloca.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "XBOX360Realtime.hpp"
+
+static uint64_t RealtimeNow()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+// same buckets as StatsHistogram, but independent of XBOX360_STATS
+static void RealtimeRecord(XKCTRL::HISTOGRAM& Histogram, const uint64_t Value)
+{
+  int32_t bucket = (Value == 0) ? 0 : 64 - __builtin_clzll(Value);
+  Histogram.BUCKETS[std::min(bucket, STATS_HISTOGRAM_BUCKETS - 1)]++;
+  Histogram.COUNT++;
+  Histogram.SUM += Value;
+  Histogram.MAX = std::max(Histogram.MAX, Value);
+}
+
+static void __attribute__((noinline)) RealtimeStack(const uint32_t KB)
+{
+  // grow the stack once while nothing depends on it being fast
+  volatile uint8_t* stack = static_cast<volatile uint8_t*>(alloca(KB * 1024));
+  for (uint32_t i = 0; i < KB * 1024; i += 4096)
+    stack[i] = 0;
+}
+
+bool XKCTRL::RealtimeApply(const XKCTRL::REALTIME_CONFIG& Config, XKCTRL::REALTIME_STATUS& Status)
+{
+  Status = {REALTIME_OFF, 0, false, false, false, 0, 0, 0};
+
+  if (Config.POLICY != REALTIME_OFF)
+  {
+    int policy = (Config.POLICY == REALTIME_RR) ? SCHED_RR : SCHED_FIFO;
+    sched_param param;
+    memset(&param, 0x00, sizeof(param));
+    param.sched_priority = std::max(std::min(Config.PRIORITY, sched_get_priority_max(policy)), sched_get_priority_min(policy));
+    // usually EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO, the thread keeps its priority then
+    Status.SCHEDULING_ERROR = pthread_setschedparam(pthread_self(), policy, &param);
+    if (Status.SCHEDULING_ERROR == 0)
+    {
+      Status.POLICY = Config.POLICY;
+      Status.PRIORITY = param.sched_priority;
+    }
+  }
+
+  if (Config.CPU_MASK)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int32_t cpu = 0; cpu < 64; cpu++)
+    {
+      if (Config.CPU_MASK & (1ULL << cpu))
+        CPU_SET(cpu, &cpus);
+    }
+    Status.AFFINITY_ERROR = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    Status.PINNED = (Status.AFFINITY_ERROR == 0);
+  }
+
+  if (Config.LOCK_MEMORY)
+  {
+    // usually ENOMEM or EPERM when RLIMIT_MEMLOCK is too small
+    Status.MEMORY_ERROR = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) ? 0 : errno;
+    Status.MEMORY_LOCKED = (Status.MEMORY_ERROR == 0);
+  }
+
+  if (Config.PREFAULT_STACK_KB)
+  {
+    RealtimeStack(Config.PREFAULT_STACK_KB);
+    Status.PREFAULTED = true;
+  }
+
+  return Status.SCHEDULING_ERROR == 0 && Status.AFFINITY_ERROR == 0 && Status.MEMORY_ERROR == 0;
+}
+
+void XKCTRL::RealtimePrefault(const void* Buffer, const size_t Length)
+{
+  if (!Buffer || !Length)
+    return;
+
+  uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  uintptr_t first = reinterpret_cast<uintptr_t>(Buffer) & ~(page - 1);
+  uintptr_t last = reinterpret_cast<uintptr_t>(Buffer) + Length;
+#ifdef MADV_POPULATE_WRITE
+  // maps writable pages without touching the contents, other threads may already use them
+  if (madvise(reinterpret_cast<void*>(first), last - first, MADV_POPULATE_WRITE) == 0)
+    return;
+#endif
+  // older kernels, reading at least maps the pages that already hold data
+  for (uintptr_t address = first; address < last; address += page)
+    (void)*reinterpret_cast<const volatile uint8_t*>(std::max(address, reinterpret_cast<uintptr_t>(Buffer)));
+}
+
+void XKCTRL::RealtimeProbe(const XKCTRL::REALTIME_CONFIG& Config, const uint32_t DurationMS, const uint32_t PeriodUS, XKCTRL::REALTIME_PROBE& Probe)
+{
+  memset(&Probe, 0x00, sizeof(Probe));
+
+  int event = eventfd(0, EFD_CLOEXEC);
+  if (event < 0)
+    return;
+
+  // the probe thread arms before it blocks, the signaller waits for that so
+  // only the wakeup itself is measured
+  std::atomic<bool> running(true);
+  std::atomic<bool> armed(false);
+  std::atomic<uint64_t> signalled(0);
+  const uint64_t period = std::max<uint32_t>(PeriodUS, 50) * 1000ULL;
+
+  std::thread signaller([&]()
+  {
+    while (running)
+    {
+      if (!armed.load(std::memory_order_acquire))
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+        continue;
+      }
+      std::this_thread::sleep_for(std::chrono::nanoseconds(period / 2));
+      armed.store(false, std::memory_order_relaxed);
+      signalled.store(RealtimeNow(), std::memory_order_release);
+      uint64_t value = 1;
+      if (write(event, &value, sizeof(value)) < 0)
+        break;
+    }
+  });
+
+  std::thread probe([&]()
+  {
+    RealtimeApply(Config, Probe.STATUS);
+
+    uint64_t end = RealtimeNow() + DurationMS * 1000000ULL;
+    while (RealtimeNow() < end)
+    {
+      uint64_t target = RealtimeNow() + period;
+      timespec due = {static_cast<time_t>(target / 1000000000ULL), static_cast<long>(target % 1000000000ULL)};
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR)
+        ;
+      RealtimeRecord(Probe.WAKEUP_NS, RealtimeNow() - target);
+
+      pollfd fd = {event, POLLIN, 0};
+      armed.store(true, std::memory_order_release);
+      if (poll(&fd, 1, 100) > 0)
+      {
+        uint64_t woken = RealtimeNow();
+        uint64_t value;
+        if (read(event, &value, sizeof(value)) == sizeof(value))
+          RealtimeRecord(Probe.DISPATCH_NS, woken - signalled.load(std::memory_order_acquire));
+      }
+    }
+  });
+
+  probe.join();
+  running = false;
+  signaller.join();
+  close(event);
+}
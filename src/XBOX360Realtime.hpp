@@ -0,0 +1,94 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_REALTIME_
+#define _XBOX360_REALTIME_
+
+#include <stdint.h>
+
+#include "XBOX360Stats.hpp"
+
+namespace XKCTRL
+{
+  enum REALTIME_POLICY
+  {
+    REALTIME_OFF = 0x00,    // default scheduling, nothing is changed
+    REALTIME_FIFO = 0x01,   // SCHED_FIFO, runs until it blocks
+    REALTIME_RR = 0x02      // SCHED_RR, time sliced with equal priorities
+  };
+
+  // How the USB device thread runs. Every part is optional and applied on
+  // its own, whatever the process is not allowed to do is left as it was
+  // and reported in REALTIME_STATUS.
+  struct REALTIME_CONFIG
+  {
+    REALTIME_POLICY POLICY;
+    // 1-99 for FIFO and RR, keep it below kernel threads such as the USB irq threads
+    int32_t PRIORITY;
+    // CPUs the thread may run on, bit n is CPU n, 0 leaves the affinity alone
+    uint64_t CPU_MASK;
+    // mlockall the whole process, current and future pages
+    bool LOCK_MEMORY;
+    // stack touched up front, plus the controller buffers, so the first
+    // reports do not take page faults
+    uint32_t PREFAULT_STACK_KB;
+  };
+
+  inline REALTIME_CONFIG DefaultRealtimeConfig()
+  {
+    return {REALTIME_OFF, 0, 0, false, 0};
+  }
+
+  // What was achieved, errors are errno values of the failed call, 0 on
+  // success or when the part was not asked for
+  struct REALTIME_STATUS
+  {
+    REALTIME_POLICY POLICY;
+    int32_t PRIORITY;
+    bool PINNED;
+    bool MEMORY_LOCKED;
+    bool PREFAULTED;
+    int32_t SCHEDULING_ERROR;
+    int32_t AFFINITY_ERROR;
+    int32_t MEMORY_ERROR;
+  };
+
+  struct REALTIME_PROBE
+  {
+    REALTIME_STATUS STATUS;
+    // lateness of periodic absolute timer wakeups
+    HISTOGRAM WAKEUP_NS;
+    // from another thread signalling an eventfd to the probe thread running
+    HISTOGRAM DISPATCH_NS;
+  };
+
+  // Applies a configuration to the calling thread, LOCK_MEMORY to the whole
+  // process. Returns true if everything asked for was applied.
+  bool RealtimeApply(const REALTIME_CONFIG& Config, REALTIME_STATUS& Status);
+
+  // Touches every page of a buffer, without changing its contents
+  void RealtimePrefault(const void* Buffer, const size_t Length);
+
+  // Runs a probe thread with the given configuration for DurationMS. It
+  // alternates timer wakeups every PeriodUS with wakeups by a signalling
+  // thread, the two ways the USB device thread is woken.
+  void RealtimeProbe(const REALTIME_CONFIG& Config, const uint32_t DurationMS, const uint32_t PeriodUS, REALTIME_PROBE& Probe);
+}
+
+#endif //_XBOX360_REALTIME_
@@ -0,0 +1,335 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_REPORT_
+#define _XBOX360_REPORT_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <array>
+#include <utility>
+
+#include "XBOX360Defines.hpp"
+#include "XBOX360Decode.hpp"
+
+namespace XKCTRL
+{
+  // Reports a wireless receiver sends per controller slot
+  enum REPORT_TYPE
+  {
+    REPORT_UNKNOWN = 0x00,
+    REPORT_LINK = 0x01,       // controller or headset came or went
+    REPORT_INPUT = 0x02,      // buttons and axes
+    REPORT_ANNOUNCE = 0x03,   // sent once after connecting, serial and battery
+    REPORT_BATTERY = 0x04,    // battery level changed
+    REPORT_CHATPAD = 0x05,    // chatpad keys or chatpad status
+    REPORT_TYPES = 0x06
+  };
+
+  struct LINK_STATE
+  {
+    // 0x80 controller, 0x40 headset, both or none
+    uint8_t STATUS;
+
+    bool CONTROLLER() const { return (STATUS & 0x80) != 0; }
+    bool HEADSET() const    { return (STATUS & 0x40) != 0; }
+  };
+
+  struct ANNOUNCE_STATE
+  {
+    uint8_t SERIAL[7];
+    uint8_t BATTERY;
+  };
+
+  struct BATTERY_STATE
+  {
+    // raw level as reported, higher is fuller
+    uint8_t LEVEL;
+  };
+
+  struct CHATPAD_STATE
+  {
+    // 0x00 for key reports, anything else is a chatpad status report
+    uint8_t STATUS;
+    // shift, green, orange and people modifier bits
+    uint8_t MODIFIERS;
+    // scan codes of up to two held keys, 0 for none
+    uint8_t KEYS[2];
+  };
+
+  // One parsed report, TYPE tells which member is valid
+  struct RECEIVER_REPORT
+  {
+    REPORT_TYPE TYPE;
+    union
+    {
+      CONTROLLER_PACKED_STATE INPUT;
+      LINK_STATE LINK;
+      ANNOUNCE_STATE ANNOUNCE;
+      BATTERY_STATE BATTERY;
+      CHATPAD_STATE CHATPAD;
+    };
+  };
+
+  // Everything known about a controller besides its input state, the valid
+  // flags are cleared when the controller disconnects
+  struct CONTROLLER_INFO
+  {
+    LINK_STATE LINK;
+    bool SERIAL_VALID;
+    uint8_t SERIAL[7];
+    bool BATTERY_VALID;
+    uint8_t BATTERY;
+    bool CHATPAD_VALID;
+    CHATPAD_STATE CHATPAD;
+    // time of the report that last changed any of the above
+    uint64_t TIMESTAMP_NS;
+  };
+
+  // A byte the report must have to be of a type, (byte & MASK) == VALUE
+  struct REPORT_SIGNATURE
+  {
+    uint8_t OFFSET;
+    uint8_t MASK;
+    uint8_t VALUE;
+  };
+
+  // SIZE bytes at OFFSET in the report, copied to TARGET in the decoded state
+  struct REPORT_FIELD
+  {
+    uint8_t OFFSET;
+    uint8_t SIZE;
+    uint8_t TARGET;
+  };
+
+  // Layout of each report type, one specialization per type. Fields are
+  // little endian like the host, copies never care about alignment.
+  template <REPORT_TYPE Type> struct ReportFormat;
+
+  template <> struct ReportFormat<REPORT_LINK>
+  {
+    typedef LINK_STATE Target;
+    static constexpr REPORT_SIGNATURE SIGNATURE[] = {{0, 0xFF, 0x08}};
+    static constexpr REPORT_FIELD FIELDS[] = {{1, 1, offsetof(LINK_STATE, STATUS)}};
+    static Target& Member(RECEIVER_REPORT& Report) { return Report.LINK; }
+    static void Finish(Target&) {}
+  };
+
+  template <> struct ReportFormat<REPORT_INPUT>
+  {
+    typedef CONTROLLER_PACKED_STATE Target;
+    static constexpr REPORT_SIGNATURE SIGNATURE[] = {{0, 0xFF, 0x00}, {1, 0xFF, 0x01}, {3, 0xFF, 0xF0}, {5, 0xFF, 0x13}};
+    static constexpr REPORT_FIELD FIELDS[] =
+    {
+      {REPORT_LAYOUT_OFFSET + 0, 2, offsetof(CONTROLLER_PACKED_STATE, BUTTONS)},
+      {REPORT_LAYOUT_OFFSET + 2, 1, offsetof(CONTROLLER_PACKED_STATE, LTRIG)},
+      {REPORT_LAYOUT_OFFSET + 3, 1, offsetof(CONTROLLER_PACKED_STATE, RTRIG)},
+      {REPORT_LAYOUT_OFFSET + 4, 2, offsetof(CONTROLLER_PACKED_STATE, LSTICK_X)},
+      {REPORT_LAYOUT_OFFSET + 6, 2, offsetof(CONTROLLER_PACKED_STATE, LSTICK_Y)},
+      {REPORT_LAYOUT_OFFSET + 8, 2, offsetof(CONTROLLER_PACKED_STATE, RSTICK_X)},
+      {REPORT_LAYOUT_OFFSET + 10, 2, offsetof(CONTROLLER_PACKED_STATE, RSTICK_Y)}
+    };
+    static Target& Member(RECEIVER_REPORT& Report) { return Report.INPUT; }
+    // a controller sending input is connected
+    static void Finish(Target& State) { State.BUTTONS = (State.BUTTONS & MASK_ALL_BUTTONS) | MASK_CONNECTED; }
+  };
+
+  template <> struct ReportFormat<REPORT_ANNOUNCE>
+  {
+    typedef ANNOUNCE_STATE Target;
+    static constexpr REPORT_SIGNATURE SIGNATURE[] = {{0, 0xFF, 0x00}, {1, 0xFF, 0x0F}, {2, 0xFF, 0x00}, {3, 0xFF, 0xF0}};
+    static constexpr REPORT_FIELD FIELDS[] = {{7, 7, offsetof(ANNOUNCE_STATE, SERIAL)}, {17, 1, offsetof(ANNOUNCE_STATE, BATTERY)}};
+    static Target& Member(RECEIVER_REPORT& Report) { return Report.ANNOUNCE; }
+    static void Finish(Target&) {}
+  };
+
+  template <> struct ReportFormat<REPORT_BATTERY>
+  {
+    typedef BATTERY_STATE Target;
+    static constexpr REPORT_SIGNATURE SIGNATURE[] = {{0, 0xFF, 0x00}, {1, 0xFF, 0x00}, {2, 0xFF, 0x00}, {3, 0xFF, 0x13}};
+    static constexpr REPORT_FIELD FIELDS[] = {{4, 1, offsetof(BATTERY_STATE, LEVEL)}};
+    static Target& Member(RECEIVER_REPORT& Report) { return Report.BATTERY; }
+    static void Finish(Target&) {}
+  };
+
+  template <> struct ReportFormat<REPORT_CHATPAD>
+  {
+    typedef CHATPAD_STATE Target;
+    static constexpr REPORT_SIGNATURE SIGNATURE[] = {{0, 0xFF, 0x00}, {1, 0xFF, 0x02}, {3, 0xFF, 0xF0}};
+    static constexpr REPORT_FIELD FIELDS[] = {{24, 1, offsetof(CHATPAD_STATE, STATUS)}, {25, 1, offsetof(CHATPAD_STATE, MODIFIERS)},
+                                              {26, 2, offsetof(CHATPAD_STATE, KEYS)}};
+    static Target& Member(RECEIVER_REPORT& Report) { return Report.CHATPAD; }
+    static void Finish(Target&) {}
+  };
+
+  // Shortest report that holds every byte a format looks at
+  template <typename Format>
+  constexpr size_t ReportLength()
+  {
+    size_t length = 0;
+    for (const REPORT_SIGNATURE& signature : Format::SIGNATURE)
+      length = (signature.OFFSET + 1u > length) ? signature.OFFSET + 1u : length;
+    for (const REPORT_FIELD& field : Format::FIELDS)
+      length = (field.OFFSET + field.SIZE > length) ? field.OFFSET + field.SIZE : length;
+    return length;
+  }
+
+  template <typename Format>
+  constexpr bool ReportFieldsFit()
+  {
+    for (const REPORT_FIELD& field : Format::FIELDS)
+    {
+      if (field.TARGET + field.SIZE > sizeof(typename Format::Target))
+        return false;
+    }
+    return true;
+  }
+
+  // Fields that are one run of bytes filling the whole target in order,
+  // decoded with a single copy and nothing to clear
+  template <typename Format>
+  constexpr bool ReportContiguous()
+  {
+    size_t offset = Format::FIELDS[0].OFFSET;
+    size_t target = 0;
+    for (const REPORT_FIELD& field : Format::FIELDS)
+    {
+      if (field.OFFSET != offset || field.TARGET != target)
+        return false;
+      offset += field.SIZE;
+      target += field.SIZE;
+    }
+    return target == sizeof(typename Format::Target);
+  }
+
+  // Signatures within the first 8 bytes of a report of at least 8 bytes,
+  // checked with one load and compare. Reports are little endian like the host.
+  template <typename Format>
+  constexpr bool ReportWordMatch()
+  {
+    if (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__ || ReportLength<Format>() < 8)
+      return false;
+    for (const REPORT_SIGNATURE& signature : Format::SIGNATURE)
+    {
+      if (signature.OFFSET >= 8)
+        return false;
+    }
+    return true;
+  }
+
+  template <typename Format>
+  constexpr uint64_t ReportWord(const bool Mask)
+  {
+    uint64_t word = 0;
+    for (const REPORT_SIGNATURE& signature : Format::SIGNATURE)
+      word |= static_cast<uint64_t>(Mask ? signature.MASK : signature.VALUE) << (8 * signature.OFFSET);
+    return word;
+  }
+
+  // The tables are walked at compile time, every check and copy ends up
+  // with constant offsets and sizes so the compiler merges them
+  template <typename Format, size_t... I>
+  inline bool ReportMatch(const uint8_t* Report, std::index_sequence<I...>)
+  {
+    if constexpr (ReportWordMatch<Format>())
+    {
+      uint64_t word;
+      memcpy(&word, Report, sizeof(word));
+      return (word & ReportWord<Format>(true)) == ReportWord<Format>(false);
+    }
+    else
+    {
+      return (((Report[Format::SIGNATURE[I].OFFSET] & Format::SIGNATURE[I].MASK) == Format::SIGNATURE[I].VALUE) && ...);
+    }
+  }
+
+  template <typename Format, size_t... I>
+  inline void ReportCopy(const uint8_t* Report, uint8_t* Out, std::index_sequence<I...>)
+  {
+    (memcpy(Out + Format::FIELDS[I].TARGET, Report + Format::FIELDS[I].OFFSET, Format::FIELDS[I].SIZE), ...);
+  }
+
+  template <REPORT_TYPE Type>
+  inline REPORT_TYPE ReportDecode(const uint8_t* Report, const size_t Length, RECEIVER_REPORT& Parsed)
+  {
+    typedef ReportFormat<Type> Format;
+    static_assert(ReportLength<Format>() <= MAX_USB_INBUFF, "report format reaches past a full report");
+    static_assert(ReportFieldsFit<Format>(), "report field reaches past its decoded state");
+
+    if (Length < ReportLength<Format>() ||
+        !ReportMatch<Format>(Report, std::make_index_sequence<sizeof(Format::SIGNATURE) / sizeof(REPORT_SIGNATURE)>()))
+      return REPORT_UNKNOWN;
+
+    typename Format::Target& target = Format::Member(Parsed);
+    if constexpr (ReportContiguous<Format>())
+    {
+      memcpy(&target, Report + Format::FIELDS[0].OFFSET, sizeof(target));
+    }
+    else
+    {
+      memset(&target, 0x00, sizeof(target));
+      ReportCopy<Format>(Report, reinterpret_cast<uint8_t*>(&target),
+                         std::make_index_sequence<sizeof(Format::FIELDS) / sizeof(REPORT_FIELD)>());
+    }
+    Format::Finish(target);
+    return Type;
+  }
+
+  // Candidate type of a data report by its second byte, the signature
+  // decides if it really is one
+  constexpr std::array<uint8_t, 256> ReportKinds()
+  {
+    std::array<uint8_t, 256> kinds = {};
+    kinds[0x00] = REPORT_BATTERY;
+    kinds[0x01] = REPORT_INPUT;
+    kinds[0x02] = REPORT_CHATPAD;
+    kinds[0x0F] = REPORT_ANNOUNCE;
+    return kinds;
+  }
+  constexpr std::array<uint8_t, 256> REPORT_KINDS = ReportKinds();
+
+  // Parses one report of Length bytes, Length may be anything from 0 to a
+  // full report. Never reads past Length, returns the type also set in Parsed.
+  inline REPORT_TYPE ParseReport(const uint8_t* Report, const size_t Length, RECEIVER_REPORT& Parsed)
+  {
+    // input is nearly every report under load, tried first without the dispatch
+    if (ReportDecode<REPORT_INPUT>(Report, Length, Parsed) == REPORT_INPUT)
+    {
+      Parsed.TYPE = REPORT_INPUT;
+      return REPORT_INPUT;
+    }
+
+    uint8_t kind = REPORT_UNKNOWN;
+    if (Length >= 2)
+      kind = (Report[0] == 0x08) ? static_cast<uint8_t>(REPORT_LINK) : REPORT_KINDS[Report[1]];   // 0x08 connection, 0x00 data
+    // dense cases compile to a jump table, every decoder is inlined into its case
+    switch (kind)
+    {
+      case REPORT_LINK:     Parsed.TYPE = ReportDecode<REPORT_LINK>(Report, Length, Parsed); break;
+      case REPORT_ANNOUNCE: Parsed.TYPE = ReportDecode<REPORT_ANNOUNCE>(Report, Length, Parsed); break;
+      case REPORT_BATTERY:  Parsed.TYPE = ReportDecode<REPORT_BATTERY>(Report, Length, Parsed); break;
+      case REPORT_CHATPAD:  Parsed.TYPE = ReportDecode<REPORT_CHATPAD>(Report, Length, Parsed); break;
+      default:              Parsed.TYPE = REPORT_UNKNOWN; break;
+    }
+    return Parsed.TYPE;
+  }
+}
+
+#endif //_XBOX360_REPORT_
@@ -0,0 +1,83 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_RING_
+#define _XBOX360_RING_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace XKCTRL
+{
+  // Lock free single producer, single consumer ring buffer.
+  // Storage is fixed at compile time, so pushing never allocates.
+  // When full, new entries are dropped and counted until the consumer
+  // picks up the drop count with Read.
+  template <typename T, size_t CAPACITY>
+  class SPSCRing
+  {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SPSCRing capacity must be a power of 2");
+
+    public:
+      SPSCRing()
+        : Head_(0), Tail_(0), Dropped_(0)
+      {
+      }
+
+      // producer side
+      bool Push(const T& Entry)
+      {
+        uint64_t head = Head_.load(std::memory_order_relaxed);
+        if (head - Tail_.load(std::memory_order_acquire) >= CAPACITY)
+        {
+          Dropped_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+
+        Entries_[head & (CAPACITY - 1)] = Entry;
+        Head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      // consumer side, copies up to MaxEntries and returns how many were read
+      size_t Read(T* Entries, const size_t MaxEntries, uint64_t& Dropped)
+      {
+        uint64_t tail = Tail_.load(std::memory_order_relaxed);
+        uint64_t head = Head_.load(std::memory_order_acquire);
+
+        size_t count = 0;
+        while (tail != head && count < MaxEntries)
+          Entries[count++] = Entries_[(tail++) & (CAPACITY - 1)];
+
+        Tail_.store(tail, std::memory_order_release);
+        Dropped = Dropped_.exchange(0, std::memory_order_relaxed);
+        return count;
+      }
+
+    private:
+      // keep producer and consumer indexes on separate cache lines
+      alignas(64) std::atomic<uint64_t> Head_;
+      alignas(64) std::atomic<uint64_t> Tail_;
+      std::atomic<uint64_t> Dropped_;
+      alignas(64) T Entries_[CAPACITY];
+  };
+}
+
+#endif //_XBOX360_RING_
@@ -0,0 +1,88 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_SEQLOCK_
+#define _XBOX360_SEQLOCK_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+namespace XKCTRL
+{
+  // Single writer, many reader sequence lock.
+  // Readers never block the writer or each other, they simply retry
+  // when the writer was busy updating the value while they copied it.
+  // The value is kept in relaxed atomic words so the copy is race free.
+  template <typename T>
+  class SeqLock
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+    public:
+      SeqLock()
+        : Sequence_(0)
+      {
+        for (auto& word : Data_)
+          word.store(0, std::memory_order_relaxed);
+      }
+
+      // only ever called from one thread at a time
+      void Store(const T& Value)
+      {
+        uint32_t words[WORDS] = {0};
+        memcpy(words, &Value, sizeof(T));
+
+        uint32_t seq = Sequence_.load(std::memory_order_relaxed);
+        Sequence_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++)
+          Data_[i].store(words[i], std::memory_order_relaxed);
+
+        Sequence_.store(seq + 2, std::memory_order_release);
+      }
+
+      // safe from any number of threads
+      void Load(T& Value) const
+      {
+        uint32_t words[WORDS];
+        uint32_t seq_before, seq_after;
+        do
+        {
+          seq_before = Sequence_.load(std::memory_order_acquire);
+          for (size_t i = 0; i < WORDS; i++)
+            words[i] = Data_[i].load(std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          seq_after = Sequence_.load(std::memory_order_relaxed);
+        } while ((seq_before & 0x01) || seq_before != seq_after);
+
+        memcpy(&Value, words, sizeof(T));
+      }
+
+    private:
+      static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+      std::atomic<uint32_t> Sequence_;
+      std::atomic<uint32_t> Data_[WORDS];
+  };
+}
+
+#endif //_XBOX360_SEQLOCK_
@@ -0,0 +1,484 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+
+#include "XBOX360Shared.hpp"
+
+#define SHARED_MAGIC "X360SHM"
+#define SHARED_VERSION 2
+
+static_assert((SHARED_EVENTS & (SHARED_EVENTS - 1)) == 0, "SHARED_EVENTS must be a power of 2");
+static_assert((SHARED_REQUESTS & (SHARED_REQUESTS - 1)) == 0, "SHARED_REQUESTS must be a power of 2");
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory needs address free atomics");
+
+namespace XKCTRL
+{
+  enum SHARED_COMMAND
+  {
+    SHARED_LED = 0x01,
+    SHARED_RUMBLE = 0x02
+  };
+
+  struct SHARED_REQUEST
+  {
+    int32_t CONTROLLER;
+    uint8_t COMMAND;
+    uint8_t VALUE1, VALUE2;
+  };
+
+  // Layout of the shared memory object, both sides must be built from the
+  // same sources. Only the publisher writes states and events, requests are
+  // a bounded multi producer queue with a sequence number per slot.
+  struct SharedSegment
+  {
+    char MAGIC[8];
+    uint32_t VERSION;
+    uint32_t SIZE;
+    // process id of the publisher, written first so a crashed one is recognized
+    int32_t PUBLISHER;
+
+    // futex words, bumped whenever a controller state changed
+    std::atomic<uint32_t> GENERATION[MAX_CONTROLLERS];
+    std::atomic<uint32_t> WAITERS[MAX_CONTROLLERS];
+    SeqLock<CONTROLLER_PACKED_STATE> STATES[MAX_CONTROLLERS];
+
+    std::atomic<uint64_t> EVENT_HEAD;
+    SeqLock<SHARED_EVENT> EVENTS[SHARED_EVENTS];
+
+    // a client that dies between claiming and filling a slot stalls the queue
+    struct RequestSlot
+    {
+      std::atomic<uint64_t> SEQUENCE;
+      SHARED_REQUEST REQUEST;
+    };
+    alignas(64) std::atomic<uint64_t> REQUEST_HEAD;
+    alignas(64) std::atomic<uint64_t> REQUEST_TAIL;
+    alignas(64) std::atomic<uint32_t> REQUEST_SIGNAL;
+    RequestSlot REQUESTS[SHARED_REQUESTS];
+  };
+}
+
+static int SharedFutex(std::atomic<uint32_t>* Word, const int Operation, const uint32_t Value, const timespec* Timeout)
+{
+  // process shared futex, never FUTEX_PRIVATE_FLAG
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(Word), Operation, Value, Timeout, nullptr, 0);
+}
+
+static timespec SharedTimeout(const uint64_t NS)
+{
+  timespec timeout;
+  timeout.tv_sec = NS / 1000000000ULL;
+  timeout.tv_nsec = NS % 1000000000ULL;
+  return timeout;
+}
+
+static bool SharedStale(const std::string& Name)
+{
+  // only an object whose publisher provably exited may be replaced
+  int fd = shm_open(Name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    return errno == ENOENT;
+
+  // a publisher that crashed before sizing it left it empty
+  struct stat info;
+  if (fstat(fd, &info) < 0)
+  {
+    close(fd);
+    return false;
+  }
+  if (info.st_size != static_cast<off_t>(sizeof(XKCTRL::SharedSegment)))
+  {
+    close(fd);
+    return info.st_size == 0;
+  }
+
+  void* segment = mmap(nullptr, sizeof(XKCTRL::SharedSegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    return false;
+
+  const XKCTRL::SharedSegment* header = static_cast<const XKCTRL::SharedSegment*>(segment);
+  bool stale;
+  if (memcmp(header->MAGIC, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0 && header->VERSION != SHARED_VERSION)
+    stale = false;  // another build, its layout is unknown
+  else
+    stale = header->PUBLISHER <= 0 || (kill(header->PUBLISHER, 0) < 0 && errno == ESRCH);
+  munmap(segment, sizeof(XKCTRL::SharedSegment));
+  return stale;
+}
+
+XKCTRL::SharedPublisher::SharedPublisher(XKCTRL::XBOX360& Controllers, const std::string& Name, const mode_t Mode)
+  : Controllers_(Controllers),
+    Name_(Name),
+    Running_(false),
+    Published_(0),
+    Dropped_(0)
+{
+  // a crashed publisher may have left its object behind, a running one keeps it
+  int fd = shm_open(Name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, Mode);
+  if (fd < 0 && errno == EEXIST)
+  {
+    if (!SharedStale(Name_))
+      throw std::runtime_error("Shared memory is already published by a running publisher: " + Name_);
+    shm_unlink(Name_.c_str());
+    fd = shm_open(Name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, Mode);
+  }
+  if (fd < 0)
+    throw std::runtime_error("Error creating shared memory: " + Name_);
+
+  // the umask may have cleared group bits asked for in Mode
+  if (fchmod(fd, Mode) < 0)
+  {
+    close(fd);
+    shm_unlink(Name_.c_str());
+    throw std::runtime_error("Error setting shared memory permissions: " + Name_);
+  }
+
+  if (ftruncate(fd, sizeof(SharedSegment)) < 0)
+  {
+    close(fd);
+    shm_unlink(Name_.c_str());
+    throw std::runtime_error("Error sizing shared memory: " + Name_);
+  }
+
+  void* segment = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+  {
+    shm_unlink(Name_.c_str());
+    throw std::runtime_error("Error mapping shared memory: " + Name_);
+  }
+
+  // construct every atomic in place, clients check the header last
+  Segment_ = new (segment) SharedSegment();
+  Segment_->PUBLISHER = getpid();
+  for (int32_t i = 0; i < MAX_CONTROLLERS; i++)
+  {
+    Segment_->GENERATION[i] = 0;
+    Segment_->WAITERS[i] = 0;
+  }
+  Segment_->EVENT_HEAD = 0;
+  Segment_->REQUEST_HEAD = 0;
+  Segment_->REQUEST_TAIL = 0;
+  Segment_->REQUEST_SIGNAL = 0;
+  for (uint64_t i = 0; i < SHARED_REQUESTS; i++)
+    Segment_->REQUESTS[i].SEQUENCE = i;
+  memset(States_, 0x00, sizeof(States_));
+
+  Segment_->VERSION = SHARED_VERSION;
+  Segment_->SIZE = sizeof(SharedSegment);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(Segment_->MAGIC, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+
+  StopFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (StopFD_ < 0)
+  {
+    munmap(Segment_, sizeof(SharedSegment));
+    shm_unlink(Name_.c_str());
+    throw std::runtime_error("Error creating publisher eventfd");
+  }
+
+  // the publisher's own copy of every event, readable when the eventfd is.
+  // Opened last, so a publisher that failed above leaves the XBOX360 untouched.
+  try
+  {
+    EventFD_ = Controllers_.OpenEventTap();
+  }
+  catch(...)
+  {
+    close(StopFD_);
+    munmap(Segment_, sizeof(SharedSegment));
+    shm_unlink(Name_.c_str());
+    throw;
+  }
+
+  Running_ = true;
+  PublishThread_ = std::thread(&SharedPublisher::PublishThread, this);
+  RequestThread_ = std::thread(&SharedPublisher::RequestThread, this);
+}
+
+XKCTRL::SharedPublisher::~SharedPublisher()
+{
+  Running_ = false;
+  uint64_t signal = 1;
+  if (write(StopFD_, &signal, sizeof(signal)) < 0)
+  {
+    // only fails if the counter overflows, the thread is awake then anyway
+  }
+  Segment_->REQUEST_SIGNAL.fetch_add(1);
+  SharedFutex(&Segment_->REQUEST_SIGNAL, FUTEX_WAKE, INT_MAX, nullptr);
+  PublishThread_.join();
+  RequestThread_.join();
+  close(StopFD_);
+
+  // clients keep their mapping, new ones can no longer open it
+  shm_unlink(Name_.c_str());
+  munmap(Segment_, sizeof(SharedSegment));
+}
+
+void XKCTRL::SharedPublisher::PublishThread()
+{
+  // wake on new input from any controller, or on the stop signal
+  pollfd fds[2];
+  fds[0].fd = EventFD_;
+  fds[0].events = POLLIN;
+  fds[1].fd = StopFD_;
+  fds[1].events = POLLIN;
+
+  Publish();
+  while (Running_)
+  {
+    if (poll(fds, 2, -1) <= 0)
+      continue;
+
+    uint64_t count;
+    if (read(fds[0].fd, &count, sizeof(count)) < 0)
+    {
+      // nothing new, already reset by a racing read
+    }
+    Publish();
+  }
+}
+
+void XKCTRL::SharedPublisher::Publish()
+{
+  // events first, so a client woken by a state change already finds them
+  CONTROLLER_EVENT events[64];
+  uint64_t head = Segment_->EVENT_HEAD.load(std::memory_order_relaxed);
+  for (int32_t c = 0; c < MAX_CONTROLLERS; c++)
+  {
+    size_t count;
+    do
+    {
+      uint64_t dropped = 0;
+      count = Controllers_.ReadEventTap(c, events, 64, dropped);
+      Dropped_.fetch_add(dropped, std::memory_order_relaxed);
+      for (size_t i = 0; i < count; i++)
+      {
+        SHARED_EVENT event;
+        event.INDEX = head;
+        event.CONTROLLER = c;
+        event.EVENT = events[i];
+        Segment_->EVENTS[head & (SHARED_EVENTS - 1)].Store(event);
+        Segment_->EVENT_HEAD.store(++head, std::memory_order_release);
+      }
+      Published_.fetch_add(count, std::memory_order_relaxed);
+    } while (count == 64);
+  }
+
+  for (int32_t c = 0; c < MAX_CONTROLLERS; c++)
+  {
+    CONTROLLER_PACKED_STATE state;
+    Controllers_.GetControllerState(c, state);
+    if (memcmp(&state, &States_[c], sizeof(CONTROLLER_PACKED_STATE)) == 0)
+      continue;
+
+    States_[c] = state;
+    Segment_->STATES[c].Store(state);
+    Segment_->GENERATION[c].fetch_add(1);
+    if (Segment_->WAITERS[c].load() > 0)
+      SharedFutex(&Segment_->GENERATION[c], FUTEX_WAKE, INT_MAX, nullptr);
+  }
+}
+
+void XKCTRL::SharedPublisher::RequestThread()
+{
+  // single consumer of the request queue, sleeps on the signal futex
+  while (Running_)
+  {
+    uint32_t signal = Segment_->REQUEST_SIGNAL.load();
+    uint64_t tail = Segment_->REQUEST_TAIL.load(std::memory_order_relaxed);
+    SharedSegment::RequestSlot& slot = Segment_->REQUESTS[tail & (SHARED_REQUESTS - 1)];
+    if (slot.SEQUENCE.load(std::memory_order_acquire) != tail + 1)
+    {
+      SharedFutex(&Segment_->REQUEST_SIGNAL, FUTEX_WAIT, signal, nullptr);
+      continue;
+    }
+
+    SHARED_REQUEST request = slot.REQUEST;
+    slot.SEQUENCE.store(tail + SHARED_REQUESTS, std::memory_order_release);
+    Segment_->REQUEST_TAIL.store(tail + 1, std::memory_order_relaxed);
+
+    if (request.COMMAND == SHARED_LED)
+      Controllers_.SetLED(request.CONTROLLER, static_cast<LED_SETTING>(request.VALUE1 & 0x0F));
+    else if (request.COMMAND == SHARED_RUMBLE)
+      Controllers_.SetRumble(request.CONTROLLER, request.VALUE1, request.VALUE2);
+  }
+}
+
+XKCTRL::SharedClient::SharedClient(const std::string& Name)
+{
+  int fd = shm_open(Name.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0)
+    throw std::runtime_error("Error opening shared memory, is the publisher running: " + Name);
+
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size != static_cast<off_t>(sizeof(SharedSegment)))
+  {
+    close(fd);
+    throw std::runtime_error("Invalid shared memory: " + Name);
+  }
+
+  void* segment = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    throw std::runtime_error("Error mapping shared memory: " + Name);
+
+  Segment_ = static_cast<SharedSegment*>(segment);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (memcmp(Segment_->MAGIC, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0 ||
+      Segment_->VERSION != SHARED_VERSION || Segment_->SIZE != sizeof(SharedSegment))
+  {
+    munmap(Segment_, sizeof(SharedSegment));
+    throw std::runtime_error("Invalid shared memory: " + Name);
+  }
+
+  // only events published from now on
+  EventPosition_ = Segment_->EVENT_HEAD.load(std::memory_order_acquire);
+}
+
+XKCTRL::SharedClient::~SharedClient()
+{
+  munmap(Segment_, sizeof(SharedSegment));
+}
+
+bool XKCTRL::SharedClient::Request(const int32_t ControllerIndex, const uint8_t Command, const uint8_t Value1, const uint8_t Value2)
+{
+  // claim a slot, fill it and publish it through its sequence number
+  uint64_t head = Segment_->REQUEST_HEAD.load(std::memory_order_relaxed);
+  SharedSegment::RequestSlot* slot;
+  while (true)
+  {
+    slot = &Segment_->REQUESTS[head & (SHARED_REQUESTS - 1)];
+    int64_t diff = static_cast<int64_t>(slot->SEQUENCE.load(std::memory_order_acquire) - head);
+    if (diff < 0)
+      return false;
+    if (diff == 0 && Segment_->REQUEST_HEAD.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+      break;
+    if (diff > 0)
+      head = Segment_->REQUEST_HEAD.load(std::memory_order_relaxed);
+  }
+
+  slot->REQUEST.CONTROLLER = std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0);
+  slot->REQUEST.COMMAND = Command;
+  slot->REQUEST.VALUE1 = Value1;
+  slot->REQUEST.VALUE2 = Value2;
+  slot->SEQUENCE.store(head + 1, std::memory_order_release);
+
+  Segment_->REQUEST_SIGNAL.fetch_add(1);
+  SharedFutex(&Segment_->REQUEST_SIGNAL, FUTEX_WAKE, 1, nullptr);
+  return true;
+}
+
+void XKCTRL::SharedClient::SetLED(const int32_t ControllerIndex, const XKCTRL::LED_SETTING LEDSetting)
+{
+  // dropped if the publisher fell behind by SHARED_REQUESTS requests
+  Request(ControllerIndex, SHARED_LED, static_cast<uint8_t>(LEDSetting), 0x00);
+}
+
+void XKCTRL::SharedClient::SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight)
+{
+  Request(ControllerIndex, SHARED_RUMBLE, BigWeight, SmallWeight);
+}
+
+void XKCTRL::SharedClient::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState)
+{
+  // straight from shared memory, no system call
+  int32_t controlleridx = std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0);
+  Segment_->STATES[controlleridx].Load(ControllerState);
+}
+
+void XKCTRL::SharedClient::GetControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState)
+{
+  CONTROLLER_PACKED_STATE state;
+  GetControllerState(ControllerIndex, state);
+  state.ToState(ControllerState);
+}
+
+bool XKCTRL::SharedClient::GetWaitControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  // sleep on the controller's generation futex until the publisher moves it on
+  int32_t controlleridx = std::max(std::min(ControllerIndex, MAX_CONTROLLERS - 1), 0);
+  std::atomic<uint32_t>& generation = Segment_->GENERATION[controlleridx];
+  uint32_t start = generation.load();
+  Segment_->WAITERS[controlleridx].fetch_add(1);
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TimeoutMS);
+  bool notified = false;
+  while (!(notified = (generation.load() != start)))
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+      break;
+    timespec timeout = SharedTimeout(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count());
+    SharedFutex(&generation, FUTEX_WAIT, start, &timeout);
+  }
+  Segment_->WAITERS[controlleridx].fetch_sub(1);
+
+  Segment_->STATES[controlleridx].Load(ControllerState);
+  return notified;
+}
+
+bool XKCTRL::SharedClient::GetWaitControllerState(const int32_t ControllerIndex, XKCTRL::CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS)
+{
+  CONTROLLER_PACKED_STATE state;
+  bool notified = GetWaitControllerState(ControllerIndex, state, TimeoutMS);
+  state.ToState(ControllerState);
+  return notified;
+}
+
+size_t XKCTRL::SharedClient::ReadEvents(XKCTRL::SHARED_EVENT* Events, const size_t MaxEvents, uint64_t& DroppedEvents)
+{
+  uint64_t head = Segment_->EVENT_HEAD.load(std::memory_order_acquire);
+  DroppedEvents = 0;
+
+  // skip whatever the publisher already overwrote
+  if (head - EventPosition_ > SHARED_EVENTS)
+  {
+    DroppedEvents = head - SHARED_EVENTS - EventPosition_;
+    EventPosition_ = head - SHARED_EVENTS;
+  }
+
+  size_t count = 0;
+  for (; EventPosition_ < head && count < MaxEvents; EventPosition_++)
+  {
+    Segment_->EVENTS[EventPosition_ & (SHARED_EVENTS - 1)].Load(Events[count]);
+    if (Events[count].INDEX == EventPosition_)
+      count++;
+    else
+      DroppedEvents++;
+  }
+  return count;
+}
@@ -0,0 +1,121 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_SHARED_
+#define _XBOX360_SHARED_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "XBOX360.hpp"
+
+// POSIX shared memory object the publisher creates and clients open
+#define SHARED_DEFAULT_NAME "/xbox360-controllers"
+// Permissions of the shared memory object, only the publisher's user by
+// default. 0660 lets clients in the publisher's group in as well, anyone
+// who can open it can read every controller and send LED and rumble requests.
+#define SHARED_DEFAULT_MODE 0600
+// Events kept in the shared event ring, for all controllers together
+#define SHARED_EVENTS 1024
+// LED and rumble requests from clients waiting for the publisher
+#define SHARED_REQUESTS 256
+
+namespace XKCTRL
+{
+  struct SharedSegment;
+
+  // Input event of any controller, as read from the shared event ring
+  struct SHARED_EVENT
+  {
+    // position in the ring, counts every event ever published
+    uint64_t INDEX;
+    int32_t CONTROLLER;
+    CONTROLLER_EVENT EVENT;
+  };
+
+  // Publishes the states and events of an XBOX360 into shared memory and
+  // carries out LED and rumble requests from clients. States are published
+  // through seqlocks, so any number of client processes can read them
+  // without system calls. Events come from the event tap of the XBOX360 it
+  // is given, so ReadControllerEvents and the eventfds stay free for the
+  // rest of the process. Only one publisher can use an XBOX360 at a time.
+  class SharedPublisher
+  {
+    public:
+      explicit SharedPublisher(XBOX360& Controllers, const std::string& Name = SHARED_DEFAULT_NAME,
+                               const mode_t Mode = SHARED_DEFAULT_MODE);
+      ~SharedPublisher();
+
+      // events published and events lost because the XBOX360 ring was full
+      uint64_t Published() const { return Published_.load(std::memory_order_relaxed); }
+      uint64_t Dropped() const { return Dropped_.load(std::memory_order_relaxed); }
+
+    private:
+      XBOX360& Controllers_;
+      std::string Name_;
+      SharedSegment* Segment_ = nullptr;
+      CONTROLLER_PACKED_STATE States_[MAX_CONTROLLERS];
+
+      std::atomic<bool> Running_;
+      int EventFD_ = -1;
+      int StopFD_ = -1;
+      std::thread PublishThread_;
+      std::thread RequestThread_;
+      std::atomic<uint64_t> Published_;
+      std::atomic<uint64_t> Dropped_;
+
+      void PublishThread();
+      void RequestThread();
+      void Publish();
+  };
+
+  // Reads what a SharedPublisher in another process publishes, with the same
+  // calls as XBOX360. States and events are read straight from shared memory,
+  // only waiting and sending requests make system calls.
+  class SharedClient
+  {
+    public:
+      explicit SharedClient(const std::string& Name = SHARED_DEFAULT_NAME);
+      ~SharedClient();
+
+      void SetLED(const int32_t ControllerIndex, const LED_SETTING LEDSetting);
+      void SetRumble(const int32_t ControllerIndex, const uint8_t BigWeight, const uint8_t SmallWeight);
+      void GetControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState);
+      void GetControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState);
+      bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_STATE& ControllerState, uint32_t TimeoutMS);
+      bool GetWaitControllerState(const int32_t ControllerIndex, CONTROLLER_PACKED_STATE& ControllerState, uint32_t TimeoutMS);
+
+      // Events of all controllers published since the last call, oldest
+      // first. Each client has its own position, events the publisher
+      // overwrote before they were read are counted in DroppedEvents.
+      size_t ReadEvents(SHARED_EVENT* Events, const size_t MaxEvents, uint64_t& DroppedEvents);
+
+    private:
+      SharedSegment* Segment_ = nullptr;
+      uint64_t EventPosition_ = 0;
+
+      bool Request(const int32_t ControllerIndex, const uint8_t Command, const uint8_t Value1, const uint8_t Value2);
+  };
+}
+
+#endif //_XBOX360_SHARED_
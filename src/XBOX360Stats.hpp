@@ -0,0 +1,172 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_STATS_
+#define _XBOX360_STATS_
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "XBOX360Defines.hpp"
+
+// Build with -DXBOX360_NO_STATS to compile all hot path instrumentation out,
+// snapshots are then all zero.
+#ifndef XBOX360_NO_STATS
+#define XBOX360_STATS 1
+#else
+#define XBOX360_STATS 0
+#endif
+
+// Bucket i counts values of bit length i, i.e. [2^(i-1), 2^i), the last
+// bucket holds everything larger.
+#define STATS_HISTOGRAM_BUCKETS 40
+
+namespace XKCTRL
+{
+  struct HISTOGRAM
+  {
+    uint64_t COUNT;
+    uint64_t SUM;
+    uint64_t MAX;
+    uint64_t BUCKETS[STATS_HISTOGRAM_BUCKETS];
+  };
+
+  struct PERF_STATS
+  {
+    // time between reports, per controller
+    HISTOGRAM REPORT_INTERVAL_NS[MAX_CONTROLLERS];
+    // decoding and publishing one data report in ControllerDataProcessing
+    HISTOGRAM DECODE_NS;
+    // time spent waiting for the output queue mutex when it was already held
+    HISTOGRAM MUTEX_WAIT_NS;
+    // output report from submit to completion
+    HISTOGRAM OUTPUT_NS;
+    uint64_t REPORTS;
+    uint64_t MUTEX_ACQUIRED;
+    uint64_t MUTEX_CONTENDED;
+    uint64_t OUTPUT_FAILED;
+    uint64_t CONNECTS;
+    uint64_t DISCONNECTS;
+    uint64_t TIMEOUTS_IN;
+    uint64_t TIMEOUTS_OUT;
+    // data reports that woke a subscriber and those filtered out, all subscriptions
+    uint64_t SUBSCRIPTION_DELIVERED;
+    uint64_t SUBSCRIPTION_SUPPRESSED;
+  };
+
+  // Upper bound of the bucket holding the given fraction (0.0-1.0) of values
+  inline uint64_t HistogramPercentile(const HISTOGRAM& Histogram, const double Fraction)
+  {
+    uint64_t target = static_cast<uint64_t>(Histogram.COUNT * Fraction);
+    uint64_t seen = 0;
+    for (int32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += Histogram.BUCKETS[i];
+      if (seen > target)
+        return (i == 0) ? 0 : std::min<uint64_t>(Histogram.MAX, (1ULL << i) - 1);
+    }
+    return Histogram.MAX;
+  }
+
+  // Fixed bucket histogram, recording is wait free with relaxed atomics
+  class StatsHistogram
+  {
+    public:
+      StatsHistogram()
+        : Count_(0), Sum_(0), Max_(0)
+      {
+        for (auto& bucket : Buckets_)
+          bucket = 0;
+      }
+
+      inline void Record(const uint64_t Value)
+      {
+#if XBOX360_STATS
+        int32_t bucket = (Value == 0) ? 0 : 64 - __builtin_clzll(Value);
+        if (bucket >= STATS_HISTOGRAM_BUCKETS)
+          bucket = STATS_HISTOGRAM_BUCKETS - 1;
+        Buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        Count_.fetch_add(1, std::memory_order_relaxed);
+        Sum_.fetch_add(Value, std::memory_order_relaxed);
+
+        // racing writers can only raise the max
+        uint64_t max = Max_.load(std::memory_order_relaxed);
+        while (Value > max && !Max_.compare_exchange_weak(max, Value, std::memory_order_relaxed))
+          ;
+#endif
+      }
+
+      void Snapshot(HISTOGRAM& Histogram) const
+      {
+        // counters are read one by one, totals may be off by in flight records
+        Histogram.COUNT = Count_.load(std::memory_order_relaxed);
+        Histogram.SUM = Sum_.load(std::memory_order_relaxed);
+        Histogram.MAX = Max_.load(std::memory_order_relaxed);
+        for (int32_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+          Histogram.BUCKETS[i] = Buckets_[i].load(std::memory_order_relaxed);
+      }
+
+    private:
+      std::atomic<uint64_t> Count_;
+      std::atomic<uint64_t> Sum_;
+      std::atomic<uint64_t> Max_;
+      std::atomic<uint64_t> Buckets_[STATS_HISTOGRAM_BUCKETS];
+  };
+
+  // Plain event counter with relaxed atomics
+  class StatsCounter
+  {
+    public:
+      StatsCounter()
+        : Count_(0)
+      {
+      }
+
+      inline void Add(const uint64_t Value = 1)
+      {
+#if XBOX360_STATS
+        Count_.fetch_add(Value, std::memory_order_relaxed);
+#endif
+      }
+
+      uint64_t Get() const
+      {
+        return Count_.load(std::memory_order_relaxed);
+      }
+
+    private:
+      std::atomic<uint64_t> Count_;
+  };
+
+  // steady clock in nanoseconds for timing measurements, 0 when compiled out
+  inline uint64_t StatsNow()
+  {
+#if XBOX360_STATS
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return 0;
+#endif
+  }
+}
+
+#endif //_XBOX360_STATS_
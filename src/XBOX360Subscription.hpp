@@ -0,0 +1,79 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_SUBSCRIPTION_
+#define _XBOX360_SUBSCRIPTION_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "XBOX360Defines.hpp"
+
+// Subscriptions per controller, subscription ids are
+// controller index * MAX_SUBSCRIPTIONS + slot
+#define MAX_SUBSCRIPTIONS 8
+static_assert(MAX_SUBSCRIPTIONS < 32, "subscription slots are kept in a 32 bit mask");
+
+namespace XKCTRL
+{
+  // What a subscriber wants to be woken for, zero fields are ignored.
+  // Connecting and disconnecting always wakes every subscriber.
+  struct SUBSCRIPTION_FILTER
+  {
+    // BUTTON_MASK bits, a press or release of any of them
+    uint16_t BUTTONS;
+    // raw change of an axis since the subscriber was last woken
+    uint16_t LTRIG_DELTA, RTRIG_DELTA;
+    uint16_t LSTICK_X_DELTA, LSTICK_Y_DELTA, RSTICK_X_DELTA, RSTICK_Y_DELTA;
+    // a trigger crossing this raw level, in either direction
+    uint8_t LTRIG_LEVEL, RTRIG_LEVEL;
+  };
+
+  struct SUBSCRIPTION_STATS
+  {
+    // data reports that woke the subscriber and those it slept through
+    uint64_t DELIVERED;
+    uint64_t SUPPRESSED;
+  };
+
+  // True if a report moving a controller from Previous to State wakes the
+  // subscriber. Buttons and levels are compared with the previous report,
+  // axis deltas with Reference, the state the subscriber was last woken for,
+  // so slow drift wakes it once it adds up.
+  inline bool SubscriptionMatch(const SUBSCRIPTION_FILTER& Filter, const CONTROLLER_PACKED_STATE& Reference,
+                                const CONTROLLER_PACKED_STATE& Previous, const CONTROLLER_PACKED_STATE& State)
+  {
+    if ((State.BUTTONS ^ Previous.BUTTONS) & Filter.BUTTONS)
+      return true;
+
+    if (Filter.LTRIG_LEVEL && ((Previous.LTRIG >= Filter.LTRIG_LEVEL) != (State.LTRIG >= Filter.LTRIG_LEVEL)))
+      return true;
+    if (Filter.RTRIG_LEVEL && ((Previous.RTRIG >= Filter.RTRIG_LEVEL) != (State.RTRIG >= Filter.RTRIG_LEVEL)))
+      return true;
+
+    return (Filter.LTRIG_DELTA && abs(State.LTRIG - Reference.LTRIG) >= Filter.LTRIG_DELTA) ||
+           (Filter.RTRIG_DELTA && abs(State.RTRIG - Reference.RTRIG) >= Filter.RTRIG_DELTA) ||
+           (Filter.LSTICK_X_DELTA && abs(State.LSTICK_X - Reference.LSTICK_X) >= Filter.LSTICK_X_DELTA) ||
+           (Filter.LSTICK_Y_DELTA && abs(State.LSTICK_Y - Reference.LSTICK_Y) >= Filter.LSTICK_Y_DELTA) ||
+           (Filter.RSTICK_X_DELTA && abs(State.RSTICK_X - Reference.RSTICK_X) >= Filter.RSTICK_X_DELTA) ||
+           (Filter.RSTICK_Y_DELTA && abs(State.RSTICK_Y - Reference.RSTICK_Y) >= Filter.RSTICK_Y_DELTA);
+  }
+}
+
+#endif //_XBOX360_SUBSCRIPTION_
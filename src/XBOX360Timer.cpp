@@ -0,0 +1,231 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "XBOX360Timer.hpp"
+
+#define TIMER_SLOT(TICK) ((TICK) & (TIMER_WHEEL_SLOTS - 1))
+
+XKCTRL::TimerWheel::TimerWheel()
+  : CurrentTick_(0),
+    ActiveTimers_(0),
+    StartTime_(std::chrono::steady_clock::now()),
+    TimerThreadRunning_(false)
+{
+  for (auto& slot : Slots_)
+    slot = -1;
+  memset(SlotsUsed_, 0x00, sizeof(SlotsUsed_));
+
+  // firing and pooling timers never allocates below the reserve
+  Entries_.reserve(TIMER_POOL_RESERVE);
+  FreeEntries_.reserve(TIMER_POOL_RESERVE);
+  Expired_.reserve(TIMER_POOL_RESERVE);
+
+  //start timer thread
+  TimerThreadRunning_ = true;
+  TimerThread_ = std::thread(&TimerWheel::TimerThread, this);
+}
+
+XKCTRL::TimerWheel::~TimerWheel()
+{
+  Stop();
+}
+
+void XKCTRL::TimerWheel::Stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    TimerThreadRunning_ = false;
+  }
+  TimerNotify_.notify_one();
+
+  // pending timers are dropped, their callbacks never run
+  if (TimerThread_.joinable())
+    TimerThread_.join();
+}
+
+XKCTRL::TimerWheel::TimerID XKCTRL::TimerWheel::Schedule(const uint32_t DelayMS, std::function<void()> Callback)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (!TimerThreadRunning_)
+    return INVALID_TIMER;
+
+  // reuse a pooled entry if possible
+  int32_t entry;
+  if (FreeEntries_.empty())
+  {
+    entry = static_cast<int32_t>(Entries_.size());
+    Entries_.push_back(TimerEntry{nullptr, 0, 0, -1, -1, false});
+  }
+  else
+  {
+    entry = FreeEntries_.back();
+    FreeEntries_.pop_back();
+  }
+
+  // never schedule behind the tick the timer thread is working on
+  uint64_t due = TimerTick(std::chrono::steady_clock::now()) + (DelayMS / TIMER_RESOLUTION_MS);
+  TimerEntry& timer = Entries_[entry];
+  timer.Callback = std::move(Callback);
+  timer.DueTick = std::max(due, CurrentTick_);
+  timer.Generation++;
+  timer.Active = true;
+  TimerLink(entry);
+  ActiveTimers_++;
+
+  TimerNotify_.notify_one();
+  return (static_cast<uint64_t>(timer.Generation) << 32) | static_cast<uint32_t>(entry);
+}
+
+bool XKCTRL::TimerWheel::Cancel(const TimerID Timer)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+
+  int32_t entry = static_cast<int32_t>(Timer & 0xFFFFFFFF);
+  uint32_t generation = static_cast<uint32_t>(Timer >> 32);
+  if (Timer == INVALID_TIMER || entry >= static_cast<int32_t>(Entries_.size()))
+    return false;
+
+  // stale ids from fired or cancelled timers are ignored
+  TimerEntry& timer = Entries_[entry];
+  if (!timer.Active || timer.Generation != generation)
+    return false;
+
+  TimerUnlink(entry);
+  timer.Active = false;
+  timer.Callback = nullptr;
+  FreeEntries_.push_back(entry);
+  ActiveTimers_--;
+  return true;
+}
+
+uint64_t XKCTRL::TimerWheel::TimerTick(const std::chrono::steady_clock::time_point Time)
+{
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Time - StartTime_);
+  return static_cast<uint64_t>(elapsed.count()) / TIMER_RESOLUTION_MS;
+}
+
+uint64_t XKCTRL::TimerWheel::TimerNextTick()
+{
+  // find the next wheel slot holding any timer, at most one revolution out
+  for (uint64_t tick = CurrentTick_; tick < CurrentTick_ + TIMER_WHEEL_SLOTS; tick++)
+  {
+    uint64_t slot = TIMER_SLOT(tick);
+    uint64_t bits = SlotsUsed_[slot / 64] >> (slot % 64);
+    if (bits == 0)
+    {
+      // skip the rest of this word
+      tick += 63 - (slot % 64);
+      continue;
+    }
+    if (bits & 0x01)
+      return tick;
+  }
+  return CurrentTick_ + TIMER_WHEEL_SLOTS;
+}
+
+void XKCTRL::TimerWheel::TimerLink(const int32_t Entry)
+{
+  uint64_t slot = TIMER_SLOT(Entries_[Entry].DueTick);
+  Entries_[Entry].Prev = -1;
+  Entries_[Entry].Next = Slots_[slot];
+  if (Slots_[slot] >= 0)
+    Entries_[Slots_[slot]].Prev = Entry;
+  Slots_[slot] = Entry;
+  SlotsUsed_[slot / 64] |= (1ULL << (slot % 64));
+}
+
+void XKCTRL::TimerWheel::TimerUnlink(const int32_t Entry)
+{
+  uint64_t slot = TIMER_SLOT(Entries_[Entry].DueTick);
+  TimerEntry& timer = Entries_[Entry];
+  if (timer.Prev >= 0)
+    Entries_[timer.Prev].Next = timer.Next;
+  else
+    Slots_[slot] = timer.Next;
+  if (timer.Next >= 0)
+    Entries_[timer.Next].Prev = timer.Prev;
+
+  if (Slots_[slot] < 0)
+    SlotsUsed_[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
+void XKCTRL::TimerWheel::TimerThread()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (TimerThreadRunning_)
+  {
+    // expire every occupied slot up to the current time, empty slots are
+    // skipped so catching up after an idle stretch costs nothing
+    uint64_t now = TimerTick(std::chrono::steady_clock::now());
+    while (CurrentTick_ <= now)
+    {
+      uint64_t occupied = TimerNextTick();
+      if (occupied > now || occupied >= CurrentTick_ + TIMER_WHEEL_SLOTS)
+      {
+        CurrentTick_ = now + 1;
+        break;
+      }
+      CurrentTick_ = occupied;
+
+      int32_t entry = Slots_[TIMER_SLOT(CurrentTick_)];
+      while (entry >= 0)
+      {
+        int32_t next = Entries_[entry].Next;
+
+        // entries more than one revolution out stay for a later pass
+        if (Entries_[entry].DueTick <= CurrentTick_)
+        {
+          TimerUnlink(entry);
+          Entries_[entry].Active = false;
+          Expired_.push_back(std::move(Entries_[entry].Callback));
+          Entries_[entry].Callback = nullptr;
+          FreeEntries_.push_back(entry);
+          ActiveTimers_--;
+        }
+        entry = next;
+      }
+      CurrentTick_++;
+    }
+
+    // run callbacks unlocked so they can schedule or cancel timers
+    if (!Expired_.empty())
+    {
+      std::vector<std::function<void()>> expired;
+      expired.swap(Expired_);
+      lock.unlock();
+      for (auto& callback : expired)
+        callback();
+      expired.clear();
+      lock.lock();
+
+      // keep the buffer to avoid reallocating next time
+      if (Expired_.empty())
+        Expired_.swap(expired);
+      continue;
+    }
+
+    // sleep until the next occupied slot or until a timer is scheduled
+    if (ActiveTimers_ == 0)
+      TimerNotify_.wait(lock);
+    else
+      TimerNotify_.wait_until(lock, StartTime_ + std::chrono::milliseconds(TimerNextTick() * TIMER_RESOLUTION_MS));
+  }
+}
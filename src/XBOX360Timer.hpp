@@ -0,0 +1,88 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_TIMER_
+#define _XBOX360_TIMER_
+
+#include <stdint.h>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+#define TIMER_WHEEL_SLOTS 512
+#define TIMER_RESOLUTION_MS 1
+// timers pooled up front, the pool only grows past this many pending timers
+#define TIMER_POOL_RESERVE 256
+
+namespace XKCTRL
+{
+  // Hashed timer wheel serviced by a single thread.
+  // Scheduling and cancelling are O(1), timers are kept in a pooled list
+  // per wheel slot and callbacks run on the timer thread without any lock held.
+  class TimerWheel
+  {
+    public:
+      typedef uint64_t TimerID;
+      static const TimerID INVALID_TIMER = 0;
+
+      TimerWheel();
+      ~TimerWheel();
+
+      TimerID Schedule(const uint32_t DelayMS, std::function<void()> Callback);
+      bool    Cancel(const TimerID Timer);
+      void    Stop();
+
+    private:
+      struct TimerEntry
+      {
+        std::function<void()> Callback;
+        uint64_t DueTick;
+        uint32_t Generation;
+        int32_t  Next;
+        int32_t  Prev;
+        bool     Active;
+      };
+
+      // pooled timer entries, linked per wheel slot by index
+      std::vector<TimerEntry> Entries_;
+      std::vector<int32_t> FreeEntries_;
+      std::vector<std::function<void()>> Expired_;
+      int32_t Slots_[TIMER_WHEEL_SLOTS];
+      uint64_t SlotsUsed_[TIMER_WHEEL_SLOTS / 64];
+      uint64_t CurrentTick_;
+      size_t ActiveTimers_;
+      std::chrono::steady_clock::time_point StartTime_;
+
+      std::thread TimerThread_;
+      bool TimerThreadRunning_;
+      std::mutex mutex_;
+      std::condition_variable TimerNotify_;
+
+      void     TimerThread();
+      uint64_t TimerTick(const std::chrono::steady_clock::time_point Time);
+      uint64_t TimerNextTick();
+      void     TimerLink(const int32_t Entry);
+      void     TimerUnlink(const int32_t Entry);
+  };
+}
+
+#endif //_XBOX360_TIMER_
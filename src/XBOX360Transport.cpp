@@ -0,0 +1,632 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include <string.h>
+#include <stdexcept>
+
+#include "XBOX360Transport.hpp"
+#include "XBOX360Decode.hpp"
+#include "XBOX360Log.hpp"
+
+static size_t WiredTranslateIn(const uint8_t* Report, const size_t Length, uint8_t* Translated)
+{
+  // wired input reports are type 0x00, 20 bytes long with the layout at
+  // offset 2. LED, rumble and headset status reports are dropped.
+  if (Length < 2 + sizeof(XKCTRL::CONTROLLER_LAYOUT) || Report[0] != 0x00 || Report[1] != 0x14)
+    return 0;
+
+  static const uint8_t header[REPORT_LAYOUT_OFFSET] = {0x00, 0x01, 0x00, 0xF0, 0x00, 0x13};
+  memcpy(Translated, header, REPORT_LAYOUT_OFFSET);
+  memcpy(Translated + REPORT_LAYOUT_OFFSET, Report + 2, sizeof(XKCTRL::CONTROLLER_LAYOUT));
+  return REPORT_LAYOUT_OFFSET + sizeof(XKCTRL::CONTROLLER_LAYOUT);
+}
+
+static size_t WiredTranslateOut(const uint8_t* Data, const size_t Length, uint8_t* Translated)
+{
+  // rumble, big and small motor weights
+  if (Length >= 7 && Data[1] == 0x01 && Data[2] == 0x0F && Data[3] == 0xC0)
+  {
+    const uint8_t rumble[8] = {0x00, 0x08, 0x00, Data[5], Data[6], 0x00, 0x00, 0x00};
+    memcpy(Translated, rumble, sizeof(rumble));
+    return sizeof(rumble);
+  }
+
+  // LED pattern, wired controllers take the same LED_SETTING values
+  if (Length >= 4 && Data[2] == 0x08)
+  {
+    const uint8_t led[3] = {0x01, 0x03, static_cast<uint8_t>(Data[3] & 0x0F)};
+    memcpy(Translated, led, sizeof(led));
+    return sizeof(led);
+  }
+
+  // wired controllers have no ready command, it is always sent right after
+  // the LEDs were turned off so turning them off again keeps the order
+  const uint8_t off[3] = {0x01, 0x03, 0x00};
+  memcpy(Translated, off, sizeof(off));
+  return sizeof(off);
+}
+
+const XKCTRL::USBDriver XKCTRL::LibUSBTransport::USBDrivers_[] =
+{
+  // XBOX 360 Wireless has only 1 Configuratin Descriptor with 8 Interface
+  // Descriptors, 0,2,4,6 represent connected controllers 1,2,3 and 4. Each
+  // has 2 Endpoint Descriptors, one for data In and another for Out.
+  {"XBOX360 Wireless Receiver", 0x045E, 0x02A9, RECEIVER_CONTROLLERS, {0, 2, 4, 6},
+   {0x81, 0x83, 0x85, 0x87}, {0x01, 0x03, 0x05, 0x07}, nullptr, nullptr, false},
+  {"XBOX360 Wireless Receiver", 0x045E, 0x0719, RECEIVER_CONTROLLERS, {0, 2, 4, 6},
+   {0x81, 0x83, 0x85, 0x87}, {0x01, 0x03, 0x05, 0x07}, nullptr, nullptr, false},
+  // XBOX 360 Wired Controller, one controller on interface 0
+  {"XBOX360 Wired Controller", 0x045E, 0x028E, 1, {0}, {0x81}, {0x01},
+   &WiredTranslateIn, &WiredTranslateOut, true}
+};
+const int32_t XKCTRL::LibUSBTransport::USBDriverCount_ = sizeof(USBDrivers_) / sizeof(USBDrivers_[0]);
+
+XKCTRL::LibUSBTransport::LibUSBTransport()
+  : Running_(true)
+{
+  // every transfer knows which controller it belongs to
+  for (int32_t i = 0; i < MAX_CONTROLLERS; i++)
+  {
+    USBTransferContext_[i] = {this, i};
+    ControllerDevice_[i] = -1;
+  }
+}
+
+XKCTRL::LibUSBTransport::~LibUSBTransport()
+{
+  //close out context, Run released all devices on exit
+  if (USBContext_)
+    libusb_exit(USBContext_);
+}
+
+void XKCTRL::LibUSBTransport::Stop()
+{
+  Running_ = false;
+}
+
+void XKCTRL::LibUSBTransport::USBDeviceScan()
+{
+  // Find all supported devices that are not open yet
+  libusb_device** devices = nullptr;
+  ssize_t count = libusb_get_device_list(USBContext_, &devices);
+  if (count < 0)
+    throw std::runtime_error(libusb_strerror(static_cast<libusb_error>(count)));
+
+  int32_t failed = 0;
+
+  for (ssize_t i = 0; i < count; i++)
+  {
+    libusb_device_descriptor descriptor;
+    if (libusb_get_device_descriptor(devices[i], &descriptor) != LIBUSB_SUCCESS)
+      continue;
+
+    const USBDriver* driver = nullptr;
+    for (int32_t d = 0; d < USBDriverCount_ && !driver; d++)
+    {
+      if (descriptor.idVendor == USBDrivers_[d].VendorID && descriptor.idProduct == USBDrivers_[d].ProductID)
+        driver = &USBDrivers_[d];
+    }
+    if (!driver)
+      continue;
+
+    // the device slot keeps controller indexes stable per USB port
+    int32_t deviceidx = USBDeviceSlot(devices[i], driver);
+    if (deviceidx < 0 || USBDevices_[deviceidx].DeviceHandle)
+      continue;
+
+    try
+    {
+      USBDeviceInit(deviceidx, devices[i]);
+      LogWrite(LOG_INFO, "%s Connected, Controllers %d-%d", driver->Name, USBDevices_[deviceidx].FirstController,
+               USBDevices_[deviceidx].FirstController + driver->Controllers - 1);
+
+      // how long it took to get the device going
+      auto now = std::chrono::steady_clock::now();
+      uint64_t attach_us = std::chrono::duration_cast<std::chrono::microseconds>(now - USBArrivalTime_).count();
+      uint64_t reconnect_us = std::chrono::duration_cast<std::chrono::microseconds>(now - USBDevices_[deviceidx].LostTime).count();
+      
+      std::lock_guard<std::mutex> guard(mutex_);
+      ReceiverStats_.ATTACHED++;
+      ReceiverStats_.LAST_ATTACH_US = attach_us;
+      ReceiverStats_.MAX_ATTACH_US = std::max(ReceiverStats_.MAX_ATTACH_US, attach_us);
+      if (USBDevices_[deviceidx].LostTime.time_since_epoch().count() != 0)
+        ReceiverStats_.LAST_RECONNECT_US = reconnect_us;
+    }
+    catch(const std::exception& e)
+    {
+      // Could not open this device.. will try again
+      LogWrite(LOG_ERROR, "%s", e.what());
+      USBDeviceRelease(deviceidx);
+      failed++;
+    }
+  }
+
+  libusb_free_device_list(devices, 1);
+
+  // a device often can not be opened right after it arrived, until udev
+  // applied its permissions. Try again shortly, backing off while it keeps failing.
+  if (failed)
+  {
+    USBRetryMS_ = USBRetryMS_ ? std::min(USBRetryMS_ * 2, MAX_USB_RETRY_MS) : MIN_USB_RETRY_MS;
+    USBRetryTime_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(USBRetryMS_);
+    std::lock_guard<std::mutex> guard(mutex_);
+    ReceiverStats_.OPEN_RETRIES += failed;
+  }
+  else
+  {
+    USBRetryMS_ = 0;
+  }
+}
+
+int LIBUSB_CALL XKCTRL::LibUSBTransport::USBHotplugCallback(libusb_context* Context, libusb_device* Device, 
+                                                          libusb_hotplug_event Event, void* UserData)
+{
+  // Runs on the transport thread inside libusb_handle_events, opening devices
+  // is left to the transport thread as soon as event handling returns.
+  LibUSBTransport* transport = static_cast<LibUSBTransport*>(UserData);
+  if (Event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+  {
+    if (!transport->USBScanPending_)
+      transport->USBArrivalTime_ = std::chrono::steady_clock::now();
+    transport->USBScanPending_ = true;
+  }
+  else if (Event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT)
+  {
+    for (auto& device : transport->USBDevices_)
+    {
+      if (device.DeviceHandle && libusb_get_device(device.DeviceHandle) == Device)
+        device.Lost = true;
+    }
+  }
+
+  // stay registered
+  return 0;
+}
+
+bool XKCTRL::LibUSBTransport::USBControllersFree(const int32_t First, const int32_t Count, const bool Reserved)
+{
+  // no open device uses these indexes, with Reserved no device used them before either
+  for (auto& device : USBDevices_)
+  {
+    if (!device.DeviceHandle && !(Reserved && device.Used))
+      continue;
+    if (First < device.FirstController + device.Driver->Controllers && device.FirstController < First + Count)
+      return false;
+  }
+  return true;
+}
+
+int32_t XKCTRL::LibUSBTransport::USBDeviceSlot(libusb_device* Device, const XKCTRL::USBDriver* Driver)
+{
+  uint8_t bus = libusb_get_bus_number(Device);
+  uint8_t path[MAX_USB_PORTPATH];
+  int32_t pathlen = libusb_get_port_numbers(Device, path, MAX_USB_PORTPATH);
+  if (pathlen < 0)
+    pathlen = 0;
+
+  // same kind of device on the same bus and port as before, gets the same controller indexes
+  for (int32_t d = 0; d < MAX_CONTROLLERS; d++)
+  {
+    USBDevice& device = USBDevices_[d];
+    if (device.Used && device.Driver == Driver && device.PortPathLength == pathlen && 
+        device.BusNumber == bus && memcmp(device.PortPath, path, pathlen) == 0)
+      return d;
+  }
+
+  // receivers take aligned blocks from the bottom, wired controllers single
+  // indexes from the top, preferring indexes never used by any other port
+  int32_t count = Driver->Controllers;
+  int32_t first = -1;
+  for (int32_t pass = 0; pass < 2 && first < 0; pass++)
+  {
+    for (int32_t b = 0; b < MAX_CONTROLLERS / count && first < 0; b++)
+    {
+      int32_t candidate = (count > 1) ? b * count : MAX_CONTROLLERS - 1 - b;
+      if (USBControllersFree(candidate, count, pass == 0))
+        first = candidate;
+    }
+  }
+  if (first < 0)
+    return -1;
+
+  // forget the devices that used these indexes before, then take a free slot
+  int32_t freeslot = -1;
+  for (int32_t d = 0; d < MAX_CONTROLLERS; d++)
+  {
+    USBDevice& device = USBDevices_[d];
+    if (device.DeviceHandle)
+      continue;
+    if (device.Used && first < device.FirstController + device.Driver->Controllers && device.FirstController < first + count)
+      device.Used = false;
+    if (!device.Used && freeslot < 0)
+      freeslot = d;
+  }
+  if (freeslot < 0)
+    return -1;
+
+  USBDevice& device = USBDevices_[freeslot];
+  device.Driver = Driver;
+  device.FirstController = first;
+  device.BusNumber = bus;
+  device.PortPathLength = pathlen;
+  memcpy(device.PortPath, path, pathlen);
+  device.Used = true;
+  device.LostTime = std::chrono::steady_clock::time_point();
+  return freeslot;
+}
+
+void XKCTRL::LibUSBTransport::USBDeviceInit(const int32_t DeviceIndex, libusb_device* Device)
+{
+  USBDevice& device = USBDevices_[DeviceIndex];
+  const USBDriver* driver = device.Driver;
+
+  // Open the USB Device
+  int ret = libusb_open(Device, &device.DeviceHandle);
+  if (ret != LIBUSB_SUCCESS)
+  {
+    device.DeviceHandle = nullptr;
+    throw std::runtime_error(libusb_strerror(static_cast<libusb_error>(ret)));
+  }
+
+  // Claim all interfaces for all controllers
+  for (int32_t slot = 0; slot < driver->Controllers; slot++)
+  {
+    int32_t iface = driver->Interfaces[slot];
+
+    // detach from any kernel drivers - requires sudo
+    if (libusb_kernel_driver_active(device.DeviceHandle, iface) == 0x01)
+      libusb_detach_kernel_driver(device.DeviceHandle, iface);
+
+    // claim interface
+    ret = libusb_claim_interface(device.DeviceHandle, iface);
+    if (ret != LIBUSB_SUCCESS)
+      throw std::runtime_error(libusb_strerror(static_cast<libusb_error>(ret)));
+  }
+
+  // Allocate one OUT transfer per controller for the output queue
+  device.Lost = false;
+  int32_t first = device.FirstController;
+  for (int32_t slot = 0; slot < driver->Controllers; slot++)
+  {
+    USBTransfersOut_[first + slot] = libusb_alloc_transfer(0);
+    if (!USBTransfersOut_[first + slot])
+      throw std::runtime_error("Error allocating USB transfer");
+
+    libusb_fill_interrupt_transfer(USBTransfersOut_[first + slot], device.DeviceHandle, driver->EndpointsOut[slot],
+                                   USBDataOut_[first + slot], MAX_USB_OUTBUFF, 
+                                   &LibUSBTransport::USBTXCallback, &USBTransferContext_[first + slot], MAX_USB_TIMEOUT);
+  }
+
+  { // the controllers belong to this device and output can be queued from here on
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int32_t slot = 0; slot < driver->Controllers; slot++)
+      ControllerDevice_[first + slot] = DeviceIndex;
+    device.TXReady = true;
+  }
+
+  // Queue one IN transfer per controller, each one is resubmitted from its
+  // completion callback so there is always a read pending on every endpoint
+  for (int32_t slot = 0; slot < driver->Controllers; slot++)
+  {
+    USBTransfersIn_[first + slot] = libusb_alloc_transfer(0);
+    if (!USBTransfersIn_[first + slot])
+      throw std::runtime_error("Error allocating USB transfer");
+
+    USBErrorsIn_[first + slot] = 0;
+    libusb_fill_interrupt_transfer(USBTransfersIn_[first + slot], device.DeviceHandle, driver->EndpointsIn[slot],
+                                   USBDataIn_[first + slot], MAX_USB_INBUFF, 
+                                   &LibUSBTransport::USBRXCallback, &USBTransferContext_[first + slot], 0);
+    if (!USBRXSubmit(first + slot))
+      throw std::runtime_error("Error submitting USB transfer");
+  }
+
+  // devices without connection reports get one, like a receiver sends when
+  // a controller links up
+  if (driver->AlwaysConnected)
+  {
+    const uint8_t connected[2] = {0x08, 0x80};
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count();
+    for (int32_t slot = 0; slot < driver->Controllers; slot++)
+      Sink_->TransportReport(first + slot, connected, sizeof(connected), timestamp);
+  }
+}
+
+void XKCTRL::LibUSBTransport::USBDeviceRelease(const int32_t DeviceIndex)
+{
+  USBDevice& device = USBDevices_[DeviceIndex];
+  const USBDriver* driver = device.Driver;
+  int32_t first = device.FirstController;
+
+  { // Stop callers from queueing new output transfers
+    std::lock_guard<std::mutex> guard(mutex_);
+    device.TXReady = false;
+  }
+
+  // cancel all queued transfers and let libusb deliver the cancellations
+  for (int32_t i = first; i < first + driver->Controllers; i++)
+  {
+    if (USBTransfersIn_[i])
+      libusb_cancel_transfer(USBTransfersIn_[i]);
+    if (USBTransfersOut_[i])
+      libusb_cancel_transfer(USBTransfersOut_[i]);
+  }
+
+  while (device.TransfersActive > 0)
+  {
+    timeval tv = {0, MAX_USB_TIMEOUT * 1000};
+    libusb_handle_events_timeout_completed(USBContext_, &tv, nullptr);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int32_t i = first; i < first + driver->Controllers; i++)
+    {
+      libusb_free_transfer(USBTransfersIn_[i]);
+      USBTransfersIn_[i] = nullptr;
+      libusb_free_transfer(USBTransfersOut_[i]);
+      USBTransfersOut_[i] = nullptr;
+      ControllerDevice_[i] = -1;
+    }
+  }
+
+  if (device.DeviceHandle)
+  {
+    // attempt to release all interfaces
+    for (int32_t slot = 0; slot < driver->Controllers; slot++)
+      libusb_release_interface(device.DeviceHandle, driver->Interfaces[slot]);
+
+    libusb_close(device.DeviceHandle);
+    device.DeviceHandle = nullptr;
+  }
+  device.Lost = false;
+}
+
+void XKCTRL::LibUSBTransport::USBDeviceDetach(const int32_t DeviceIndex)
+{
+  //release transfers, interfaces and device, then clear its controllers
+  USBDevice& device = USBDevices_[DeviceIndex];
+  USBDeviceRelease(DeviceIndex);
+  Sink_->TransportDetached(device.FirstController, device.Driver->Controllers);
+}
+
+bool XKCTRL::LibUSBTransport::USBRXSubmit(const int32_t ControllerIndex)
+{
+  USBDevice& device = USBDevices_[ControllerDevice_[ControllerIndex]];
+
+  device.TransfersActive++;
+  int32_t ret = libusb_submit_transfer(USBTransfersIn_[ControllerIndex]);
+  if (ret != LIBUSB_SUCCESS)
+  {
+    device.TransfersActive--;
+    if (ret == LIBUSB_ERROR_NO_DEVICE)
+      device.Lost = true;
+  }
+
+  return (ret == LIBUSB_SUCCESS);
+}
+
+void LIBUSB_CALL XKCTRL::LibUSBTransport::USBRXCallback(libusb_transfer* Transfer)
+{
+  // All transfers are asynchronous, so callbacks only ever run on the
+  // transport thread inside libusb_handle_events.
+  USBTransferContext* context = static_cast<USBTransferContext*>(Transfer->user_data);
+  LibUSBTransport* transport = context->Owner;
+  int32_t controlleridx = context->ControllerIndex;
+  USBDevice& device = transport->USBDevices_[transport->ControllerDevice_[controlleridx]];
+  device.TransfersActive--;
+
+  switch (Transfer->status)
+  {
+    case LIBUSB_TRANSFER_COMPLETED:
+    {
+      uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch()).count();
+
+      // reports reach the sink in the wireless receiver's format
+      const uint8_t* report = Transfer->buffer;
+      size_t length = Transfer->actual_length;
+      uint8_t translated[MAX_USB_INBUFF];
+      if (device.Driver->TranslateIn)
+      {
+        length = device.Driver->TranslateIn(report, length, translated);
+        report = translated;
+      }
+      if (length)
+        transport->Sink_->TransportReport(controlleridx, report, length, timestamp);
+      transport->USBErrorsIn_[controlleridx] = 0;
+      break;
+    }
+
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      device.Lost = true;
+      return;
+
+    case LIBUSB_TRANSFER_CANCELLED:
+      return;
+
+    default:
+      // errors, timeouts and overflows are re-queued, a controller that
+      // keeps failing gets its device reopened
+      transport->USBTransferError(true, Transfer->status == LIBUSB_TRANSFER_TIMED_OUT);
+      if (++transport->USBErrorsIn_[controlleridx] >= MAX_USB_RX_ERRORS)
+      {
+        device.Lost = true;
+        return;
+      }
+      break;
+  }
+
+  // re-queue the transfer, a device that takes none is reopened
+  if (transport->Running_ && !device.Lost && !transport->USBRXSubmit(controlleridx))
+    device.Lost = true;
+}
+
+void XKCTRL::LibUSBTransport::USBTransferError(const bool Input, const bool TimedOut)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (TimedOut)
+    (Input ? ReceiverStats_.TIMEOUTS_IN : ReceiverStats_.TIMEOUTS_OUT)++;
+  else
+    (Input ? ReceiverStats_.ERRORS_IN : ReceiverStats_.ERRORS_OUT)++;
+}
+
+bool XKCTRL::LibUSBTransport::Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length)
+{
+  if (ControllerIndex < 0 || ControllerIndex >= MAX_CONTROLLERS || Length > MAX_USB_OUTBUFF)
+    return false;
+
+  //syncronize with devices coming and going
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (ControllerDevice_[ControllerIndex] < 0)
+    return false;
+  USBDevice& device = USBDevices_[ControllerDevice_[ControllerIndex]];
+  if (!device.TXReady || !USBTransfersOut_[ControllerIndex])
+    return false;
+
+  // the driver writes the report in its device's own format
+  memset(USBDataOut_[ControllerIndex], 0x00, MAX_USB_OUTBUFF);
+  if (device.Driver->TranslateOut)
+  {
+    USBTransfersOut_[ControllerIndex]->length = static_cast<int>(device.Driver->TranslateOut(Data, Length, USBDataOut_[ControllerIndex]));
+  }
+  else
+  {
+    memcpy(USBDataOut_[ControllerIndex], Data, Length);
+    USBTransfersOut_[ControllerIndex]->length = MAX_USB_OUTBUFF;
+  }
+
+  device.TransfersActive++;
+  int32_t ret = libusb_submit_transfer(USBTransfersOut_[ControllerIndex]);
+  if (ret != LIBUSB_SUCCESS)
+    device.TransfersActive--;
+  return (ret == LIBUSB_SUCCESS);
+}
+
+void LIBUSB_CALL XKCTRL::LibUSBTransport::USBTXCallback(libusb_transfer* Transfer)
+{
+  USBTransferContext* context = static_cast<USBTransferContext*>(Transfer->user_data);
+  LibUSBTransport* transport = context->Owner;
+  int32_t controlleridx = context->ControllerIndex;
+  USBDevice& device = transport->USBDevices_[transport->ControllerDevice_[controlleridx]];
+  device.TransfersActive--;
+
+  if (Transfer->status == LIBUSB_TRANSFER_NO_DEVICE)
+    device.Lost = true;
+  else if (Transfer->status != LIBUSB_TRANSFER_COMPLETED && Transfer->status != LIBUSB_TRANSFER_CANCELLED)
+    transport->USBTransferError(false, Transfer->status == LIBUSB_TRANSFER_TIMED_OUT);
+
+  transport->Sink_->TransportSent(controlleridx, Transfer->status == LIBUSB_TRANSFER_COMPLETED);
+}
+
+void XKCTRL::LibUSBTransport::Run(XKCTRL::TransportSink* Sink)
+{
+  Sink_ = Sink;
+
+  auto nextscan = std::chrono::steady_clock::now();
+  while (Running_)
+  {
+    // One long lived libusb context services every device
+    if (USBContext_ == nullptr)
+    {
+      int ret = libusb_init(&USBContext_);
+      if (ret != LIBUSB_SUCCESS)
+      {
+        LogWrite(LOG_ERROR, "%s", libusb_strerror(static_cast<libusb_error>(ret)));
+        USBContext_ = nullptr;
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        continue;
+      }
+
+      // get told about devices coming and going instead of polling for them,
+      // every driver's device is from the same vendor
+      USBHotplug_ = libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) &&
+                    libusb_hotplug_register_callback(USBContext_, 
+                      LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                      LIBUSB_HOTPLUG_NO_FLAGS, USBVendorID_, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                      &LibUSBTransport::USBHotplugCallback, this, &USBHotplugHandle_) == LIBUSB_SUCCESS;
+      USBScanPending_ = true;
+      USBArrivalTime_ = std::chrono::steady_clock::now();
+    }
+
+    // Open new devices right after they arrive, or every 500ms 
+    // when hotplug is not supported on this platform. Devices that
+    // failed to open are retried after their backoff either way.
+    auto now = std::chrono::steady_clock::now();
+    if (USBScanPending_ || (!USBHotplug_ && now >= nextscan) || (USBRetryMS_ && now >= USBRetryTime_))
+    {
+      if (!USBHotplug_)
+        USBArrivalTime_ = now;
+      USBScanPending_ = false;
+
+      try
+      {
+        USBDeviceScan();
+      }
+      catch(const std::exception& e)
+      {
+        LogWrite(LOG_ERROR, "ERROR Scanning USB Devices: %s", e.what());
+      }
+      nextscan = now + std::chrono::milliseconds(500);
+    }
+
+    // dispatch completed transfers and hotplug events for all devices,
+    // the timeout only bounds how long we take to notice Stop.
+    timeval tv = {0, MAX_USB_TIMEOUT * 1000};
+    libusb_handle_events_timeout_completed(USBContext_, &tv, nullptr);
+
+    for (int32_t d = 0; d < MAX_CONTROLLERS; d++)
+    {
+      USBDevice& device = USBDevices_[d];
+      if (!device.DeviceHandle || !device.Lost)
+        continue;
+
+      //Device was disconnected..
+      LogWrite(LOG_INFO, "%s Disconnected, Controllers %d-%d", device.Driver->Name, device.FirstController,
+               device.FirstController + device.Driver->Controllers - 1);
+      device.LostTime = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        ReceiverStats_.DETACHED++;
+      }
+      USBDeviceDetach(d);
+
+      // a device lost to transfer errors is still plugged in, hotplug
+      // will not announce it again
+      USBScanPending_ = true;
+    }
+  } //end while polling
+
+  for (int32_t d = 0; d < MAX_CONTROLLERS; d++)
+  {
+    if (USBDevices_[d].DeviceHandle)
+      USBDeviceDetach(d);
+  }
+
+  if (USBHotplug_)
+    libusb_hotplug_deregister_callback(USBContext_, USBHotplugHandle_);
+  USBHotplug_ = false;
+}
+
+void XKCTRL::LibUSBTransport::GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  ReceiverStats = ReceiverStats_;
+}
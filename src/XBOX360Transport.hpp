@@ -0,0 +1,275 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_TRANSPORT_
+#define _XBOX360_TRANSPORT_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+// requires "libusb-1.0-0-dev"
+// link against "usb-1.0"
+#include <libusb-1.0/libusb.h>
+
+#include "XBOX360Defines.hpp"
+
+namespace XKCTRL
+{
+  // Receives everything a transport delivers. All calls are made on the
+  // thread running Transport::Run.
+  class TransportSink
+  {
+    public:
+      virtual ~TransportSink() {}
+
+      // raw report from a controller IN endpoint, timestamped at transfer completion
+      virtual void TransportReport(const int32_t ControllerIndex, const uint8_t* Report,
+                                   const size_t Length, const uint64_t TimestampNS) = 0;
+      // an output report queued with Transport::Send finished
+      virtual void TransportSent(const int32_t ControllerIndex, const bool Success) = 0;
+      // the device serving a range of controllers went away
+      virtual void TransportDetached(const int32_t FirstController, const int32_t ControllerCount) = 0;
+  };
+
+  // Moves raw reports between controllers and XBOX360
+  class Transport
+  {
+    public:
+      virtual ~Transport() {}
+
+      // runs the transport until Stop is called, on the calling thread.
+      // Stop may come before Run has started, Run then returns right away.
+      virtual void Run(TransportSink* Sink) = 0;
+      virtual void Stop() = 0;
+
+      // queue one output report for a controller, safe from any thread.
+      // returns false if it could not be queued, TransportSent follows otherwise.
+      virtual bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) = 0;
+
+      virtual void GetReceiverStats(RECEIVER_STATS& ReceiverStats) = 0;
+  };
+
+  // How one kind of USB device is driven. Every driver translates its
+  // reports to and from the wireless receiver's format, so XBOX360 sees the
+  // same reports no matter which device a controller is on.
+  struct USBDriver
+  {
+    const char* Name;
+    uint16_t VendorID;
+    uint16_t ProductID;
+    // controllers served by one device, one interface and IN/OUT endpoint pair each
+    int32_t Controllers;
+    int32_t Interfaces[RECEIVER_CONTROLLERS];
+    uint8_t EndpointsIn[RECEIVER_CONTROLLERS];
+    uint8_t EndpointsOut[RECEIVER_CONTROLLERS];
+    // report as the receiver would have sent it, returns its length or 0 to
+    // drop it. nullptr passes reports through unchanged.
+    size_t (*TranslateIn)(const uint8_t* Report, const size_t Length, uint8_t* Translated);
+    // output report in the device's own format, returns its length
+    size_t (*TranslateOut)(const uint8_t* Data, const size_t Length, uint8_t* Translated);
+    // the device has no connection reports, its controller is connected while it is plugged in
+    bool AlwaysConnected;
+  };
+
+  // XBOX 360 Wireless Receivers and wired controllers on USB through libusb.
+  // One context and the thread running Run serve every device, each
+  // controller costs one always queued IN transfer and one OUT transfer.
+  class LibUSBTransport : public Transport
+  {
+    public:
+      LibUSBTransport();
+      ~LibUSBTransport();
+
+      void Run(TransportSink* Sink) override;
+      void Stop() override;
+      bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) override;
+      void GetReceiverStats(RECEIVER_STATS& ReceiverStats) override;
+
+    private:
+      // Wireless receivers take a block of RECEIVER_CONTROLLERS indexes from
+      // the bottom, wired controllers single indexes from the top
+      static const USBDriver USBDrivers_[];
+      static const int32_t USBDriverCount_;
+      const uint16_t USBVendorID_ = 0x045E;
+
+      // one libusb context shared by all devices
+      libusb_context* USBContext_ = nullptr;
+      TransportSink* Sink_ = nullptr;
+      std::atomic<bool> Running_;
+
+      // device arrival/removal is reported by libusb hotplug where supported,
+      // otherwise the transport falls back to scanning every 500ms
+      bool USBHotplug_ = false;
+      libusb_hotplug_callback_handle USBHotplugHandle_;
+      bool USBScanPending_ = true;
+      std::chrono::steady_clock::time_point USBArrivalTime_;
+      // rescan for devices that failed to open, hotplug will not announce them again
+      int32_t USBRetryMS_ = 0;
+      std::chrono::steady_clock::time_point USBRetryTime_;
+      RECEIVER_STATS ReceiverStats_ = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+      // Open devices, a slot remembers the port and controller indexes it
+      // was used for so a replugged device keeps its indexes
+      struct USBDevice
+      {
+        libusb_device_handle* DeviceHandle = nullptr;
+        const USBDriver* Driver = nullptr;
+        int32_t FirstController = 0;
+        uint8_t BusNumber = 0;
+        uint8_t PortPath[MAX_USB_PORTPATH] = {0};
+        int32_t PortPathLength = 0;
+        bool Used = false;
+        bool Lost = false;
+        bool TXReady = false;
+        std::atomic<int32_t> TransfersActive{0};
+        std::chrono::steady_clock::time_point LostTime;
+      };
+      USBDevice USBDevices_[MAX_CONTROLLERS];
+
+      // device slot serving each controller, -1 if none. Written on the
+      // transport thread under mutex_, transfer callbacks read it unlocked.
+      int32_t ControllerDevice_[MAX_CONTROLLERS];
+
+      // transfer callbacks find their controller through user_data
+      struct USBTransferContext
+      {
+        LibUSBTransport* Owner;
+        int32_t ControllerIndex;
+      };
+      USBTransferContext USBTransferContext_[MAX_CONTROLLERS];
+
+      // One always-queued async IN transfer and one OUT transfer per controller
+      libusb_transfer* USBTransfersIn_[MAX_CONTROLLERS] = {nullptr};
+      libusb_transfer* USBTransfersOut_[MAX_CONTROLLERS] = {nullptr};
+      uint8_t USBDataIn_[MAX_CONTROLLERS][MAX_USB_INBUFF];
+      // IN transfers failed in a row per controller, transport thread only
+      int32_t USBErrorsIn_[MAX_CONTROLLERS] = {0};
+      uint8_t USBDataOut_[MAX_CONTROLLERS][MAX_USB_OUTBUFF];
+
+      //Protection of device output state and stats
+      std::mutex mutex_;
+
+      void    USBDeviceScan();
+      static int LIBUSB_CALL USBHotplugCallback(libusb_context* Context, libusb_device* Device,
+                                                libusb_hotplug_event Event, void* UserData);
+      int32_t USBDeviceSlot(libusb_device* Device, const USBDriver* Driver);
+      bool    USBControllersFree(const int32_t First, const int32_t Count, const bool Reserved);
+      void    USBDeviceInit(const int32_t DeviceIndex, libusb_device* Device);
+      void    USBDeviceRelease(const int32_t DeviceIndex);
+      void    USBDeviceDetach(const int32_t DeviceIndex);
+      bool    USBRXSubmit(const int32_t ControllerIndex);
+      static void LIBUSB_CALL USBRXCallback(libusb_transfer* Transfer);
+      static void LIBUSB_CALL USBTXCallback(libusb_transfer* Transfer);
+      void    USBTransferError(const bool Input, const bool TimedOut);
+  };
+
+  // Capture file layout, a header followed by fixed size records
+  struct CAPTURE_HEADER
+  {
+    char     MAGIC[8];
+    uint32_t VERSION;
+    uint32_t RECORD_SIZE;
+  };
+
+  enum CAPTURE_RECORD_TYPE
+  {
+    CAPTURE_REPORT = 0x00,
+    CAPTURE_DETACHED = 0x01
+  };
+
+  struct CAPTURE_RECORD
+  {
+    // steady clock time the report arrived, in nanoseconds
+    uint64_t TIMESTAMP_NS;
+    int32_t  CONTROLLER;
+    // CAPTURE_RECORD_TYPE, for CAPTURE_DETACHED LENGTH holds the controller count
+    uint8_t  TYPE;
+    uint8_t  LENGTH;
+    uint16_t RESERVED;
+    uint8_t  DATA[MAX_USB_INBUFF];
+  };
+
+  // Wraps another transport and appends every report it delivers to a capture file
+  class RecordTransport : public Transport, private TransportSink
+  {
+    public:
+      RecordTransport(std::unique_ptr<Transport> Inner, const std::string& CaptureFile);
+      ~RecordTransport();
+
+      void Run(TransportSink* Sink) override;
+      void Stop() override;
+      bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) override;
+      void GetReceiverStats(RECEIVER_STATS& ReceiverStats) override;
+
+    private:
+      std::unique_ptr<Transport> Inner_;
+      TransportSink* Sink_ = nullptr;
+      FILE* CaptureFile_ = nullptr;
+
+      void TransportReport(const int32_t ControllerIndex, const uint8_t* Report,
+                           const size_t Length, const uint64_t TimestampNS) override;
+      void TransportSent(const int32_t ControllerIndex, const bool Success) override;
+      void TransportDetached(const int32_t FirstController, const int32_t ControllerCount) override;
+      void CaptureWrite(const CAPTURE_RECORD& Record);
+  };
+
+  // Plays a capture file back, output reports always succeed
+  class ReplayTransport : public Transport
+  {
+    public:
+      enum ReplaySpeed
+      {
+        ORIGINAL,     // original report timing
+        ACCELERATED,  // original timing divided by the speed factor
+        MAXIMUM       // as fast as reports can be processed
+      };
+
+      ReplayTransport(const std::string& CaptureFile, const ReplaySpeed Speed = ORIGINAL, const double SpeedFactor = 1.0);
+      ~ReplayTransport();
+
+      void Run(TransportSink* Sink) override;
+      void Stop() override;
+      bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) override;
+      void GetReceiverStats(RECEIVER_STATS& ReceiverStats) override;
+
+      // true once every record was delivered
+      bool Finished() const { return Finished_; }
+
+    private:
+      const uint8_t* Capture_ = nullptr;
+      size_t CaptureSize_ = 0;
+      ReplaySpeed Speed_;
+      double SpeedFactor_;
+      std::atomic<bool> Running_;
+      std::atomic<bool> Finished_;
+
+      // completions for Send, delivered from the replay thread
+      std::atomic<uint64_t> SentPending_[(MAX_CONTROLLERS + 63) / 64];
+
+      void ReplaySent(TransportSink* Sink);
+  };
+}
+
+#endif //_XBOX360_TRANSPORT_
@@ -0,0 +1,74 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _XBOX360_WAITER_
+#define _XBOX360_WAITER_
+
+#include <stdint.h>
+#include <atomic>
+
+#include "XBOX360Defines.hpp"
+#include "XBOX360Timer.hpp"
+
+namespace XKCTRL
+{
+  enum WAIT_RESULT
+  {
+    WAIT_PENDING = 0x00,
+    WAIT_READY = 0x01,
+    WAIT_TIMEOUT = 0x02,
+    WAIT_CANCELLED = 0x03,
+    // the controller went away while waiting for an event
+    WAIT_DISCONNECTED = 0x04
+  };
+
+  // One asynchronous wait without a thread behind it, see XBOX360::WaitAsync.
+  // The caller owns the memory and fills in the request, Complete is called
+  // exactly once with the outcome and the waiter is not touched after that.
+  // Complete runs on the device thread, the timer thread or the cancelling
+  // thread, so it should only hand the waiter on, never block.
+  struct ControllerWaiter
+  {
+    // request
+    int32_t Controller = 0;
+    // wait for an event pressing or releasing any of these BUTTON_MASK bits
+    // or changing any of these AXIS_MASK bits, both 0 waits for any new state
+    uint16_t Buttons = 0;
+    uint8_t Axes = 0;
+    // 0 waits forever, for RumbleAsync the rumble time
+    uint32_t TimeoutMS = 0;
+    void (*Complete)(ControllerWaiter* Waiter) = nullptr;
+    void* Context = nullptr;
+
+    // outcome, valid in Complete
+    std::atomic<int32_t> Result{WAIT_PENDING};
+    CONTROLLER_PACKED_STATE State = {};
+    CONTROLLER_EVENT Event = {};
+
+    // owned by XBOX360 while the wait is pending
+    ControllerWaiter* Next = nullptr;
+    ControllerWaiter* Prev = nullptr;
+    TimerWheel::TimerID Timer = TimerWheel::INVALID_TIMER;
+    std::atomic<int32_t> References{0};
+    bool Rumble = false;
+    uint32_t RumbleGeneration = 0;
+  };
+}
+
+#endif //_XBOX360_WAITER_
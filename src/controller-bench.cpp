@@ -0,0 +1,1283 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Benchmarks for the controller API, driven by a synthetic in-process
+// transport so no hardware is needed. Results are written as JSON.
+//   usage: controller-bench [output.json]
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <new>
+
+#include "XBOX360.hpp"
+#include "XBOX360Decode.hpp"
+#include "XBOX360Report.hpp"
+#include "XBOX360Shared.hpp"
+#include "XBOX360Bridge.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Every heap allocation in the process is counted, the steady state check
+// expects none while reports flow
+static std::atomic<uint64_t> Allocations(0);
+
+void* operator new(size_t Size)
+{
+  Allocations.fetch_add(1, std::memory_order_relaxed);
+  void* memory = malloc(Size ? Size : 1);
+  if (!memory)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new(size_t Size, std::align_val_t Alignment)
+{
+  Allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t alignment = static_cast<size_t>(Alignment);
+  void* memory = aligned_alloc(alignment, (Size + alignment - 1) / alignment * alignment);
+  if (!memory)
+    throw std::bad_alloc();
+  return memory;
+}
+
+// gcc can not tell these pair with the replaced operator new above
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* Memory) noexcept { free(Memory); }
+void operator delete(void* Memory, size_t) noexcept { free(Memory); }
+void operator delete(void* Memory, std::align_val_t) noexcept { free(Memory); }
+void operator delete(void* Memory, size_t, std::align_val_t) noexcept { free(Memory); }
+#pragma GCC diagnostic pop
+
+// set by checks that failed, the bench then exits with an error
+static bool BenchFailed = false;
+
+static uint64_t NowNS()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Generates wireless receiver reports for a number of controllers, every
+// report changes the controller state. Output reports complete right away.
+class SyntheticTransport : public XKCTRL::Transport
+{
+  public:
+    // IntervalNS between report rounds, 0 runs as fast as possible.
+    // MaxReports stops generating after that many reports, 0 never stops.
+    SyntheticTransport(const int32_t Controllers, const uint64_t IntervalNS, const uint64_t MaxReports = 0)
+      : Controllers_(std::min(Controllers, static_cast<int32_t>(MAX_CONTROLLERS))),
+        IntervalNS_(IntervalNS),
+        MaxReports_(MaxReports),
+        Running_(true),
+        Finished_(false),
+        Reports_(0),
+        Sent_(0)
+    {
+      for (auto& pending : SentPending_)
+        pending = 0;
+    }
+
+    void Run(XKCTRL::TransportSink* Sink) override
+    {
+      uint8_t report[MAX_USB_INBUFF] = {0x00};
+
+      // connect every controller first
+      for (int32_t c = 0; c < Controllers_; c++)
+      {
+        report[0] = 0x08;
+        report[1] = 0x80;
+        Sink->TransportReport(c, report, 2, NowNS());
+      }
+
+      memset(report, 0x00, MAX_USB_INBUFF);
+      report[1] = 0x01;
+      report[3] = 0xF0;
+      report[5] = 0x13;
+
+      uint64_t count = 0;
+      uint64_t round = 0;
+      auto due = Clock::now();
+      while (Running_ && (MaxReports_ == 0 || count < MaxReports_))
+      {
+        for (int32_t c = 0; c < Controllers_; c++)
+        {
+          // toggle A and move the left stick on every report
+          uint16_t buttons = (round & 0x01) ? XKCTRL::MASK_BTN_A : 0x0000;
+          int16_t stick = static_cast<int16_t>(count * 7);
+          memcpy(&report[REPORT_LAYOUT_OFFSET], &buttons, sizeof(buttons));
+          memcpy(&report[REPORT_LAYOUT_OFFSET + 4], &stick, sizeof(stick));
+          Sink->TransportReport(c, report, 29, NowNS());
+          count++;
+        }
+        Reports_.store(count, std::memory_order_relaxed);
+        round++;
+        Complete(Sink);
+
+        if (IntervalNS_)
+        {
+          due += std::chrono::nanoseconds(IntervalNS_);
+          std::this_thread::sleep_until(due);
+        }
+      }
+      Finished_ = true;
+
+      while (Running_)
+      {
+        Complete(Sink);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+      Complete(Sink);
+    }
+
+    void Stop() override
+    {
+      Running_ = false;
+    }
+
+    bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) override
+    {
+      if (ControllerIndex < 0 || ControllerIndex >= MAX_CONTROLLERS)
+        return false;
+      // remember the last rumble weights that went out
+      if (Length > 6 && Data[1] == 0x01 && Data[2] == 0x0f && Data[3] == 0xc0)
+        LastRumble_[ControllerIndex].store((Data[5] << 8) | Data[6], std::memory_order_relaxed);
+      SentPending_[ControllerIndex / 64].fetch_or(1ULL << (ControllerIndex % 64));
+      Sent_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+
+    void GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats) override
+    {
+      ReceiverStats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    bool Finished() const { return Finished_; }
+    uint64_t Reports() const { return Reports_.load(std::memory_order_relaxed); }
+    uint64_t Sent() const { return Sent_.load(std::memory_order_relaxed); }
+    uint16_t LastRumble(const int32_t ControllerIndex) const { return LastRumble_[ControllerIndex].load(std::memory_order_relaxed); }
+
+  private:
+    int32_t Controllers_;
+    uint64_t IntervalNS_;
+    uint64_t MaxReports_;
+    std::atomic<bool> Running_;
+    std::atomic<bool> Finished_;
+    std::atomic<uint64_t> Reports_;
+    std::atomic<uint64_t> Sent_;
+    std::atomic<uint64_t> SentPending_[(MAX_CONTROLLERS + 63) / 64];
+    std::atomic<uint16_t> LastRumble_[MAX_CONTROLLERS] = {};
+
+    void Complete(XKCTRL::TransportSink* Sink)
+    {
+      for (int32_t word = 0; word < (MAX_CONTROLLERS + 63) / 64; word++)
+      {
+        uint64_t pending = SentPending_[word].exchange(0);
+        while (pending)
+        {
+          int32_t bit = __builtin_ctzll(pending);
+          pending &= pending - 1;
+          Sink->TransportSent(word * 64 + bit, true);
+        }
+      }
+    }
+};
+
+// Minimal JSON output, one object per benchmark
+class BenchResults
+{
+  public:
+    void Begin(const std::string& Name)
+    {
+      out_ << (first_ ? "" : ",\n") << "  \"" << Name << "\": {";
+      first_ = false;
+      firstfield_ = true;
+    }
+
+    template <typename T>
+    void Field(const std::string& Name, const T Value)
+    {
+      out_ << (firstfield_ ? "" : ", ") << "\"" << Name << "\": " << Value;
+      firstfield_ = false;
+    }
+
+    void Percentiles(const std::string& Prefix, std::vector<uint64_t>& Samples)
+    {
+      if (Samples.empty())
+        return;
+      std::sort(Samples.begin(), Samples.end());
+      Field(Prefix + "_p50", Samples[Samples.size() * 50 / 100]);
+      Field(Prefix + "_p90", Samples[Samples.size() * 90 / 100]);
+      Field(Prefix + "_p99", Samples[Samples.size() * 99 / 100]);
+      Field(Prefix + "_p999", Samples[Samples.size() * 999 / 1000]);
+      Field(Prefix + "_max", Samples.back());
+    }
+
+    void End()
+    {
+      out_ << "}";
+    }
+
+    std::string Json()
+    {
+      return "{\n" + out_.str() + "\n}\n";
+    }
+
+  private:
+    std::ostringstream out_;
+    bool first_ = true;
+    bool firstfield_ = true;
+};
+
+static double Seconds(const Clock::time_point Start)
+{
+  return std::chrono::duration<double>(Clock::now() - Start).count();
+}
+
+static double CPUSeconds()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// DecodeReport and DecodeReports on prebuilt reports, then the full
+// ControllerDataProcessing path fed by the synthetic transport.
+static void BenchDecode(BenchResults& Results)
+{
+  const size_t count = 4096;
+  const int32_t rounds = 2000;
+  std::vector<uint8_t> reports(count * MAX_USB_INBUFF, 0x00);
+  for (size_t i = 0; i < reports.size(); i++)
+    reports[i] = static_cast<uint8_t>(i * 31);
+  std::vector<XKCTRL::CONTROLLER_PACKED_STATE> states(count);
+
+  Results.Begin("decode");
+  auto start = Clock::now();
+  for (int32_t r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < count; i++)
+      XKCTRL::DecodeReport(&reports[i * MAX_USB_INBUFF], true, states[i]);
+    asm volatile("" : : "r"(states.data()) : "memory");
+  }
+  Results.Field("scalar_reports_per_sec", static_cast<uint64_t>(count * rounds / Seconds(start)));
+
+  start = Clock::now();
+  for (int32_t r = 0; r < rounds; r++)
+  {
+    XKCTRL::DecodeReports(reports.data(), MAX_USB_INBUFF, states.data(), count);
+    asm volatile("" : : "r"(states.data()) : "memory");
+  }
+  Results.Field("batch_reports_per_sec", static_cast<uint64_t>(count * rounds / Seconds(start)));
+
+  // the whole input path: decode, events, seqlock publish and notify
+  const uint64_t pipelinereports = 1000000;
+  SyntheticTransport* transport = new SyntheticTransport(4, 0, pipelinereports);
+  start = Clock::now();
+  {
+    std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+    while (!transport->Finished())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Results.Field("processing_reports_per_sec", static_cast<uint64_t>(transport->Reports() / Seconds(start)));
+  }
+  Results.End();
+}
+
+static uint64_t BenchRandom(uint64_t& Seed)
+{
+  Seed ^= Seed << 13;
+  Seed ^= Seed >> 7;
+  Seed ^= Seed << 17;
+  return Seed;
+}
+
+// The hand coded checks ControllerDataProcessing used before ParseReport
+static XKCTRL::REPORT_TYPE LegacyClassify(const uint8_t* Report)
+{
+  if (Report[0] == 0x08)
+    return XKCTRL::REPORT_LINK;
+  if (Report[0] == 0x00 && Report[1] == 0x01 && Report[3] == 0xF0 && Report[5] == 0x13)
+    return XKCTRL::REPORT_INPUT;
+  return XKCTRL::REPORT_UNKNOWN;
+}
+
+// ParseReport against the hand coded checks plus DecodeReport on a mix of
+// report types, then random and mutated reports of every length. Any
+// mismatch with the old decoder or a report type out of range is counted.
+static void BenchParser(BenchResults& Results)
+{
+  const size_t count = 4096;
+  const int32_t rounds = 2000;
+  const uint8_t headers[][6] = {{0x00, 0x01, 0x00, 0xF0, 0x00, 0x13}, {0x08, 0x80, 0x00, 0x00, 0x00, 0x00},
+                                {0x00, 0x00, 0x00, 0x13, 0x00, 0x00}, {0x00, 0x02, 0x00, 0xF0, 0x00, 0x00},
+                                {0x00, 0x0F, 0x00, 0xF0, 0x00, 0x00}, {0x00, 0x00, 0x00, 0xF8, 0x00, 0x00}};
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+  std::vector<uint8_t> reports(count * MAX_USB_INBUFF);
+  for (size_t i = 0; i < count; i++)
+  {
+    uint8_t* report = &reports[i * MAX_USB_INBUFF];
+    for (size_t b = 0; b < MAX_USB_INBUFF; b++)
+      report[b] = static_cast<uint8_t>(BenchRandom(seed));
+    // three in four reports are input, like a receiver under load
+    memcpy(report, headers[(i % 4) ? 0 : (i / 4) % 6], 6);
+  }
+  std::vector<XKCTRL::CONTROLLER_PACKED_STATE> states(count);
+  std::vector<XKCTRL::RECEIVER_REPORT> parsed(count);
+
+  Results.Begin("parser");
+  auto start = Clock::now();
+  for (int32_t r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      if (LegacyClassify(&reports[i * MAX_USB_INBUFF]) == XKCTRL::REPORT_INPUT)
+        XKCTRL::DecodeReport(&reports[i * MAX_USB_INBUFF], true, states[i]);
+    }
+    asm volatile("" : : "r"(states.data()) : "memory");
+  }
+  Results.Field("legacy_reports_per_sec", static_cast<uint64_t>(count * rounds / Seconds(start)));
+
+  start = Clock::now();
+  for (int32_t r = 0; r < rounds; r++)
+  {
+    for (size_t i = 0; i < count; i++)
+      XKCTRL::ParseReport(&reports[i * MAX_USB_INBUFF], MAX_USB_INBUFF, parsed[i]);
+    asm volatile("" : : "r"(parsed.data()) : "memory");
+  }
+  Results.Field("table_reports_per_sec", static_cast<uint64_t>(count * rounds / Seconds(start)));
+
+  // fuzz, every length from 0 to a full report with the buffer cut exactly
+  // there, half of them starting with a valid header
+  const uint64_t cases = 2000000;
+  uint64_t types[XKCTRL::REPORT_TYPES] = {0};
+  uint64_t mismatches = 0;
+  uint8_t buffer[MAX_USB_INBUFF];
+  for (uint64_t c = 0; c < cases; c++)
+  {
+    size_t length = BenchRandom(seed) % (MAX_USB_INBUFF + 1);
+    for (size_t b = 0; b < MAX_USB_INBUFF; b++)
+      buffer[b] = static_cast<uint8_t>(BenchRandom(seed));
+    if (c % 2)
+      memcpy(buffer, headers[BenchRandom(seed) % 6], 6);
+    std::vector<uint8_t> exact(buffer, buffer + length);
+
+    XKCTRL::RECEIVER_REPORT report;
+    XKCTRL::REPORT_TYPE type = XKCTRL::ParseReport(exact.data(), exact.size(), report);
+    if (type >= XKCTRL::REPORT_TYPES || type != report.TYPE)
+    {
+      mismatches++;
+      continue;
+    }
+    types[type]++;
+
+    if (length == MAX_USB_INBUFF)
+    {
+      XKCTRL::REPORT_TYPE legacy = LegacyClassify(buffer);
+      if ((legacy != XKCTRL::REPORT_UNKNOWN && legacy != type) ||
+          (legacy == XKCTRL::REPORT_UNKNOWN && (type == XKCTRL::REPORT_LINK || type == XKCTRL::REPORT_INPUT)))
+        mismatches++;
+      XKCTRL::CONTROLLER_PACKED_STATE state;
+      XKCTRL::DecodeReport(buffer, true, state);
+      if (type == XKCTRL::REPORT_INPUT && memcmp(&state, &report.INPUT, sizeof(state)) != 0)
+        mismatches++;
+    }
+  }
+  Results.Field("fuzz_cases", cases);
+  Results.Field("fuzz_mismatches", mismatches);
+  Results.Field("fuzz_unknown", types[XKCTRL::REPORT_UNKNOWN]);
+  Results.Field("fuzz_link", types[XKCTRL::REPORT_LINK]);
+  Results.Field("fuzz_input", types[XKCTRL::REPORT_INPUT]);
+  Results.Field("fuzz_announce", types[XKCTRL::REPORT_ANNOUNCE]);
+  Results.Field("fuzz_battery", types[XKCTRL::REPORT_BATTERY]);
+  Results.Field("fuzz_chatpad", types[XKCTRL::REPORT_CHATPAD]);
+  Results.End();
+
+  if (mismatches)
+  {
+    std::cerr << "ERROR: table parser disagrees with the hand coded checks on " << mismatches << " reports" << '\n';
+    BenchFailed = true;
+  }
+}
+
+// Analog pipeline on its own, with and without smoothing
+static void BenchAnalog(BenchResults& Results)
+{
+  const int32_t reports = 2000000;
+  XKCTRL::ANALOG_CONFIG config = XKCTRL::DefaultAnalogConfig();
+  config.LSTICK.CURVE = 1.8f;
+
+  Results.Begin("analog_pipeline");
+  for (bool filter : {false, true})
+  {
+    config.FILTER.ENABLED = filter;
+    XKCTRL::AnalogPipeline pipeline(config);
+    XKCTRL::CONTROLLER_PACKED_STATE state;
+    memset(&state, 0x00, sizeof(state));
+    XKCTRL::ANALOG_STATE analog;
+
+    auto start = Clock::now();
+    for (int32_t i = 0; i < reports; i++)
+    {
+      state.LSTICK_X = static_cast<int16_t>(i * 7);
+      state.RSTICK_Y = static_cast<int16_t>(i * 13);
+      state.LTRIG = static_cast<uint8_t>(i);
+      pipeline.Process(state, 1000000ULL * (i + 1), analog);
+      asm volatile("" : : "r"(&analog) : "memory");
+    }
+    Results.Field(filter ? "filtered_reports_per_sec" : "reports_per_sec", static_cast<uint64_t>(reports / Seconds(start)));
+  }
+  Results.End();
+}
+
+// Combo recognition with a few hundred registered combos, fed one press per
+// report. Work per press should not grow with the number of combos.
+static void BenchCombos(BenchResults& Results)
+{
+  static const uint16_t buttons[] = {XKCTRL::MASK_BTN_A, XKCTRL::MASK_BTN_B, XKCTRL::MASK_BTN_X, XKCTRL::MASK_BTN_Y,
+                                     XKCTRL::MASK_DPAD_UP, XKCTRL::MASK_DPAD_DOWN, XKCTRL::MASK_DPAD_LEFT, XKCTRL::MASK_DPAD_RIGHT};
+  const int32_t presses = 2000000;
+
+  for (int32_t count : {16, 256, 1024})
+  {
+    uint32_t seed = 12345;
+    XKCTRL::ComboPatterns patterns;
+    while (static_cast<int32_t>(patterns.Count()) < count)
+    {
+      std::vector<XKCTRL::COMBO_STEP> steps;
+      seed = seed * 1103515245 + 12345;
+      int32_t length = 2 + (seed >> 16) % 4;
+      for (int32_t s = 0; s < length; s++)
+      {
+        seed = seed * 1103515245 + 12345;
+        uint16_t held = ((seed >> 16) & 0x01) ? (XKCTRL::MASK_BTN_LB | XKCTRL::MASK_BTN_RB) : 0x0000;
+        steps.push_back({static_cast<uint16_t>(held | buttons[(seed >> 20) % 8]), 200});
+      }
+      patterns.Add(steps);
+    }
+
+    auto start = Clock::now();
+    std::shared_ptr<const XKCTRL::ComboMachine> machine = patterns.Compile();
+    double compilems = Seconds(start) * 1e3;
+
+    XKCTRL::ComboMachine::ComboCursor cursor;
+    uint64_t matches = 0;
+    start = Clock::now();
+    for (int32_t i = 0; i < presses; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      uint16_t held = ((seed >> 16) & 0x01) ? (XKCTRL::MASK_BTN_LB | XKCTRL::MASK_BTN_RB) : 0x0000;
+      uint16_t pressed = buttons[(seed >> 20) % 8];
+      machine->Advance(cursor, pressed, held | pressed, 50000000ULL * (i + 1), [&](const int32_t)
+      {
+        matches++;
+      });
+    }
+    double elapsed = Seconds(start);
+
+    Results.Begin("combos_" + std::to_string(count));
+    Results.Field("combos", count);
+    Results.Field("states", machine->States());
+    Results.Field("symbols", machine->Symbols());
+    Results.Field("compile_ms", compilems);
+    Results.Field("presses_per_sec", static_cast<uint64_t>(presses / elapsed));
+    Results.Field("matches", matches);
+    Results.End();
+  }
+}
+
+// GetControllerState and GetWaitControllerState with 1-32 readers while
+// the synthetic transport publishes as fast as it can
+static void BenchReaders(BenchResults& Results)
+{
+  const auto duration = std::chrono::milliseconds(300);
+  for (int32_t readers : {1, 2, 4, 8, 16, 32})
+  {
+    for (bool wait : {false, true})
+    {
+      SyntheticTransport* transport = new SyntheticTransport(4, 0);
+      std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+
+      std::atomic<bool> running(true);
+      std::atomic<uint64_t> reads(0);
+      std::vector<std::thread> threads;
+      uint64_t reportsstart = transport->Reports();
+      auto start = Clock::now();
+      for (int32_t t = 0; t < readers; t++)
+      {
+        threads.emplace_back([&, t]()
+        {
+          uint64_t count = 0;
+          XKCTRL::CONTROLLER_PACKED_STATE state;
+          while (running)
+          {
+            if (wait)
+              x360->GetWaitControllerState(t % 4, state, 10);
+            else
+              x360->GetControllerState(t % 4, state);
+            count++;
+          }
+          reads += count;
+        });
+      }
+
+      std::this_thread::sleep_for(duration);
+      running = false;
+      for (auto& thread : threads)
+        thread.join();
+      double elapsed = Seconds(start);
+
+      Results.Begin(std::string(wait ? "wait_state_readers_" : "get_state_readers_") + std::to_string(readers));
+      Results.Field("readers", readers);
+      Results.Field("reads_per_sec", static_cast<uint64_t>(reads / elapsed));
+      Results.Field("reports_per_sec", static_cast<uint64_t>((transport->Reports() - reportsstart) / elapsed));
+      Results.End();
+    }
+  }
+}
+
+// GetControllerStateAt and GetControllerChangesSince while the history is
+// written at full rate, queries look a few milliseconds into the past
+static void BenchHistory(BenchResults& Results)
+{
+  SyntheticTransport* transport = new SyntheticTransport(4, 0);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  const int32_t queries = 500000;
+  XKCTRL::CONTROLLER_PACKED_STATE state;
+  int32_t found = 0;
+  auto start = Clock::now();
+  for (int32_t i = 0; i < queries; i++)
+    found += x360->GetControllerStateAt(i % 4, NowNS() - 200000, state, true) ? 1 : 0;
+  double stateat = queries / Seconds(start);
+
+  XKCTRL::CONTROLLER_HISTORY_ENTRY entries[64];
+  uint64_t changes = 0;
+  start = Clock::now();
+  for (int32_t i = 0; i < queries; i++)
+    changes += x360->GetControllerChangesSince(i % 4, NowNS() - 200000, entries, 64);
+  double since = queries / Seconds(start);
+
+  Results.Begin("history");
+  Results.Field("state_at_per_sec", static_cast<uint64_t>(stateat));
+  Results.Field("state_at_found", found);
+  Results.Field("changes_since_per_sec", static_cast<uint64_t>(since));
+  Results.Field("changes_since_avg_entries", static_cast<double>(changes) / queries);
+  Results.End();
+}
+
+// Wakeups of filtered subscribers compared to a plain GetWaitControllerState
+// reader. The synthetic reports toggle A and move the left stick every time.
+static void BenchSubscriptions(BenchResults& Results)
+{
+  SyntheticTransport* transport = new SyntheticTransport(4, 0);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  XKCTRL::SUBSCRIPTION_FILTER buttona = {};
+  buttona.BUTTONS = XKCTRL::MASK_BTN_A;
+  XKCTRL::SUBSCRIPTION_FILTER buttonb = {};
+  buttonb.BUTTONS = XKCTRL::MASK_BTN_B;
+  XKCTRL::SUBSCRIPTION_FILTER stick = {};
+  stick.LSTICK_X_DELTA = 2800;
+  const std::vector<std::pair<std::string, XKCTRL::SUBSCRIPTION_FILTER>> filters =
+    {{"button_a", buttona}, {"button_b", buttonb}, {"stick_delta", stick}};
+
+  std::atomic<bool> running(true);
+  std::vector<int32_t> ids;
+  std::vector<uint64_t> wakeups(filters.size() + 1, 0);
+  std::vector<std::thread> threads;
+  for (size_t f = 0; f < filters.size(); f++)
+  {
+    ids.push_back(x360->Subscribe(0, filters[f].second));
+    threads.emplace_back([&, f]()
+    {
+      XKCTRL::CONTROLLER_PACKED_STATE state;
+      while (running)
+        wakeups[f] += x360->WaitSubscription(ids[f], state, 10) ? 1 : 0;
+    });
+  }
+  threads.emplace_back([&]()
+  {
+    XKCTRL::CONTROLLER_PACKED_STATE state;
+    while (running)
+      wakeups[filters.size()] += x360->GetWaitControllerState(0, state, 10) ? 1 : 0;
+  });
+
+  uint64_t reportsstart = transport->Reports();
+  auto start = Clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  running = false;
+  for (auto& thread : threads)
+    thread.join();
+  double elapsed = Seconds(start);
+
+  Results.Begin("subscriptions");
+  Results.Field("reports_per_sec_per_controller", static_cast<uint64_t>((transport->Reports() - reportsstart) / elapsed / 4));
+  Results.Field("unfiltered_wakeups_per_sec", static_cast<uint64_t>(wakeups[filters.size()] / elapsed));
+  for (size_t f = 0; f < filters.size(); f++)
+  {
+    XKCTRL::SUBSCRIPTION_STATS stats;
+    x360->GetSubscriptionStats(ids[f], stats);
+    Results.Field(filters[f].first + "_wakeups_per_sec", static_cast<uint64_t>(wakeups[f] / elapsed));
+    Results.Field(filters[f].first + "_delivered", stats.DELIVERED);
+    Results.Field(filters[f].first + "_suppressed", stats.SUPPRESSED);
+  }
+  Results.End();
+}
+
+// One thread serving 4 controllers at 1kHz with WaitAny and consistent
+// snapshots of all controllers, instead of a thread per controller
+static void BenchWaitAny(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 1000000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  std::unique_ptr<XKCTRL::CONTROLLER_SNAPSHOT> snapshot(new XKCTRL::CONTROLLER_SNAPSHOT);
+  const int32_t snapshots = 200000;
+  auto start = Clock::now();
+  for (int32_t i = 0; i < snapshots; i++)
+  {
+    x360->GetAllControllerStates(*snapshot);
+    asm volatile("" : : "r"(snapshot.get()) : "memory");
+  }
+  double snapshotns = Seconds(start) * 1e9 / snapshots;
+
+  uint64_t wakeups = 0, changes = 0, missed = 0;
+  x360->GetAllControllerStates(*snapshot);
+  start = Clock::now();
+  while (Seconds(start) < 1.0)
+  {
+    uint64_t changed = x360->WaitAny(snapshot->GENERATIONS, 10);
+    if (!changed)
+      continue;
+    uint64_t last[MAX_CONTROLLERS];
+    memcpy(last, snapshot->GENERATIONS, sizeof(last));
+    x360->GetAllControllerStates(*snapshot);
+    wakeups++;
+    for (int32_t c = 0; c < controllers; c++)
+    {
+      changes += (changed >> c) & 0x01;
+      // states published between two snapshots that were never seen
+      missed += snapshot->GENERATIONS[c] - last[c] - ((changed >> c) & 0x01);
+    }
+  }
+  double elapsed = Seconds(start);
+
+  Results.Begin("wait_any");
+  Results.Field("controllers", controllers);
+  Results.Field("snapshot_ns", snapshotns);
+  Results.Field("wakeups_per_sec", static_cast<uint64_t>(wakeups / elapsed));
+  Results.Field("controllers_per_wakeup", wakeups ? static_cast<double>(changes) / wakeups : 0.0);
+  Results.Field("states_coalesced", missed);
+  Results.End();
+}
+
+// 10k asynchronous state waits spread over 4 controllers at 1kHz, each one
+// waits again from its completion callback, no thread per waiter
+struct BenchWaits
+{
+  XKCTRL::XBOX360* X360;
+  std::atomic<bool> Running;
+  std::atomic<uint64_t> Completed;
+  XKCTRL::StatsHistogram Latency;
+};
+
+static void BenchWaitComplete(XKCTRL::ControllerWaiter* Waiter)
+{
+  BenchWaits* waits = static_cast<BenchWaits*>(Waiter->Context);
+  if (!waits->Running || Waiter->Result != XKCTRL::WAIT_READY)
+    return;
+  waits->Latency.Record(NowNS() - Waiter->Event.TIMESTAMP_NS);
+  waits->Completed.fetch_add(1, std::memory_order_relaxed);
+  waits->X360->WaitAsync(*Waiter);
+}
+
+static void BenchAsyncWaits(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  const int32_t waiters = 10000;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 1000000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  std::unique_ptr<BenchWaits> waits(new BenchWaits);
+  waits->X360 = x360.get();
+  waits->Running = true;
+  waits->Completed = 0;
+  std::unique_ptr<XKCTRL::ControllerWaiter[]> waiter(new XKCTRL::ControllerWaiter[waiters]);
+  double cpustart = CPUSeconds();
+  auto start = Clock::now();
+  for (int32_t i = 0; i < waiters; i++)
+  {
+    waiter[i].Controller = i % controllers;
+    waiter[i].Complete = BenchWaitComplete;
+    waiter[i].Context = waits.get();
+    x360->WaitAsync(waiter[i]);
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  waits->Running = false;
+  double elapsed = Seconds(start);
+  double cpu = CPUSeconds() - cpustart;
+
+  // waits that are not re-armed any more complete with the cancel
+  for (int32_t i = 0; i < waiters; i++)
+    x360->CancelWait(waiter[i]);
+  x360.reset();
+
+  XKCTRL::HISTOGRAM latency;
+  waits->Latency.Snapshot(latency);
+  Results.Begin("async_waits");
+  Results.Field("waiters", waiters);
+  Results.Field("completions_per_sec", static_cast<uint64_t>(waits->Completed / elapsed));
+  Results.Field("latency_ns_p50", XKCTRL::HistogramPercentile(latency, 0.50));
+  Results.Field("latency_ns_p99", XKCTRL::HistogramPercentile(latency, 0.99));
+  Results.Field("cpu_percent", 100.0 * cpu / elapsed);
+  Results.End();
+}
+
+// A SharedPublisher and a SharedClient in the same process, the client side
+// is what other processes see: state reads straight from shared memory and
+// report to client latency through the publisher at a paced 1kHz.
+static void BenchShared(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 1000000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::unique_ptr<XKCTRL::SharedPublisher> publisher;
+  std::unique_ptr<XKCTRL::SharedClient> client;
+  try
+  {
+    publisher.reset(new XKCTRL::SharedPublisher(*x360, "/xbox360-bench"));
+    client.reset(new XKCTRL::SharedClient("/xbox360-bench"));
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "Skipping shared memory bench: " << e.what() << '\n';
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  const int32_t reads = 2000000;
+  XKCTRL::CONTROLLER_PACKED_STATE state;
+  auto start = Clock::now();
+  for (int32_t i = 0; i < reads; i++)
+  {
+    client->GetControllerState(i % controllers, state);
+    asm volatile("" : : "r"(&state) : "memory");
+  }
+  double readrate = reads / Seconds(start);
+
+  XKCTRL::SHARED_EVENT events[256];
+  uint64_t dropped = 0, lost = 0;
+  client->ReadEvents(events, 256, lost);
+  std::vector<uint64_t> latency;
+  start = Clock::now();
+  while (Seconds(start) < 1.0)
+  {
+    if (!client->GetWaitControllerState(0, state, 10))
+      continue;
+    size_t count = client->ReadEvents(events, 256, lost);
+    uint64_t now = NowNS();
+    for (size_t i = 0; i < count; i++)
+      latency.push_back(now - events[i].EVENT.TIMESTAMP_NS);
+    dropped += lost;
+  }
+
+  Results.Begin("shared_memory");
+  Results.Field("client_reads_per_sec", static_cast<uint64_t>(readrate));
+  Results.Field("events", latency.size());
+  Results.Field("dropped", dropped);
+  Results.Percentiles("latency_ns", latency);
+  Results.End();
+}
+
+// UDP bridge over loopback, 4 controllers at 1kHz streamed with the default
+// 1ms tick. A tick adds up to one tick of latency on top of the transit time.
+static void BenchBridge(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 1000000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  XKCTRL::BRIDGE_CONFIG config = XKCTRL::DefaultBridgeConfig();
+  config.PORT = 36123;
+  std::unique_ptr<XKCTRL::BridgeServer> server;
+  std::unique_ptr<XKCTRL::BridgeClient> client;
+  try
+  {
+    server.reset(new XKCTRL::BridgeServer(*x360, config));
+    client.reset(new XKCTRL::BridgeClient("127.0.0.1", config.PORT));
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "Skipping udp bridge bench: " << e.what() << '\n';
+    return;
+  }
+
+  XKCTRL::BRIDGE_STATS start, stats;
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  client->GetBridgeStats(start);
+  auto begin = Clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  client->GetBridgeStats(stats);
+  double elapsed = Seconds(begin);
+
+  XKCTRL::CONTROLLER_PACKED_STATE remote;
+  client->GetControllerState(0, remote);
+
+  XKCTRL::HISTOGRAM transit;
+  client->GetTransitTime(transit);
+  uint64_t datagrams = stats.DATAGRAMS - start.DATAGRAMS;
+  uint64_t bytes = stats.BYTES - start.BYTES;
+
+  Results.Begin("udp_bridge");
+  Results.Field("controllers", controllers);
+  Results.Field("tick_us", config.TICK_US);
+  Results.Field("datagrams_per_sec", static_cast<uint64_t>(datagrams / elapsed));
+  Results.Field("bytes_per_sec", static_cast<uint64_t>(bytes / elapsed));
+  Results.Field("bytes_per_datagram", datagrams ? bytes / datagrams : 0);
+  Results.Field("keyframes", stats.KEYFRAMES - start.KEYFRAMES);
+  Results.Field("gaps", stats.GAPS - start.GAPS);
+  Results.Field("connected", remote.CONNECTED() ? 1 : 0);
+  Results.Field("transit_ns_p50", XKCTRL::HistogramPercentile(transit, 0.50));
+  Results.Field("transit_ns_p99", XKCTRL::HistogramPercentile(transit, 0.99));
+  Results.Field("transit_ns_max", transit.MAX);
+  Results.End();
+}
+
+// Per call latency of SetRumble with input at full rate and 4 readers
+static void BenchRumble(BenchResults& Results)
+{
+  SyntheticTransport* transport = new SyntheticTransport(4, 0);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+
+  std::atomic<bool> running(true);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 4; t++)
+  {
+    threads.emplace_back([&, t]()
+    {
+      XKCTRL::CONTROLLER_PACKED_STATE state;
+      while (running)
+        x360->GetControllerState(t, state);
+    });
+  }
+
+  const int32_t calls = 200000;
+  std::vector<uint64_t> latency;
+  latency.reserve(calls);
+  for (int32_t i = 0; i < calls; i++)
+  {
+    uint64_t start = NowNS();
+    x360->SetRumble(i % 4, static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8));
+    latency.push_back(NowNS() - start);
+  }
+  running = false;
+  for (auto& thread : threads)
+    thread.join();
+
+  XKCTRL::OUTPUT_STATS stats;
+  x360->GetOutputStats(stats);
+
+  Results.Begin("set_rumble");
+  Results.Field("calls", calls);
+  Results.Percentiles("latency_ns", latency);
+  Results.Field("coalesced", stats.COALESCED);
+  Results.Field("sent", transport->Sent());
+  Results.End();
+}
+
+// SetRumbleTimed racing the stops of its own expiring timers. Each round
+// ends with one more timed rumble, after everything expired the motors must
+// be on if that one is still running and off if it ran out.
+static void BenchRumbleRace(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  const int32_t rounds = 40;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 100000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  uint64_t calls = 0;
+  uint64_t failures = 0;
+  for (int32_t round = 0; round < rounds; round++)
+  {
+    bool staying = (round % 2 == 0);
+    std::vector<std::thread> threads;
+    for (int32_t c = 0; c < controllers; c++)
+    {
+      threads.emplace_back([&, c]()
+      {
+        uint64_t seed = round * controllers + c + 1;
+        for (int32_t i = 0; i < 50; i++)
+        {
+          x360->SetRumbleTimed(c, 0x10, 0x20, 1 + BenchRandom(seed) % 3);
+          std::this_thread::sleep_for(std::chrono::microseconds(BenchRandom(seed) % 1500));
+        }
+        x360->SetRumbleTimed(c, 0xAA, 0x55, staying ? 60000 : 2);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    calls += controllers * 51;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int32_t c = 0; c < controllers; c++)
+    {
+      if (transport->LastRumble(c) != (staying ? 0xAA55 : 0x0000))
+        failures++;
+    }
+  }
+
+  Results.Begin("rumble_timed_race");
+  Results.Field("controllers", controllers);
+  Results.Field("rounds", rounds);
+  Results.Field("calls", calls);
+  Results.Field("failures", failures);
+  Results.End();
+
+  if (failures)
+  {
+    std::cerr << "ERROR: " << failures << " timed rumbles left in the wrong state" << '\n';
+    BenchFailed = true;
+  }
+}
+
+// Haptic tracks streamed to many controllers at once, how many frames the
+// rumble scheduler gets out on time and what building a track costs.
+static void BenchHaptics(BenchResults& Results)
+{
+  const int32_t controllers = 16;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 0);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+  // ten seconds of 8kHz samples, resampled to the frame rate
+  std::vector<uint8_t> big(80000), small(80000);
+  for (size_t i = 0; i < big.size(); i++)
+  {
+    big[i] = static_cast<uint8_t>(127.5 + 127.5 * sin(i * 0.01));
+    small[i] = static_cast<uint8_t>((i * 7919) >> 3);
+  }
+  auto start = Clock::now();
+  auto samples = XKCTRL::HapticTrack::FromSamples(big.data(), small.data(), big.size(), 8000);
+  double resample = Seconds(start);
+
+  XKCTRL::HAPTIC_ENVELOPE hum = {XKCTRL::HAPTIC_SINE, 200, 30.0f, 50, 100, 0.6f, 800, 50};
+  XKCTRL::HAPTIC_ENVELOPE rattle = {XKCTRL::HAPTIC_NOISE, 255, 0.0f, 0, 200, 0.3f, 700, 100};
+  start = Clock::now();
+  auto envelopes = XKCTRL::HapticTrack::FromEnvelopes(hum, rattle);
+  double render = Seconds(start);
+
+  for (int32_t c = 0; c < controllers; c++)
+    x360->PlayHaptics(c, (c % 2) ? samples : envelopes, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+  XKCTRL::HAPTIC_STATS total = {};
+  for (int32_t c = 0; c < controllers; c++)
+  {
+    XKCTRL::HAPTIC_STATS stats;
+    x360->GetHapticStats(c, stats);
+    x360->StopHaptics(c);
+    total.FRAMES += stats.FRAMES;
+    total.QUEUED += stats.QUEUED;
+    total.UNCHANGED += stats.UNCHANGED;
+    total.DROPPED += stats.DROPPED;
+    total.LATE += stats.LATE;
+  }
+
+  Results.Begin("haptics");
+  Results.Field("controllers", controllers);
+  Results.Field("frame_hz", HAPTIC_FRAME_HZ);
+  Results.Field("resample_10s_8khz_us", resample * 1e6);
+  Results.Field("render_envelopes_us", render * 1e6);
+  Results.Field("frames", total.FRAMES);
+  Results.Field("queued", total.QUEUED);
+  Results.Field("unchanged", total.UNCHANGED);
+  Results.Field("dropped", total.DROPPED);
+  Results.Field("late", total.LATE);
+  Results.End();
+}
+
+// Report to consumer latency at a paced 1kHz report rate per controller,
+// measured from transfer completion to the consumer holding the event.
+static void BenchEndToEnd(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 1000000);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+
+  // let the connect burst settle
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (int32_t c = 0; c < controllers; c++)
+  {
+    XKCTRL::CONTROLLER_EVENT events[MAX_CONTROLLER_EVENTS];
+    uint64_t dropped;
+    x360->ReadControllerEvents(c, events, MAX_CONTROLLER_EVENTS, dropped);
+  }
+
+  std::atomic<bool> running(true);
+  std::vector<std::vector<uint64_t>> latency(controllers);
+  std::vector<std::thread> threads;
+  std::atomic<uint64_t> dropped(0);
+  double cpustart = CPUSeconds();
+  auto start = Clock::now();
+  for (int32_t c = 0; c < controllers; c++)
+  {
+    threads.emplace_back([&, c]()
+    {
+      XKCTRL::CONTROLLER_PACKED_STATE state;
+      XKCTRL::CONTROLLER_EVENT events[64];
+      uint64_t lost = 0;
+      while (running)
+      {
+        if (!x360->GetWaitControllerState(c, state, 10))
+          continue;
+        size_t count = x360->ReadControllerEvents(c, events, 64, lost);
+        uint64_t now = NowNS();
+        for (size_t i = 0; i < count; i++)
+          latency[c].push_back(now - events[i].TIMESTAMP_NS);
+        dropped += lost;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  running = false;
+  for (auto& thread : threads)
+    thread.join();
+  double elapsed = Seconds(start);
+  double cpu = CPUSeconds() - cpustart;
+
+  std::vector<uint64_t> all;
+  for (auto& samples : latency)
+    all.insert(all.end(), samples.begin(), samples.end());
+
+  Results.Begin("end_to_end");
+  Results.Field("controllers", controllers);
+  Results.Field("report_rate_hz", 1000);
+  Results.Field("events", all.size());
+  Results.Field("dropped", dropped.load());
+  Results.Percentiles("latency_ns", all);
+  Results.Field("cpu_percent", 100.0 * cpu / elapsed);
+
+  // the library's own view of the same run
+  std::unique_ptr<XKCTRL::PERF_STATS> stats(new XKCTRL::PERF_STATS);
+  x360->GetPerfStats(*stats);
+  Results.Field("stats_decode_ns_p50", XKCTRL::HistogramPercentile(stats->DECODE_NS, 0.50));
+  Results.Field("stats_decode_ns_p99", XKCTRL::HistogramPercentile(stats->DECODE_NS, 0.99));
+  Results.Field("stats_interval_ns_p50", XKCTRL::HistogramPercentile(stats->REPORT_INTERVAL_NS[0], 0.50));
+  Results.Field("stats_interval_ns_p99", XKCTRL::HistogramPercentile(stats->REPORT_INTERVAL_NS[0], 0.99));
+  Results.Field("stats_output_ns_p50", XKCTRL::HistogramPercentile(stats->OUTPUT_NS, 0.50));
+  Results.Field("stats_mutex_contended", stats->MUTEX_CONTENDED);
+  Results.End();
+}
+
+// Wakeup and dispatch latency of a thread at default scheduling and with
+// SCHED_FIFO, the latter falls back to default without privileges
+static void BenchRealtime(BenchResults& Results)
+{
+  XKCTRL::REALTIME_CONFIG configs[2] = {XKCTRL::DefaultRealtimeConfig(), XKCTRL::DefaultRealtimeConfig()};
+  configs[1].POLICY = XKCTRL::REALTIME_FIFO;
+  configs[1].PRIORITY = 50;
+  configs[1].PREFAULT_STACK_KB = 256;
+
+  for (auto& config : configs)
+  {
+    XKCTRL::REALTIME_PROBE probe;
+    XKCTRL::RealtimeProbe(config, 1000, 1000, probe);
+
+    Results.Begin(config.POLICY == XKCTRL::REALTIME_OFF ? "realtime_default" : "realtime_fifo");
+    Results.Field("applied", probe.STATUS.POLICY != XKCTRL::REALTIME_OFF ? 1 : 0);
+    Results.Field("priority", probe.STATUS.PRIORITY);
+    Results.Field("wakeups", probe.WAKEUP_NS.COUNT);
+    Results.Field("wakeup_ns_p50", XKCTRL::HistogramPercentile(probe.WAKEUP_NS, 0.50));
+    Results.Field("wakeup_ns_p99", XKCTRL::HistogramPercentile(probe.WAKEUP_NS, 0.99));
+    Results.Field("wakeup_ns_max", probe.WAKEUP_NS.MAX);
+    Results.Field("dispatch_ns_p50", XKCTRL::HistogramPercentile(probe.DISPATCH_NS, 0.50));
+    Results.Field("dispatch_ns_p99", XKCTRL::HistogramPercentile(probe.DISPATCH_NS, 0.99));
+    Results.Field("dispatch_ns_max", probe.DISPATCH_NS.MAX);
+    Results.End();
+  }
+}
+
+// 10k timers on the rumble timer wheel, a third of them cancelled
+static void BenchTimers(BenchResults& Results)
+{
+  const int32_t timers = 10000;
+  XKCTRL::TimerWheel wheel;
+  std::atomic<int32_t> fired(0);
+  std::vector<uint64_t> lateness(timers, 0);
+  std::vector<XKCTRL::TimerWheel::TimerID> ids(timers);
+
+  uint32_t seed = 12345;
+  auto start = Clock::now();
+  for (int32_t i = 0; i < timers; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    uint32_t delay = 1 + (seed >> 16) % 500;
+    uint64_t due = NowNS() + delay * 1000000ULL;
+    ids[i] = wheel.Schedule(delay, [&, i, due]()
+    {
+      uint64_t now = NowNS();
+      lateness[i] = (now > due) ? now - due : 0;
+      fired++;
+    });
+  }
+  double schedulens = Seconds(start) * 1e9 / timers;
+
+  int32_t cancelled = 0;
+  for (int32_t i = 0; i < timers; i += 3)
+    cancelled += wheel.Cancel(ids[i]) ? 1 : 0;
+
+  // wait for every remaining timer, at most one revolution past the last one
+  while (fired + cancelled < timers && Seconds(start) < 2.0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  wheel.Stop();
+
+  std::vector<uint64_t> latems;
+  for (int32_t i = 0; i < timers; i++)
+  {
+    if (i % 3 != 0)
+      latems.push_back(lateness[i] / 1000);
+  }
+
+  Results.Begin("timer_wheel");
+  Results.Field("scheduled", timers);
+  Results.Field("cancelled", cancelled);
+  Results.Field("fired", fired.load());
+  Results.Field("schedule_ns", schedulens);
+  Results.Percentiles("lateness_us", latems);
+  Results.End();
+}
+
+// Input processing rate as the number of active controllers grows
+static void BenchScaling(BenchResults& Results)
+{
+  for (int32_t controllers : {4, 16, 64})
+  {
+    if (controllers > MAX_CONTROLLERS)
+      break;
+
+    SyntheticTransport* transport = new SyntheticTransport(controllers, 0);
+    std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    uint64_t reportsstart = transport->Reports();
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    double elapsed = Seconds(start);
+    uint64_t reports = transport->Reports() - reportsstart;
+
+    int32_t connected = 0;
+    for (int32_t c = 0; c < controllers; c++)
+    {
+      XKCTRL::CONTROLLER_PACKED_STATE state;
+      x360->GetControllerState(c, state);
+      connected += state.CONNECTED() ? 1 : 0;
+    }
+
+    Results.Begin("scaling_controllers_" + std::to_string(controllers));
+    Results.Field("controllers", controllers);
+    Results.Field("connected", connected);
+    Results.Field("reports_per_sec", static_cast<uint64_t>(reports / elapsed));
+    Results.Field("reports_per_sec_per_controller", static_cast<uint64_t>(reports / elapsed / controllers));
+    Results.End();
+  }
+}
+
+// Heap allocations on the report path once every controller is connected,
+// over a long run at full speed. Any allocation fails the bench.
+static void BenchAllocations(BenchResults& Results)
+{
+  const int32_t controllers = 4;
+  SyntheticTransport* transport = new SyntheticTransport(controllers, 0);
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+
+  // connecting queues output reports and completions, let them settle
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  uint64_t reportsstart = transport->Reports();
+  uint64_t allocationsstart = Allocations.load();
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  uint64_t allocations = Allocations.load() - allocationsstart;
+  uint64_t reports = transport->Reports() - reportsstart;
+
+  Results.Begin("steady_state_allocations");
+  Results.Field("controllers", controllers);
+  Results.Field("reports", reports);
+  Results.Field("allocations", allocations);
+  Results.Field("allocations_per_report", reports ? static_cast<double>(allocations) / reports : 0.0);
+  Results.End();
+
+  if (allocations || !reports)
+  {
+    std::cerr << "ERROR: " << allocations << " heap allocations over " << reports << " reports" << '\n';
+    BenchFailed = true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  // library chatter goes to stderr, results to stdout or a file
+  BenchResults results;
+  results.Begin("config");
+  results.Field("max_controllers", MAX_CONTROLLERS);
+  results.Field("hardware_threads", std::thread::hardware_concurrency());
+  results.Field("stats", XBOX360_STATS);
+  results.End();
+
+  BenchDecode(results);
+  BenchParser(results);
+  BenchAnalog(results);
+  BenchCombos(results);
+  BenchReaders(results);
+  BenchHistory(results);
+  BenchSubscriptions(results);
+  BenchAsyncWaits(results);
+  BenchWaitAny(results);
+  BenchRumble(results);
+  BenchRumbleRace(results);
+  BenchHaptics(results);
+  BenchEndToEnd(results);
+  BenchShared(results);
+  BenchBridge(results);
+  BenchRealtime(results);
+  BenchTimers(results);
+  BenchScaling(results);
+  BenchAllocations(results);
+
+  if (argc > 1)
+  {
+    std::ofstream file(argv[1]);
+    file << results.Json();
+  }
+  std::cout << results.Json();
+  return BenchFailed ? 1 : 0;
+}
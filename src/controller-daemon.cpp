@@ -0,0 +1,154 @@
+/* XBOX 360 Wireless Controller API [PUBLISHER DAEMON]
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Owns the receivers and publishes every controller into shared memory,
+// so any number of processes can read them through SharedClient. With
+// --udp they are also streamed to BridgeClients on other hosts. With
+// --realtime the device thread runs SCHED_FIFO at that priority with all
+// memory locked, --cpu pins it to one CPU. --mode sets the permissions of
+// the shared memory object, 0600 unless given, 0660 to let the group in.
+//   usage: controller-daemon [--name NAME] [--mode OCTAL] [--replay FILE]
+//                            [--udp PORT] [--realtime PRIORITY] [--cpu CPU]
+
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <iostream>
+#include <string>
+
+#include "XBOX360Shared.hpp"
+#include "XBOX360Bridge.hpp"
+
+static int Usage(const char* Program, const std::string& Error)
+{
+  if (!Error.empty())
+    std::cerr << "ERROR: " << Error << '\n';
+  std::cerr << "usage: " << Program << " [--name NAME] [--mode OCTAL] [--replay FILE]" << '\n'
+            << "       [--udp PORT] [--realtime PRIORITY] [--cpu CPU]" << '\n';
+  return Error.empty() ? 0 : 2;
+}
+
+// whole string as a number in Base within Min..Max, false otherwise
+static bool ParseNumber(const char* Text, const int Base, const long Min, const long Max, long& Value)
+{
+  char* end = nullptr;
+  errno = 0;
+  Value = strtol(Text, &end, Base);
+  return errno == 0 && end != Text && *end == '\0' && Value >= Min && Value <= Max;
+}
+
+int main(int argc, char** argv)
+{
+  std::string name = SHARED_DEFAULT_NAME;
+  mode_t mode = SHARED_DEFAULT_MODE;
+  std::string replay;
+  int32_t udpport = 0;
+  XKCTRL::REALTIME_CONFIG realtime = XKCTRL::DefaultRealtimeConfig();
+  for (int i = 1; i < argc; i++)
+  {
+    std::string option = argv[i];
+    if (option == "--help" || option == "-h")
+      return Usage(argv[0], "");
+    if (option != "--name" && option != "--mode" && option != "--replay" &&
+        option != "--udp" && option != "--realtime" && option != "--cpu")
+      return Usage(argv[0], "unknown option " + option);
+    if (i + 1 >= argc)
+      return Usage(argv[0], "missing value for " + option);
+
+    const char* value = argv[++i];
+    long number = 0;
+    if (option == "--name")
+      name = value;
+    else if (option == "--replay")
+      replay = value;
+    else if (option == "--mode")
+    {
+      if (!ParseNumber(value, 8, 0, 0777, number))
+        return Usage(argv[0], "--mode needs octal permissions such as 0660, not " + std::string(value));
+      mode = static_cast<mode_t>(number);
+    }
+    else if (option == "--udp")
+    {
+      if (!ParseNumber(value, 10, 1, 65535, number))
+        return Usage(argv[0], "--udp needs a port from 1 to 65535, not " + std::string(value));
+      udpport = static_cast<int32_t>(number);
+    }
+    else if (option == "--realtime")
+    {
+      if (!ParseNumber(value, 10, 1, 99, number))
+        return Usage(argv[0], "--realtime needs a priority from 1 to 99, not " + std::string(value));
+      realtime.POLICY = XKCTRL::REALTIME_FIFO;
+      realtime.PRIORITY = static_cast<int32_t>(number);
+      realtime.LOCK_MEMORY = true;
+      realtime.PREFAULT_STACK_KB = 256;
+    }
+    else if (option == "--cpu")
+    {
+      // CPU_MASK holds one bit per CPU
+      if (!ParseNumber(value, 10, 0, 63, number))
+        return Usage(argv[0], "--cpu needs a CPU from 0 to 63, not " + std::string(value));
+      realtime.CPU_MASK = 1ULL << number;
+    }
+  }
+
+  // block the stop signals before any thread starts, then wait for them here
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  try
+  {
+    std::unique_ptr<XKCTRL::Transport> transport;
+    if (!replay.empty())
+      transport.reset(new XKCTRL::ReplayTransport(replay));
+    else
+      transport.reset(new XKCTRL::LibUSBTransport());
+    XKCTRL::XBOX360 x360(std::move(transport), realtime);
+    XKCTRL::SharedPublisher publisher(x360, name, mode);
+    std::unique_ptr<XKCTRL::BridgeServer> bridge;
+    if (udpport > 0)
+    {
+      XKCTRL::BRIDGE_CONFIG config = XKCTRL::DefaultBridgeConfig();
+      config.PORT = static_cast<uint16_t>(udpport);
+      bridge.reset(new XKCTRL::BridgeServer(x360, config));
+      std::cout << "Streaming controllers on UDP port " << udpport << std::endl;
+    }
+    if (realtime.POLICY != XKCTRL::REALTIME_OFF)
+    {
+      XKCTRL::REALTIME_PROBE probe;
+      x360.ProbeRealtime(1000, 1000, probe);
+      std::cout << "Device thread wakeup latency p99 " << XKCTRL::HistogramPercentile(probe.WAKEUP_NS, 0.99)
+                << "ns, dispatch latency p99 " << XKCTRL::HistogramPercentile(probe.DISPATCH_NS, 0.99) << "ns" << std::endl;
+    }
+    std::cout << "Publishing controllers on " << name << ", stop with Ctrl+C" << std::endl;
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    std::cout << "Stopping, " << publisher.Published() << " events published, "
+              << publisher.Dropped() << " dropped" << std::endl;
+  }
+  catch(const std::exception& e)
+  {
+    std::cerr << "ERROR: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
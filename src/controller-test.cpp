@@ -18,12 +18,20 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include <iostream>
+#include <string>
 
 #include "XBOX360.hpp"
 
 int main(int argc, char** argv) 
 {  
-  XKCTRL::XBOX360 x360;
+  // optional: --record FILE captures raw reports, --replay FILE plays them back
+  std::unique_ptr<XKCTRL::Transport> transport(new XKCTRL::LibUSBTransport());
+  if (argc > 2 && std::string(argv[1]) == "--record")
+    transport.reset(new XKCTRL::RecordTransport(std::move(transport), argv[2]));
+  else if (argc > 2 && std::string(argv[1]) == "--replay")
+    transport.reset(new XKCTRL::ReplayTransport(argv[2]));
+
+  XKCTRL::XBOX360 x360(std::move(transport));
   std::cout << "Use Triggers for Rumble and press XBOX button to quit" << std::endl;
 
   int32_t idx = 0;
@@ -0,0 +1,290 @@
+/* XBOX 360 Wireless Controller API
+
+Copyright (C) 2021 Koos du Preez (kdupreez@hotmail.com)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// Drives the C++20 awaitables in XBOX360Coro.hpp through completion,
+// cancellation and timeout against a scripted in-process transport, so no
+// hardware is needed. Exits with an error if any check fails.
+//   usage: coro-test
+
+#include <string.h>
+#include <iostream>
+#include <thread>
+
+#include "XBOX360.hpp"
+#include "XBOX360Decode.hpp"
+#include "XBOX360Coro.hpp"
+
+// Delivers the reports the test pushes, output reports complete right away
+// and the last rumble weights sent are kept for checking.
+class ScriptTransport : public XKCTRL::Transport
+{
+  public:
+    void Run(XKCTRL::TransportSink* Sink) override
+    {
+      std::unique_lock<std::mutex> lock(Mutex_);
+      while (Running_)
+      {
+        Notify_.wait_for(lock, std::chrono::milliseconds(1));
+        while (!Reports_.empty())
+        {
+          std::vector<uint8_t> report = Reports_.front();
+          Reports_.pop_front();
+          lock.unlock();
+          Sink->TransportReport(0, report.data(), report.size(), Now());
+          lock.lock();
+        }
+        while (Sent_)
+        {
+          // completions go out without the lock, Send may be called from them
+          Sent_--;
+          lock.unlock();
+          Sink->TransportSent(0, true);
+          lock.lock();
+        }
+      }
+    }
+
+    void Stop() override
+    {
+      {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Running_ = false;
+      }
+      Notify_.notify_all();
+    }
+
+    bool Send(const int32_t ControllerIndex, const uint8_t* Data, const size_t Length) override
+    {
+      std::lock_guard<std::mutex> guard(Mutex_);
+      if (Length > 6 && Data[1] == 0x01 && Data[2] == 0x0f && Data[3] == 0xc0)
+        LastRumble_ = (Data[5] << 8) | Data[6];
+      Sent_++;
+      return true;
+    }
+
+    void GetReceiverStats(XKCTRL::RECEIVER_STATS& ReceiverStats) override
+    {
+      ReceiverStats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    // a report for controller 0 as the wireless receiver sends it
+    void Push(const std::vector<uint8_t>& Report)
+    {
+      {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Reports_.push_back(Report);
+      }
+      Notify_.notify_all();
+    }
+
+    void Link(const bool Connected)
+    {
+      Push({0x08, static_cast<uint8_t>(Connected ? 0x80 : 0x00)});
+    }
+
+    void Buttons(const uint16_t Buttons)
+    {
+      std::vector<uint8_t> report(29, 0x00);
+      report[1] = 0x01;
+      report[3] = 0xF0;
+      report[5] = 0x13;
+      memcpy(&report[REPORT_LAYOUT_OFFSET], &Buttons, sizeof(Buttons));
+      Push(report);
+    }
+
+    uint16_t LastRumble()
+    {
+      std::lock_guard<std::mutex> guard(Mutex_);
+      return LastRumble_;
+    }
+
+  private:
+    std::mutex Mutex_;
+    std::condition_variable Notify_;
+    std::deque<std::vector<uint8_t>> Reports_;
+    bool Running_ = true;
+    int32_t Sent_ = 0;
+    uint16_t LastRumble_ = 0;
+
+    static uint64_t Now()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Fire and forget coroutine, runs up to its first suspension when called
+struct CoroTask
+{
+  struct promise_type
+  {
+    CoroTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// What one coroutine saw when its await resumed
+struct CORO_CHECK
+{
+  std::atomic<bool> DONE{false};
+  XKCTRL::WAIT_RESULT RESULT = XKCTRL::WAIT_PENDING;
+  uint16_t BUTTONS = 0;
+  uint16_t PRESSED = 0;
+};
+
+static CoroTask AwaitState(XKCTRL::CoroController& Input, const uint32_t TimeoutMS, XKCTRL::CoroCancel* Cancel, CORO_CHECK& Check)
+{
+  XKCTRL::CORO_STATE state = co_await Input.NextState(0, TimeoutMS, Cancel);
+  Check.RESULT = state.RESULT;
+  Check.BUTTONS = state.STATE.BUTTONS;
+  Check.DONE = true;
+}
+
+static CoroTask AwaitEvent(XKCTRL::CoroController& Input, const uint16_t Buttons, const uint32_t TimeoutMS, XKCTRL::CoroCancel* Cancel, CORO_CHECK& Check)
+{
+  XKCTRL::CORO_EVENT event = co_await Input.NextEvent(0, Buttons, 0, TimeoutMS, Cancel);
+  Check.RESULT = event.RESULT;
+  Check.BUTTONS = event.EVENT.BUTTONS;
+  Check.PRESSED = event.EVENT.PRESSED;
+  Check.DONE = true;
+}
+
+static CoroTask AwaitRumble(XKCTRL::CoroController& Input, const uint32_t DurationMS, XKCTRL::CoroCancel* Cancel, CORO_CHECK& Check)
+{
+  Check.RESULT = co_await Input.RumbleFor(0, 0x40, 0x80, DurationMS, Cancel);
+  Check.DONE = true;
+}
+
+static int32_t Failures = 0;
+
+static void Expect(const bool Condition, const char* Name)
+{
+  std::cout << (Condition ? "PASS " : "FAIL ") << Name << '\n';
+  if (!Condition)
+    Failures++;
+}
+
+// true once the coroutine finished, false if it did not within TimeoutMS
+static bool WaitDone(CORO_CHECK& Check, const uint32_t TimeoutMS = 2000)
+{
+  auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(TimeoutMS);
+  while (!Check.DONE && std::chrono::steady_clock::now() < due)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return Check.DONE;
+}
+
+static void Settle()
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+int main()
+{
+  ScriptTransport* transport = new ScriptTransport();
+  std::unique_ptr<XKCTRL::XBOX360> x360(new XKCTRL::XBOX360(std::unique_ptr<XKCTRL::Transport>(transport)));
+  XKCTRL::CoroQueue queue;
+  XKCTRL::CoroController input(*x360, queue);
+  std::thread executor([&]() { queue.Run(); });
+
+  transport->Link(true);
+  Settle();
+
+  // NextState completes with the next report
+  {
+    CORO_CHECK check;
+    AwaitState(input, 1000, nullptr, check);
+    transport->Buttons(XKCTRL::MASK_BTN_A);
+    Expect(WaitDone(check) && check.RESULT == XKCTRL::WAIT_READY && (check.BUTTONS & XKCTRL::MASK_BTN_A), "NextState completes on a report");
+  }
+
+  // NextEvent ignores buttons outside its mask
+  {
+    CORO_CHECK check;
+    AwaitEvent(input, XKCTRL::MASK_BTN_B, 1000, nullptr, check);
+    transport->Buttons(0x0000);
+    Settle();
+    Expect(!check.DONE, "NextEvent ignores other buttons");
+    transport->Buttons(XKCTRL::MASK_BTN_B);
+    Expect(WaitDone(check) && check.RESULT == XKCTRL::WAIT_READY && check.PRESSED == XKCTRL::MASK_BTN_B, "NextEvent completes on a press");
+  }
+
+  // timeouts
+  {
+    CORO_CHECK state, event;
+    AwaitState(input, 30, nullptr, state);
+    AwaitEvent(input, XKCTRL::MASK_BTN_X, 30, nullptr, event);
+    Expect(WaitDone(state) && state.RESULT == XKCTRL::WAIT_TIMEOUT, "NextState times out");
+    Expect(WaitDone(event) && event.RESULT == XKCTRL::WAIT_TIMEOUT, "NextEvent times out");
+  }
+
+  // one cancel ends every pending await, and awaits started after it right away
+  {
+    XKCTRL::CoroCancel cancel;
+    CORO_CHECK state, event, later;
+    AwaitState(input, 0, &cancel, state);
+    AwaitEvent(input, XKCTRL::MASK_BTN_Y, 60000, &cancel, event);
+    Settle();
+    Expect(!state.DONE && !event.DONE, "awaits pending before the cancel");
+    cancel.Cancel();
+    Expect(WaitDone(state) && state.RESULT == XKCTRL::WAIT_CANCELLED, "NextState cancelled");
+    Expect(WaitDone(event) && event.RESULT == XKCTRL::WAIT_CANCELLED, "NextEvent cancelled before its timeout");
+    AwaitState(input, 0, &cancel, later);
+    Expect(later.DONE && later.RESULT == XKCTRL::WAIT_CANCELLED, "NextState after the cancel does not suspend");
+  }
+
+  // RumbleFor resumes once the rumble stopped on its own
+  {
+    CORO_CHECK check;
+    AwaitRumble(input, 50, nullptr, check);
+    Settle();
+    Expect(!check.DONE && transport->LastRumble() == 0x4080, "RumbleFor rumbles");
+    Expect(WaitDone(check) && check.RESULT == XKCTRL::WAIT_READY, "RumbleFor completes after its duration");
+    Settle();
+    Expect(transport->LastRumble() == 0x0000, "RumbleFor stops the rumble");
+  }
+
+  // cancelling a rumble stops it early
+  {
+    XKCTRL::CoroCancel cancel;
+    CORO_CHECK check;
+    AwaitRumble(input, 60000, &cancel, check);
+    Settle();
+    cancel.Cancel();
+    Expect(WaitDone(check) && check.RESULT == XKCTRL::WAIT_CANCELLED, "RumbleFor cancelled");
+    Settle();
+    Expect(transport->LastRumble() == 0x0000, "cancelled RumbleFor stops the rumble");
+  }
+
+  // an event wait ends when the controller goes away
+  {
+    CORO_CHECK check;
+    AwaitEvent(input, XKCTRL::MASK_BTN_A, 0, nullptr, check);
+    transport->Link(false);
+    Expect(WaitDone(check) && check.RESULT == XKCTRL::WAIT_DISCONNECTED, "NextEvent ends on disconnect");
+  }
+
+  queue.Stop();
+  executor.join();
+
+  std::cout << (Failures ? "FAILED " : "passed ") << Failures << " failures" << '\n';
+  return Failures ? 1 : 0;
+}